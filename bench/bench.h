@@ -0,0 +1,94 @@
+/*
+ * Helpers shared by the benchmarks: a monotonic clock, reporting, and
+ * loading a credential
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Current time in nanoseconds, from a clock unaffected by the system time */
+static inline long long benchNowNs( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Print one result line: the case, how many operations it ran, and the
+ * rate and mean cost they came to */
+static inline void benchReport( const char *name, long long ops,
+                                long long elapsedNs )
+{
+    double secs = elapsedNs / 1e9;
+
+    printf( "%-40s %10lld ops %12.0f ops/s %10.1f ns/op\n", name, ops,
+            secs > 0 ? ops / secs : 0.0,
+            ops > 0 ? (double)elapsedNs / ops : 0.0 );
+}
+
+static int benchCompareLL( const void *a, const void *b )
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/* Sort count samples in place and return the given percentile of them */
+static inline long long benchPercentile( long long *samples, size_t count,
+                                         double percentile )
+{
+    size_t index;
+
+    if( !count ) { return 0; }
+    qsort( samples, count, sizeof( long long ), benchCompareLL );
+    index = (size_t)( percentile / 100.0 * ( count - 1 ) + 0.5 );
+
+    return samples[index];
+}
+
+/* Return the contents of the first credential file in a directory */
+static inline char *benchReadCred( const char *dirname )
+{
+    DIR             *d      = dirname ? opendir( dirname ) : NULL;
+    struct dirent   *entry;
+    char            path[1024];
+    char            *cred   = NULL;
+    FILE            *fp;
+    long            len;
+
+    if( !d ) { return NULL; }
+    while( !cred && ( entry = readdir( d ) ) ) {
+        if( !strstr( entry->d_name, ".jwt" ) ) { continue; }
+        snprintf( path, sizeof( path ), "%s/%s", dirname, entry->d_name );
+        if( !( fp = fopen( path, "r" ) ) ) { continue; }
+        fseek( fp, 0, SEEK_END );
+        len = ftell( fp );
+        rewind( fp );
+        if( len > 0 && ( cred = malloc( len + 1 ) ) ) {
+            len = fread( cred, 1, len, fp );
+            /* Drop the trailing newline, if any */
+            while( len > 0 && ( cred[len - 1] == '\n' || cred[len - 1] == '\r' ) ) {
+                len--;
+            }
+            cred[len] = 0;
+        }
+        fclose( fp );
+    }
+    closedir( d );
+
+    return cred;
+}
+
+/* Keep the compiler from optimizing away a result */
+static volatile long long benchSink;
+
+#endif /* _BENCH_H_ */
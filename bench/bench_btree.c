@@ -0,0 +1,83 @@
+/*
+ * Benchmark for the btree that indexes services by name, from a thousand to
+ * a million entries
+ */
+
+#include "bench.h"
+#include "btree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compareInt( void *a, void *b )
+{
+    int x = *(int *)a;
+    int y = *(int *)b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/* Time inserting, finding and deleting count keys in random order */
+static void benchBtree( int count, unsigned int order )
+{
+    btree_t     *tree;
+    int         *keys;
+    char        label[64];
+    long long   start;
+    long long   found   = 0;
+    int         i;
+    int         j;
+    int         tmp;
+
+    keys = malloc( count * sizeof( int ) );
+    if( !keys ) { exit( 1 ); }
+    for( i = 0; i < count; i++ ) { keys[i] = i; }
+    srand( count );
+    for( i = count - 1; i > 0; i-- ) {
+        j = rand() % ( i + 1 );
+        tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    tree = btree_create( order, compareInt );
+
+    start = benchNowNs();
+    for( i = 0; i < count; i++ ) { btree_insert( tree, &keys[i] ); }
+    snprintf( label, sizeof( label ), "btree insert, order %u, %d", order,
+              count );
+    benchReport( label, count, benchNowNs() - start );
+
+    start = benchNowNs();
+    for( i = 0; i < count; i++ ) {
+        found += btree_search( tree, &keys[( i * 7 ) % count] ) != NULL;
+    }
+    snprintf( label, sizeof( label ), "btree search, order %u, %d", order,
+              count );
+    benchReport( label, count, benchNowNs() - start );
+    benchSink = found;
+
+    start = benchNowNs();
+    for( i = 0; i < count; i++ ) {
+        btree_delete( tree, tree->root, &keys[i] );
+    }
+    snprintf( label, sizeof( label ), "btree delete, order %u, %d", order,
+              count );
+    benchReport( label, count, benchNowNs() - start );
+
+    btree_destroy( tree );
+    free( keys );
+}
+
+int main( void )
+{
+    int count;
+
+    for( count = 1000; count <= 1000000; count *= 10 ) {
+        benchBtree( count, 2 );
+        benchBtree( count, 16 );
+    }
+
+    return 0;
+}
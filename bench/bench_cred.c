@@ -0,0 +1,129 @@
+/*
+ * Benchmark for validating the credentials presented by a peer: the full
+ * check of the JWT's RS256 signature, claims and certificate done for a new
+ * credential, against the digest that finds a credential in the cache.
+ *
+ * Usage: bench_cred <config file>. The certificate, CA certificate and first
+ * credential named by the configuration are used; the credential is timed
+ * even if it has expired, since the signature is checked first. Exits with
+ * 77, skipped, when the configuration or any of these cannot be loaded.
+ */
+
+#include "bench.h"
+
+#include <jansson.h>
+
+#include <openssl/pem.h>
+#include <openssl/sha.h>
+#include <openssl/ssl.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECKS 1000
+#define DIGESTS 100000
+
+/* Internal to the library */
+typedef struct TRviRights TRviRights;
+
+int rviDecodeCredentialKey( const char *caKey, const char *cred, X509 *cert,
+                            TRviRights **rights );
+
+int rviCredCacheKey( const char *cred, X509 *cert, unsigned char *digest );
+
+static X509 *benchReadCert( const char *path )
+{
+    FILE    *fp = path ? fopen( path, "r" ) : NULL;
+    X509    *cert;
+
+    if( !fp ) { return NULL; }
+    cert = PEM_read_X509( fp, NULL, NULL, NULL );
+    fclose( fp );
+
+    return cert;
+}
+
+/* Return the public key of a certificate as a PEM string */
+static char *benchPublicKey( X509 *cert )
+{
+    EVP_PKEY    *pkey   = X509_get_pubkey( cert );
+    BIO         *bio    = BIO_new( BIO_s_mem() );
+    char        *data;
+    char        *key    = NULL;
+    long        len;
+
+    if( pkey && bio && PEM_write_bio_PUBKEY( bio, pkey ) ) {
+        len = BIO_get_mem_data( bio, &data );
+        if( ( key = malloc( len + 1 ) ) ) {
+            memcpy( key, data, len );
+            key[len] = 0;
+        }
+    }
+    EVP_PKEY_free( pkey );
+    BIO_free( bio );
+
+    return key;
+}
+
+int main( int argc, char **argv )
+{
+    json_t          *conf;
+    json_error_t    error;
+    X509            *cert;
+    X509            *caCert;
+    char            *caKey;
+    char            *cred;
+    unsigned char   digest[SHA256_DIGEST_LENGTH];
+    long long       start;
+    long long       valid   = 0;
+    int             i;
+
+    if( argc != 2 ) {
+        fprintf( stderr, "Usage: %s <config file>\n", argv[0] );
+        return 2;
+    }
+
+    SSL_library_init();
+
+    conf = json_load_file( argv[1], 0, &error );
+    if( !conf ) {
+        fprintf( stderr, "%s: %s, skipping\n", argv[1], error.text );
+        return 77;
+    }
+    cert = benchReadCert( json_string_value(
+                json_object_get( json_object_get( conf, "dev" ), "cert" ) ) );
+    caCert = benchReadCert( json_string_value(
+                json_object_get( json_object_get( conf, "ca" ), "cert" ) ) );
+    caKey = caCert ? benchPublicKey( caCert ) : NULL;
+    cred = benchReadCred( json_string_value(
+                json_object_get( conf, "creddir" ) ) );
+    if( !cert || !caKey || !cred ) {
+        fprintf( stderr, "%s: missing certificate or credential, skipping\n", 
+                 argv[1] );
+        return 77;
+    }
+
+    start = benchNowNs();
+    for( i = 0; i < CHECKS; i++ ) {
+        valid += ( rviDecodeCredentialKey( caKey, cred, cert, NULL ) == 0 );
+    }
+    benchReport( "credential, full check", CHECKS, benchNowNs() - start );
+    if( !valid ) {
+        printf( "  (the credential did not validate, e.g., it has expired)\n" );
+    }
+
+    start = benchNowNs();
+    for( i = 0; i < DIGESTS; i++ ) {
+        rviCredCacheKey( cred, cert, digest );
+    }
+    benchReport( "credential, cache key", DIGESTS, benchNowNs() - start );
+    benchSink = digest[0];
+
+    X509_free( cert );
+    X509_free( caCert );
+    free( caKey );
+    free( cred );
+    json_decref( conf );
+
+    return 0;
+}
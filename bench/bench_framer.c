@@ -0,0 +1,74 @@
+/*
+ * Benchmark for framing the stream of messages received from a remote, as
+ * rviReadMessages() does: pipelined messages that arrive together, and
+ * messages fragmented over many reads
+ */
+
+#include "bench.h"
+#include "rvi_buffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MESSAGES 200000
+
+static const char message[] =
+    "{\"cmd\":\"rcv\",\"tid\":1234,\"mod\":\"proto_json_rpc\","
+    "\"data\":{\"service\":\"genivi.org/vin/00000001/hvac/status\","
+    "\"timeout\":1500000000000,\"parameters\":"
+    "{\"temp\":21.5,\"fan\":[1,2,3],\"note\":\"a \\\"quoted\\\" {brace}\"}}}";
+
+/* Feed the framer chunk bytes at a time, and consume each message found */
+static void benchFramer( const char *label, size_t chunk )
+{
+    TRviBuffer  buf;
+    TRviFramer  framer;
+    char        *stream;
+    size_t      msgLen  = strlen( message );
+    size_t      total   = msgLen * MESSAGES;
+    size_t      offset;
+    size_t      n;
+    size_t      len;
+    long long   start;
+    long long   found   = 0;
+    int         i;
+
+    stream = malloc( total );
+    if( !stream ) { exit( 1 ); }
+    for( i = 0; i < MESSAGES; i++ ) {
+        memcpy( stream + i * msgLen, message, msgLen );
+    }
+
+    rviBufferInitialize( &buf );
+    rviFramerInitialize( &framer );
+
+    start = benchNowNs();
+    for( offset = 0; offset < total; offset += n ) {
+        n = ( total - offset < chunk ) ? total - offset : chunk;
+        rviBufferAppend( &buf, stream + offset, n );
+        while( ( len = rviFramerNext( &framer, &buf ) ) ) {
+            rviBufferConsume( &buf, len );
+            found++;
+        }
+    }
+    benchReport( label, found, benchNowNs() - start );
+
+    if( found != MESSAGES ) {
+        fprintf( stderr, "%s: framed %lld of %d messages\n", label, found,
+                 MESSAGES );
+        exit( 1 );
+    }
+
+    rviBufferFree( &buf );
+    free( stream );
+}
+
+int main( void )
+{
+    benchFramer( "framer, pipelined 16K reads", 16384 );
+    benchFramer( "framer, whole messages", strlen( message ) );
+    benchFramer( "framer, fragmented 7 byte reads", 7 );
+    benchFramer( "framer, fragmented 1 byte reads", 1 );
+
+    return 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * Load generator for the path an invocation takes end to end: from
+ * rviInvokeServiceRaw() through TLS to a peer, and back to a service
+ * callback via rviProcessInput() and rviReadRcv().
+ *
+ * The library only opens connections, so the peer is a minimal TLS server on
+ * a thread of its own, using the same device certificate and credential from
+ * the configuration. It announces a sink service, and answers each
+ * invocation of it by invoking the client's echo service with the same
+ * parameters, which carry the time the invocation was made.
+ *
+ * Usage: bench_loopback <config file> [messages]. Exits with 77, skipped,
+ * when the configuration cannot be loaded, e.g., its credential has expired.
+ */
+
+#include "bench.h"
+#include "rvi.h"
+#include "rvi_buffer.h"
+
+#include <jansson.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MESSAGES 100000
+#define WINDOW 64
+#define DEADLINE_NS ( 60 * 1000000000LL )
+
+typedef struct TBenchPeer
+{
+    SSL_CTX     *ctx;
+    int         listenfd;
+    const char  *id;
+    char        *cred;
+} TBenchPeer;
+
+typedef struct TBenchClient
+{
+    long long   *samples;
+    long long   received;
+} TBenchClient;
+
+static int benchWriteAll( SSL *ssl, const char *data, size_t len )
+{
+    int n;
+
+    while( len > 0 ) {
+        n = SSL_write( ssl, data, len );
+        if( n <= 0 ) { return -1; }
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Answer one message from the client: invocations of the sink are returned
+ * to the echo service, anything else is ignored */
+static int benchPeerMessage( SSL *ssl, const char *id, const char *msg, 
+                             size_t len )
+{
+    json_t          *root;
+    json_t          *data;
+    json_t          *reply;
+    json_error_t    error;
+    char            service[512];
+    char            *text;
+    int             ret     = 0;
+
+    root = json_loadb( msg, len, 0, &error );
+    if( !root ) { return -1; }
+
+    if( strcmp( json_string_value( json_object_get( root, "cmd" ) ) ?: "", 
+                "rcv" ) != 0 ) {
+        goto exit;
+    }
+    data = json_object_get( root, "data" );
+    snprintf( service, sizeof( service ), "%s/bench/echo", id );
+
+    reply = json_pack( "{s:s, s:O, s:s, s:{s:s, s:O, s:O}}",
+                       "cmd", "rcv",
+                       "tid", json_object_get( root, "tid" ),
+                       "mod", "proto_json_rpc",
+                       "data",
+                           "service", service,
+                           "timeout", json_object_get( data, "timeout" ),
+                           "parameters", json_object_get( data, "parameters" ) );
+    text = reply ? json_dumps( reply, JSON_COMPACT ) : NULL;
+    ret = text ? benchWriteAll( ssl, text, strlen( text ) ) : -1;
+    free( text );
+    json_decref( reply );
+
+exit:
+    json_decref( root );
+
+    return ret;
+}
+
+static void *benchPeerMain( void *arg )
+{
+    TBenchPeer  *peer   = arg;
+    SSL         *ssl    = NULL;
+    TRviBuffer  buf;
+    TRviFramer  framer;
+    char        *text;
+    size_t      len;
+    int         fd;
+    int         n;
+
+    rviBufferInitialize( &buf );
+    rviFramerInitialize( &framer );
+
+    fd = accept( peer->listenfd, NULL, NULL );
+    if( fd < 0 ) { goto exit; }
+    ssl = SSL_new( peer->ctx );
+    SSL_set_fd( ssl, fd );
+    if( SSL_accept( ssl ) != 1 ) {
+        ERR_print_errors_fp( stderr );
+        goto exit;
+    }
+
+    /* Present the credential, then announce the sink */
+    text = malloc( strlen( peer->cred ) + strlen( peer->id ) + 128 );
+    if( !text ) { goto exit; }
+    sprintf( text, "{\"cmd\":\"au\",\"ver\":\"1.1\",\"creds\":[\"%s\"]}"
+                   "{\"cmd\":\"sa\",\"stat\":\"av\",\"svcs\":[\"%s/bench/sink\"]}",
+             peer->cred, peer->id );
+    n = benchWriteAll( ssl, text, strlen( text ) );
+    free( text );
+    if( n < 0 ) { goto exit; }
+
+    for( ;; ) {
+        if( rviBufferReserve( &buf, 16384 ) != 0 ) { break; }
+        n = SSL_read( ssl, rviBufferTail( &buf ), 16384 );
+        if( n <= 0 ) { break; }
+        rviBufferCommit( &buf, n );
+        while( ( len = rviFramerNext( &framer, &buf ) ) ) {
+            if( benchPeerMessage( ssl, peer->id, rviBufferData( &buf ), 
+                                  len ) < 0 ) {
+                goto exit;
+            }
+            rviBufferConsume( &buf, len );
+        }
+    }
+
+exit:
+    if( ssl ) {
+        SSL_shutdown( ssl );
+        SSL_free( ssl );
+    }
+    if( fd >= 0 ) { close( fd ); }
+    rviBufferFree( &buf );
+
+    return NULL;
+}
+
+/* The echo service: record how long the invocation took to come back */
+static void benchEcho( int fd, void *serviceData, const char *serviceName,
+                       long long tid, const char *parameters, size_t len )
+{
+    TBenchClient    *client = serviceData;
+    const char      *t      = memmem( parameters, len, "\"t\":", 4 );
+
+    if( !t ) { return; }
+    client->samples[client->received++] = 
+        benchNowNs() - strtoll( t + 4, NULL, 10 );
+}
+
+static bool benchHasService( TRviHandle handle, const char *name )
+{
+    char    *services[64];
+    int     count   = 64;
+    bool    found   = false;
+    int     i;
+
+    if( rviGetServices( handle, services, &count ) != 0 ) { return false; }
+    for( i = 0; i < count; i++ ) {
+        found = found || strcmp( services[i], name ) == 0;
+        free( services[i] );
+    }
+
+    return found;
+}
+
+int main( int argc, char **argv )
+{
+    TBenchPeer          peer;
+    TBenchClient        client  = { NULL, 0 };
+    TRviHandle          handle;
+    pthread_t           thread;
+    struct sockaddr_in  addr;
+    socklen_t           addrLen = sizeof( addr );
+    json_t              *conf;
+    json_t              *dev;
+    json_error_t        error;
+    char                port[16];
+    char                sink[512];
+    char                params[64];
+    long long           messages;
+    long long           sent    = 0;
+    long long           start;
+    long long           elapsed;
+    int                 fd;
+    int                 ret;
+
+    if( argc < 2 ) {
+        fprintf( stderr, "Usage: %s <config file> [messages]\n", argv[0] );
+        return 2;
+    }
+    messages = ( argc > 2 ) ? atoll( argv[2] ) : MESSAGES;
+
+    handle = rviInit( argv[1] );
+    if( !handle ) {
+        fprintf( stderr, "%s: cannot load configuration, skipping\n", argv[1] );
+        return 77;
+    }
+
+    conf = json_load_file( argv[1], 0, &error );
+    dev = json_object_get( conf, "dev" );
+    peer.id = json_string_value( json_object_get( dev, "id" ) );
+    peer.cred = benchReadCred( json_string_value( 
+                    json_object_get( conf, "creddir" ) ) );
+    peer.ctx = SSL_CTX_new( SSLv23_server_method() );
+    if( !peer.id || !peer.cred || !peer.ctx ||
+        SSL_CTX_use_certificate_file( peer.ctx, json_string_value( 
+            json_object_get( dev, "cert" ) ), SSL_FILETYPE_PEM ) != 1 ||
+        SSL_CTX_use_PrivateKey_file( peer.ctx, json_string_value( 
+            json_object_get( dev, "key" ) ), SSL_FILETYPE_PEM ) != 1 ) {
+        fprintf( stderr, "%s: cannot set up the peer\n", argv[1] );
+        return 1;
+    }
+
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    peer.listenfd = socket( AF_INET, SOCK_STREAM, 0 );
+    if( peer.listenfd < 0 || 
+        bind( peer.listenfd, (struct sockaddr *)&addr, sizeof( addr ) ) ||
+        listen( peer.listenfd, 1 ) ||
+        getsockname( peer.listenfd, (struct sockaddr *)&addr, &addrLen ) ) {
+        perror( "listen" );
+        return 1;
+    }
+    snprintf( port, sizeof( port ), "%d", ntohs( addr.sin_port ) );
+    pthread_create( &thread, NULL, benchPeerMain, &peer );
+
+    client.samples = malloc( messages * sizeof( long long ) );
+    if( !client.samples ) { return 1; }
+    snprintf( sink, sizeof( sink ), "%s/bench/sink", peer.id );
+
+    rviSetNonBlocking( handle, true );
+    rviRegisterServiceRaw( handle, "bench/echo", benchEcho, &client );
+    fd = rviConnect( handle, "127.0.0.1", port );
+    if( fd < 0 ) {
+        fprintf( stderr, "connect failed: %d\n", fd );
+        return 1;
+    }
+
+    /* Wait for the peer to be authorized and announce the sink */
+    start = benchNowNs();
+    while( !benchHasService( handle, sink ) ) {
+        if( benchNowNs() - start > DEADLINE_NS ) {
+            fprintf( stderr, "%s was never announced\n", sink );
+            return 1;
+        }
+        rviRunOnce( handle, 100 );
+    }
+
+    start = benchNowNs();
+    while( client.received < messages ) {
+        while( sent < messages && sent - client.received < WINDOW ) {
+            int len = snprintf( params, sizeof( params ), "{\"t\":%lld}", 
+                                benchNowNs() );
+            ret = rviInvokeServiceRaw( handle, sink, params, len );
+            if( ret == RVI_ERR_WOULDBLOCK ) { break; }
+            if( ret != RVI_OK ) {
+                fprintf( stderr, "invoke failed: %d\n", ret );
+                return 1;
+            }
+            sent++;
+        }
+        if( benchNowNs() - start > DEADLINE_NS ) {
+            fprintf( stderr, "timed out after %lld of %lld messages\n", 
+                     client.received, messages );
+            return 1;
+        }
+        rviRunOnce( handle, 100 );
+    }
+    elapsed = benchNowNs() - start;
+
+    benchReport( "loopback, invoke and echo", client.received, elapsed );
+    printf( "%-40s %10.1f us p50 %10.1f us p99\n", "loopback, latency",
+            benchPercentile( client.samples, client.received, 50 ) / 1e3,
+            benchPercentile( client.samples, client.received, 99 ) / 1e3 );
+
+    rviCleanup( handle );
+    pthread_join( thread, NULL );
+    close( peer.listenfd );
+    SSL_CTX_free( peer.ctx );
+    free( peer.cred );
+    free( client.samples );
+    json_decref( conf );
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Benchmark for matching service names against the rights granted by
+ * credentials. rviRightToReceiveError() and rviRightToInvokeError() match
+ * against the tries compiled from the rights, so the tries are timed directly.
+ */
+
+#include "bench.h"
+#include "rvi_trie.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOOKUPS 1000000
+#define NAMES 4096 /* Names looked up, composed before timing; a power of 2 */
+
+/* Time lookups against a set of count device patterns, such as a server
+ * holding the rights of a whole fleet would have */
+static void benchRights( int count, bool wildcard )
+{
+    TRviTrie    trie;
+    char        name[128];
+    static char names[NAMES][64];
+    char        label[64];
+    long long   start;
+    long long   hits = 0;
+    int         i;
+
+    rviTrieInitialize( &trie );
+    for( i = 0; i < count; i++ ) {
+        snprintf( name, sizeof( name ),
+                  wildcard ? "genivi.org/vin/%08d/+/status"
+                           : "genivi.org/vin/%08d/", i );
+        rviTrieInsert( &trie, name );
+    }
+
+    /* Every other name misses, at the last topic */
+    for( i = 0; i < NAMES; i++ ) {
+        snprintf( names[i], sizeof( names[i] ),
+                  ( i & 1 ) ? "genivi.org/vin/%08d/hvac/status/temp"
+                            : "genivi.org/vin/%08d/hvac/statux",
+                  ( i * 7919 ) % count );
+    }
+
+    start = benchNowNs();
+    for( i = 0; i < LOOKUPS; i++ ) {
+        hits += rviTrieMatch( &trie, names[i & ( NAMES - 1 )] );
+    }
+    snprintf( label, sizeof( label ), "rights %s, %d patterns",
+              wildcard ? "wildcard" : "prefix", count );
+    benchReport( label, LOOKUPS, benchNowNs() - start );
+    benchSink = hits;
+
+    rviTrieFree( &trie );
+}
+
+int main( void )
+{
+    int count;
+
+    for( count = 10; count <= 100000; count *= 10 ) {
+        benchRights( count, false );
+        benchRights( count, true );
+    }
+
+    return 0;
+}
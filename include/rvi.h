@@ -8,6 +8,8 @@
 #ifndef _RVI_H
 #define _RVI_H
 
+#include <poll.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -25,6 +27,24 @@ extern "C" {
  * remote RVI nodes, discover services, register additional services, and
  * invoke remote services.
  *
+ * Connections are driven by a single thread, the one running the event loop:
+ * rviConnect(), rviDisconnect(), rviResumeConnection(), rviProcessInput(),
+ * rviProcessTimers(), rviRunOnce() and rviRun() must all be called from it,
+ * as must the setters used to configure a context. The service API, i.e.,
+ * registering, unregistering and listing services, invoking them, replying
+ * to invocations and flushing, may be called from any thread, concurrently
+ * with the event loop. Lookups do not exclude one another. Callbacks and
+ * completions are run by the event loop's thread. Writes to a blocking 
+ * connection wait for the event loop to finish reading from it, so threads
+ * sharing a context should use non-blocking connections.
+ *
+ * Alternatively, rviStartWorkers() starts I/O workers, each a thread with its
+ * own event loop serving a share of the connections, so that TLS and
+ * credential checks are spread over several cores. While they run, 
+ * rviConnect(), rviDisconnect() and rviResumeConnection() may be called from
+ * any thread, and each connection's callbacks and completions run on the 
+ * worker serving it, unless an executor is set with rviSetExecutor().
+ *
  *
  * The RVI library depends on the following libraries:
  *
@@ -60,6 +80,47 @@ typedef void (*TRviCallback) ( int fd,
                                  const char *parameters
                                );
 
+/** Function signature for RVI callback functions registered with
+ * rviRegisterServiceRaw(). The parameters are the JSON text of the
+ * "parameters" member exactly as received, which is not null-terminated. */
+typedef void (*TRviRawCallback) ( int fd, 
+                                    void* serviceData, 
+                                    const char *serviceName,
+                                    long long tid,
+                                    const char *parameters,
+                                    size_t len
+                                  );
+
+/** Function signature for completions passed to rviInvokeServiceAsync().
+ * status is RVI_OK when the remote replied, in which case result holds the
+ * JSON text of the result as received, which is not null-terminated. 
+ * Otherwise, result is NULL and status is RVI_ERR_TIMEOUT if no reply came in
+ * time, or an error code if the connection was lost. */
+typedef void (*TRviCompletion) ( int fd, 
+                                   void* callData, 
+                                   long long tid,
+                                   int status,
+                                   const char *result,
+                                   size_t len
+                                 );
+
+/** Function signature for callbacks set with rviSetWritableCallback(), called
+ * once the output queued for the connection on fd has drained after an 
+ * invocation was refused with RVI_ERR_WOULDBLOCK */
+typedef void (*TRviWritable) ( int fd, 
+                                 void *writableData 
+                               );
+
+/** Function signature for work handed to an executor, see rviSetExecutor() */
+typedef void (*TRviTask) ( void *taskData );
+
+/** Function signature for executors set with rviSetExecutor(). The executor
+ * must call task( taskData ) exactly once, on any thread it likes. */
+typedef void (*TRviExecutor) ( TRviTask task, 
+                                 void *taskData, 
+                                 void *executorData 
+                               );
+
 /** Function return status codes */
 typedef enum {
     /** Success */
@@ -85,9 +146,80 @@ typedef enum {
     /** No right for that operation */
     RVI_ERR_RIGHTS          = 1009,
     /** Partial JSON */
-    RVI_ERR_JSON_PART       = 1010
+    RVI_ERR_JSON_PART       = 1010,
+    /** No reply before the timeout */
+    RVI_ERR_TIMEOUT         = 1011,
+    /** Too much output already queued for the connection */
+    RVI_ERR_WOULDBLOCK      = 1012
 } ERviStatus;
 
+/** Checks applied to the parameters of an outgoing service invocation */
+typedef enum {
+    /** Parameters are sent as given */
+    RVI_VALIDATE_NONE       = 0,
+    /** Parameters must be one JSON object or array with balanced brackets */
+    RVI_VALIDATE_STRUCTURE  = 1,
+    /** Parameters must parse as a JSON object or array */
+    RVI_VALIDATE_FULL       = 2
+} ERviValidation;
+
+/** Encodings offered to peers for the messages that follow the "au" */
+typedef enum {
+    /** Every message is JSON text */
+    RVI_ENCODING_JSON       = 0,
+    /** MessagePack in length-prefixed binary frames, else JSON */
+    RVI_ENCODING_MSGPACK    = 1
+} ERviEncoding;
+
+/** Number of buckets in a TRviHistogram */
+#define RVI_STATS_BUCKETS 32
+
+/** @brief A distribution of durations, see rviGetStats()
+ *
+ * buckets[i] counts the durations of at least 2^i and less than 2^(i+1)
+ * nanoseconds. The first bucket also counts shorter durations, and the last
+ * all longer ones.
+ */
+typedef struct TRviHistogram {
+    unsigned long long count;       /**< Number of durations recorded */
+    unsigned long long totalNs;     /**< Their sum */
+    unsigned long long maxNs;       /**< The longest of them */
+    unsigned long long buckets[RVI_STATS_BUCKETS];
+} TRviHistogram;
+
+/** @brief Counters and timings of a connection, or of a whole context, see
+ * rviGetStats() */
+typedef struct TRviStats {
+    /** Connections the statistics cover: 1 for a connection, or the number
+     * currently open in the context */
+    unsigned int connections;
+    /** Bytes and messages received and sent */
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+    unsigned long long msgsIn;
+    unsigned long long msgsOut;
+    /** Attempts to reopen lost connections */
+    unsigned long long reconnects;
+    /** Credentials presented by peers that were found in the cache of
+     * verified credentials, and those that had to be checked */
+    unsigned long long credCacheHits;
+    unsigned long long credCacheMisses;
+    /** Most bytes of a partial message left in a receive buffer after the
+     * complete messages before it were handled */
+    unsigned long long carryHighWater;
+    /** Time to finish TLS handshakes, from the start of the connection
+     * attempt, and to check the credentials of each peer */
+    TRviHistogram handshake;
+    TRviHistogram credentials;
+    /** Time to parse each message received, to check the rights for each
+     * invocation received, and to run each service callback (or to hand it
+     * to the executor). Only recorded while timing is enabled, see
+     * rviSetStatsTiming(). */
+    TRviHistogram parse;
+    TRviHistogram rights;
+    TRviHistogram callback;
+} TRviStats;
+
 // ***************************
 // INITIALIZATION AND TEARDOWN
 // ***************************
@@ -114,6 +246,60 @@ typedef enum {
  *
  * The ID format is "domain/device-type/uuid".
  *
+ * The optional integer "btree_order" (default 2, minimum 2) sets the order
+ * of the trees indexing registered services. Nodes hosting many services may
+ * use a larger order for shallower trees.
+ *
+ * The optional integer "flush_latency_ms" (default 0) lets the library hold
+ * outgoing messages for up to that many milliseconds, so that several
+ * messages to the same node are coalesced into full TLS records. Held output
+ * is written when the deadline passes, when 16K bytes have accumulated, or
+ * when rviFlush() is called. With the default, every message is written
+ * immediately.
+ *
+ * The optional integer "invoke_timeout_ms" (default 10000) sets how long an
+ * invocation sent by rviInvokeService() remains valid. The deadline is sent
+ * with the invocation as wall clock time in milliseconds, and a receiving
+ * node drops invocations that arrive after it, before checking rights or
+ * parsing them. Deadlines in seconds, as sent by older nodes, are accepted.
+ *
+ * The optional integer "keepalive_ms" (default 0, disabled) makes the library
+ * ping each connection that has received nothing for that many milliseconds,
+ * and reopen a connection that stays silent for "keepalive_timeout_ms"
+ * (default three times "keepalive_ms"). Keepalives are driven by rviRunOnce()
+ * and rviProcessInput(); see rviGetTimeout().
+ *
+ * A lost connection is reopened in the background, after a delay that starts
+ * at "reconnect_min_ms" (default 100) and doubles with each failed attempt up
+ * to "reconnect_max_ms" (default 30000), with random jitter. The connection
+ * keeps its file descriptor throughout. Reconnects resume the previous TLS 
+ * session where the peer allows it, and repeat the exchange of credentials 
+ * and services. Calls awaiting a reply on a lost
+ * connection complete with ECONNRESET.
+ *
+ * The optional integer "verify_threads" (default 0) starts that many threads
+ * to verify the credentials presented by peers, see rviSetVerifyThreads().
+ *
+ * The optional boolean "stats_timing" (default false) times the handling of
+ * every message for rviGetStats(), see rviSetStatsTiming().
+ *
+ * The optional string "wire_encoding" (default "json") may be set to 
+ * "msgpack" to offer peers a binary encoding, see rviSetWireEncoding().
+ *
+ * The optional string "rights_snapshot" names a file in which the rights
+ * granted by the credentials in "creddir" are kept once they have been
+ * checked. On later calls, a credential whose file is unchanged and whose
+ * rights have not expired is taken from the snapshot without checking its
+ * signature again. The file is rewritten whenever the credentials or the CA
+ * certificate change. It must be kept as private as the device key.
+ *
+ * The library installs its own allocator for jansson with
+ * json_set_alloc_funcs(), so that messages are decoded and built in
+ * per-message arenas. JSON created by the application is still allocated
+ * with the functions jansson used before the first call to rviInit(), which
+ * are malloc() and free() unless the application installed its own.
+ * Applications must not replace jansson's allocator after calling rviInit().
+ *
  * @param configFilename - Path to the file containing RVI config options.
  *
  * @return  A handle for the API on success, 
@@ -137,6 +323,8 @@ extern TRviHandle rviJsonInit(char *jsonConfig);
 /** @brief Enables or disables the verbose loging.
  *
  * By default, the verbose logging is disabled, use this function to turn it on.
+ * The setting applies to every context, and should be made before any of them
+ * is used from several threads.
  *
  * @param verboseEnable - if true, verbose will be enabled if false, disabled.
  *
@@ -144,6 +332,124 @@ extern TRviHandle rviJsonInit(char *jsonConfig);
 
 extern void rviSetVerboseLogs (bool verboseEnable );
 
+/** @brief Enables or disables non-blocking I/O for new connections.
+ *
+ * By default, the library performs all TLS operations in blocking mode. When
+ * non-blocking mode is enabled, rviConnect() returns as soon as the TCP
+ * connection has been initiated, and the TLS handshake and RVI credential
+ * exchange are completed by subsequent calls to rviProcessInput() as the
+ * socket becomes ready. rviProcessInput() then reads whatever data is
+ * available without waiting for more, and output that cannot be written
+ * immediately is queued until the socket is writable. Use rviGetPollEvents()
+ * to find out which events to wait for on each connection.
+ *
+ * The setting applies to connections opened after this call.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param enable - if true, non-blocking I/O will be used, if false, blocking.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+
+extern int rviSetNonBlocking ( TRviHandle handle, bool enable );
+
+/** @brief Reload the trusted CA certificates.
+ *
+ * The CA certificate named in the configuration is loaded once by rviInit()
+ * and used to verify every RVI credential. Call this function after the CA
+ * certificate file or certificate directory has been replaced, e.g., during
+ * key rotation, to load the new certificates. The new trust store applies to
+ * credentials and TLS handshakes processed after this call; established
+ * connections are not affected.
+ *
+ * If the new certificates cannot be loaded, the previous ones remain in use.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+
+extern int rviReloadTrustStore ( TRviHandle handle );
+
+/** @brief Select how service invocation parameters are checked.
+ *
+ * rviInvokeService() and rviInvokeServiceRaw() copy the caller's parameters
+ * into the outgoing message verbatim. With RVI_VALIDATE_STRUCTURE, the
+ * default, they only check in a single pass that the parameters are one JSON
+ * object or array with balanced brackets, which keeps the message stream
+ * intact. RVI_VALIDATE_FULL parses the parameters and rejects anything that
+ * is not valid JSON, at a higher cost. RVI_VALIDATE_NONE skips checking
+ * entirely, for callers that generate their parameters themselves.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param mode - The checks to apply.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+
+extern int rviSetValidation ( TRviHandle handle, ERviValidation mode );
+
+/** @brief Select the encoding offered to peers.
+ *
+ * With RVI_ENCODING_MSGPACK, the "au" sent on each new connection lists 
+ * "msgpack" in its "encodings". Once both peers' "au" messages have offered
+ * it, each side sends the rest of its messages as MessagePack, in frames of
+ * a 0xc1 marker byte and a 4 byte length, most significant first. Peers that
+ * do not offer it, including older ones, are sent JSON as before, and JSON 
+ * messages are accepted on any connection.
+ *
+ * Parameters and results sent in binary frames are converted from JSON, so
+ * they must be valid JSON whatever the validation mode, see 
+ * rviSetValidation(). Callbacks are still given JSON text. The change 
+ * applies to connections opened, or reopened, afterwards.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param encoding - The encoding to offer.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+
+extern int rviSetWireEncoding ( TRviHandle handle, ERviEncoding encoding );
+
+/** @brief Set how long invocations remain valid.
+ *
+ * This overrides "invoke_timeout_ms" from the configuration (see rviInit())
+ * for invocations made with rviInvokeService() and rviInvokeServiceRaw().
+ * Invocations made with rviInvokeServiceAsync() remain valid for as long as
+ * the caller waits for the reply.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param timeoutMs - The lifetime of an invocation in milliseconds, at least 1
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+
+extern int rviSetInvokeTimeout ( TRviHandle handle, int timeoutMs );
+
+/** @brief Set the keepalive interval and timeout.
+ *
+ * This overrides "keepalive_ms" and "keepalive_timeout_ms" from the
+ * configuration (see rviInit()). A connection that has received nothing for
+ * intervalMs is sent a ping, which the peer answers; one that has received
+ * nothing for timeoutMs is considered dead and reopened.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param intervalMs - The idle time before a ping, or 0 to disable keepalive
+ * @param timeoutMs - The idle time before reconnecting, greater than
+ *                    intervalMs
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+
+extern int rviSetKeepalive ( TRviHandle handle, int intervalMs, 
+                             int timeoutMs );
+
 /** @brief Tear down the API.
  *
  * Calling applications are expected to call this to cleanly tear down the API.
@@ -175,7 +481,12 @@ extern int rviCleanup(TRviHandle handle);
  * rviGetServices() function. Services may be invoked via
  * rviInvokeService() using the fully-qualified service name.
  *
- * This operation will block until all TLS read/write operations are complete.
+ * This operation will block until all TLS read/write operations are complete,
+ * unless non-blocking mode has been enabled with rviSetNonBlocking(). In that
+ * case, the file descriptor is returned while the connection is still being
+ * established, and the handshake is driven by rviProcessInput(). With I/O
+ * workers running, the connection is handed to the worker serving the fewest
+ * connections, which drives the handshake.
  *
  * @param handle    - The handle to the RVI context.
  * @param addr      - The address of the remote connection.
@@ -190,6 +501,9 @@ extern int rviCleanup(TRviHandle handle);
 extern int rviConnect(TRviHandle handle, const char *addr, const char *port);
 
 /** @brief Disconnect from a remote node with a specified file descriptor
+ *
+ * With I/O workers running, a connection served by another thread's worker is
+ * closed by that worker shortly after this returns.
  *
  * @param handle    - The handle to the RVI context.
  * @param fd        - The file descriptor for the connection to terminate.
@@ -249,6 +563,75 @@ extern int rviRegisterService( TRviHandle handle, const char *serviceName,
                                  TRviCallback callback, 
                                  void* serviceData );
 
+/** @brief Register a service with a callback taking unparsed parameters
+ *
+ * This function is identical to rviRegisterService(), except that the
+ * callback is passed the service name, the transaction id and a view of the
+ * parameters in the library's receive buffer, rather than parameters that
+ * have been parsed and serialized again. This suits callbacks that parse the
+ * parameters with their own parser.
+ *
+ * The service name and parameters are only valid until the callback returns,
+ * and the parameters must not be used after the callback calls
+ * rviProcessInput(). The transaction id identifies the invocation to
+ * rviReplyService().
+ *
+ * @param handle       - The handle to the RVI context.
+ * @param serviceName  - The service name to register
+ * @param callback     - The callback function to be executed upon service
+ *                        invocation.
+ * @param serviceData  - Parameters to be passed to the callback function (in
+ *                        addition to any JSON parameters from the remote node)
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviRegisterServiceRaw( TRviHandle handle, const char *serviceName, 
+                                    TRviRawCallback callback, 
+                                    void* serviceData );
+
+/** @brief Register several services with one announcement
+ *
+ * This function registers each service as rviRegisterService() would, but
+ * each connected remote node is sent a single announcement listing all of the
+ * new services it can invoke, rather than one announcement per service.
+ *
+ * A failure to register one service does not stop the others from being
+ * registered. If announcements are being deferred with rviDeferAnnounce(), the
+ * new services are announced when deferral ends.
+ *
+ * @param handle       - The handle to the RVI context.
+ * @param serviceNames - Array of count service names to register
+ * @param callbacks    - Array of count callbacks, one per service
+ * @param serviceData  - Array of count parameters to be passed to the
+ *                        callbacks, or NULL to pass NULL to all of them
+ * @param count        - The number of services to register
+ *
+ * @return 0 on success,
+ *         the error code of the first registration that failed otherwise.
+ */
+extern int rviRegisterServices( TRviHandle handle, const char **serviceNames, 
+                                  TRviCallback *callbacks, 
+                                  void **serviceData, int count );
+
+/** @brief Defer announcing changes to the local services
+ *
+ * While announcements are deferred, services registered and unregistered by
+ * the application are added to and removed from this node immediately, but
+ * remote nodes are not told about them. When deferral ends, each remote node
+ * is sent at most one announcement of the services that became available and
+ * one of those that went away. A service that was registered and unregistered
+ * again while deferred is never announced.
+ *
+ * @param handle - The handle to the RVI context
+ * @param defer  - true to start deferring, false to send the pending
+ *                  announcements and stop
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviDeferAnnounce( TRviHandle handle, bool defer );
+
 /** @brief Unregister a previously registered service
  *
  * This function unregisters a service that was previously registered by the
@@ -296,20 +679,100 @@ extern int rviGetServices( TRviHandle handle, char **result, int* len );
  * refer to the documentation on the services you intend to invoke to determine
  * which parameters (if any) to pass.
  *
- * This will send the RVI command over TLS to the remote node. The operation
- * will block until all SSL read/write operations are complete.
+ * This will send the RVI command over TLS to the remote node. On a blocking
+ * connection, the operation will block until all SSL read/write operations 
+ * are complete. On a non-blocking one, the command is queued, and refused
+ * with RVI_ERR_WOULDBLOCK while the queue is over the limits set by
+ * rviSetSendQueueLimits().
  *
  * @param handle - The handle to the RVI context.
  * @param serviceName - The fully-qualified service name to invoke 
  * @param parameters - A JSON structure containing the named parameter pairs
  *
  * @return 0 on success,
+ *         RVI_ERR_WOULDBLOCK if too much output is queued for the remote,
+ *         RVI_ERR_STREAMEND if the connection is being reopened,
  *         error code otherwise.
  */
 extern int rviInvokeService( TRviHandle handle, 
                                       const char *serviceName, 
                                       const char *parameters );
 
+/** @brief Invoke a remote service with length-delimited parameters
+ *
+ * This function is identical to rviInvokeService(), except that the
+ * parameters are passed as a buffer and length rather than a null-terminated
+ * string. The buffer is copied into the outgoing message unchanged, after the
+ * checks selected by rviSetValidation().
+ *
+ * @param handle - The handle to the RVI context.
+ * @param serviceName - The fully-qualified service name to invoke 
+ * @param parameters - A buffer holding a JSON object or array
+ * @param len - The number of bytes in parameters
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviInvokeServiceRaw( TRviHandle handle, 
+                                const char *serviceName, 
+                                const char *parameters, 
+                                size_t len );
+
+/** @brief Invoke a remote service and receive its reply
+ *
+ * This function sends the invocation as rviInvokeServiceRaw() does, tagged
+ * with a new transaction id, and returns without waiting for the reply. The
+ * call is completed from rviProcessInput() or rviRunOnce(): the completion is
+ * called once, with the result when the remote answers with 
+ * rviReplyService(), with RVI_ERR_TIMEOUT if timeoutMs passes first, or with 
+ * an error code if the connection is lost. Any number of calls may be in 
+ * flight on a connection at once.
+ *
+ * Applications running their own poll() loop should include the time
+ * returned by rviGetTimeout() in their poll timeout so that calls time out
+ * on schedule.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param serviceName - The fully-qualified service name to invoke 
+ * @param parameters - A buffer holding a JSON object or array
+ * @param len - The number of bytes in parameters
+ * @param timeoutMs - Time in milliseconds to wait for the reply
+ * @param completion - The function to call with the outcome
+ * @param callData - Passed to the completion
+ * @param tid - If not NULL, set to the transaction id of the call
+ *
+ * @return 0 on success, in which case the completion will be called,
+ *         error code otherwise, in which case it will not.
+ */
+extern int rviInvokeServiceAsync( TRviHandle handle, 
+                                  const char *serviceName, 
+                                  const char *parameters, 
+                                  size_t len,
+                                  int timeoutMs,
+                                  TRviCompletion completion,
+                                  void *callData,
+                                  long long *tid );
+
+/** @brief Reply to a service invocation
+ *
+ * This function sends a result back to the node that invoked a service, to
+ * complete a call made with rviInvokeServiceAsync(). It is normally called
+ * from a callback registered with rviRegisterServiceRaw(), which is given the
+ * transaction id, but may be called later. A reply to a caller that is not
+ * waiting for one is ignored by the caller.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param fd - The connection the invocation arrived on
+ * @param tid - The transaction id of the invocation
+ * @param result - A buffer holding a JSON object or array
+ * @param len - The number of bytes in result
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviReplyService( TRviHandle handle, int fd, long long tid, 
+                            const char *result, size_t len );
+
 
 // ******************
 // RVI I/O MANAGEMENT
@@ -330,6 +793,11 @@ extern int rviInvokeService( TRviHandle handle,
  * the operation will block until data becomes available to read on the
  * descriptor.
  *
+ * In non-blocking mode (see rviSetNonBlocking()), descriptors may be passed
+ * when they are readable or writable. Pending connection setup and queued
+ * output are advanced, and all data currently available is read; the call
+ * never waits for more.
+ *
  * @param handle - The handle to the RVI context.
  * @param fdArr - An array of file descriptors with read operations pending
  * @param fdLen - The length of the file descriptor array
@@ -339,6 +807,298 @@ extern int rviInvokeService( TRviHandle handle,
  */
 extern int rviProcessInput(TRviHandle handle, int* fdArr, int fdLen);
 
+/** @brief Get the events to poll for on each remote connection.
+ *
+ * This function fills the fds buffer with one entry per connection, setting
+ * the fd and events members (POLLIN and/or POLLOUT) to indicate what the
+ * connection is waiting for. The buffer can be passed directly to poll(), and
+ * descriptors reporting any event should then be passed to rviProcessInput().
+ *
+ * This is mostly useful in non-blocking mode, where connections may need to
+ * wait for the socket to become writable during connection setup or while
+ * output is queued. In blocking mode every connection reports POLLIN.
+ *
+ * This operation is entirely local.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param fds - Pointer to a buffer of pollfd structures.
+ * @param fdsSize - Pointer to the size of the 'fds' buffer. On success, it
+ *                  will be updated with the number of entries filled.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviGetPollEvents(TRviHandle handle, struct pollfd *fds, int *fdsSize);
+
+/** @brief Get the time until the library's next timer is due.
+ *
+ * When "flush_latency_ms" is configured, outgoing messages are held for up to
+ * that long to be coalesced. Calls made with rviInvokeServiceAsync() also 
+ * time out at a deadline, keepalives (see rviSetKeepalive()) are sent on
+ * a schedule and lost connections are reopened after a delay. Applications
+ * running their own poll() loop should use this value as the poll timeout
+ * (or a shorter one) and call rviProcessTimers() when it elapses. 
+ * rviRunOnce() accounts for it automatically.
+ *
+ * This operation is entirely local.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param timeout - Set to the time in milliseconds until the first deadline,
+ *                  0 if one has passed, or -1 if there is none.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviGetTimeout(TRviHandle handle, int *timeout);
+
+/** @brief Run everything that is due on a timer.
+ *
+ * This writes held output whose deadline has passed, times out calls 
+ * awaiting a reply, sends keepalives and starts reconnecting lost 
+ * connections whose delay has passed. rviProcessInput() and rviRunOnce() do
+ * the same on every call; applications running their own poll() loop call 
+ * this when the time returned by rviGetTimeout() elapses without input.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviProcessTimers(TRviHandle handle);
+
+/** @brief Write held output now.
+ *
+ * Writes any output queued for a connection, without waiting for the flush
+ * deadline (see "flush_latency_ms" in rviInit()). On a non-blocking
+ * connection, whatever cannot be written without blocking is written once the
+ * socket is writable.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param fd - The connection to flush, or -1 to flush every connection.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviFlush(TRviHandle handle, int fd);
+
+/** @brief Run one iteration of the built-in event loop.
+ *
+ * The RVI context keeps every connection opened with rviConnect() registered
+ * in an internal event loop (epoll on Linux, poll() elsewhere). This function
+ * waits up to timeout milliseconds for any connection to become ready, then
+ * processes input and queued output on each ready connection, as
+ * rviProcessInput() would. If output is being held for coalescing, the wait
+ * ends in time to write it by its deadline.
+ *
+ * Calling applications may use this instead of poll() with rviGetPollEvents()
+ * and rviProcessInput(); the two approaches should not be mixed on the same
+ * connections.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param timeout - The maximum time to wait, in milliseconds. A value of 0
+ *                  returns immediately, and -1 waits indefinitely.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviRunOnce(TRviHandle handle, int timeout);
+
+/** @brief Run the built-in event loop until rviStop() is called.
+ *
+ * This repeatedly calls rviRunOnce() with an infinite timeout. It returns
+ * after the iteration in which rviStop() was called, e.g., from a service
+ * callback, or when waiting for events fails.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviRun(TRviHandle handle);
+
+/** @brief Stop the built-in event loop.
+ *
+ * Causes rviRun() to return once the current iteration is complete.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviStop(TRviHandle handle);
+
+/** @brief Start I/O workers.
+ *
+ * Starts count threads, each running an event loop of its own (epoll only)
+ * for a share of the connections. Connections already open are dealt out
+ * among them, and new ones go to the worker serving the fewest. A worker 
+ * alone reads from its connections and runs their timers; the service 
+ * registry is shared by all of them and read without excluding one another.
+ *
+ * While workers run, rviProcessInput(), rviProcessTimers(), rviRunOnce() and
+ * rviRun() return EBUSY, as do rviReloadTrustStore() and disabling 
+ * non-blocking mode. Non-blocking mode must be enabled, and every open 
+ * connection non-blocking, before workers are started.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param count - The number of workers, e.g., one per core.
+ *
+ * @return 0 on success,
+ *         EBUSY if workers are already running or a connection is blocking,
+ *         EINVAL if non-blocking mode is disabled,
+ *         ENOSYS without epoll,
+ *         error code otherwise.
+ */
+extern int rviStartWorkers(TRviHandle handle, int count);
+
+/** @brief Stop the I/O workers.
+ *
+ * Waits for each worker to finish its current iteration, then returns its
+ * connections to the built-in event loop. This must not be called from a 
+ * worker, e.g., from a callback; rviCleanup() calls it.
+ *
+ * @param handle - The handle to the RVI context.
+ *
+ * @return 0 on success,
+ *         EDEADLK if called from a worker,
+ *         error code otherwise.
+ */
+extern int rviStopWorkers(TRviHandle handle);
+
+/** @brief Hand service callbacks to an executor.
+ *
+ * Each invocation received is passed to executor as a task, with copies of
+ * its parameters, instead of being run by the event loop's thread, so that
+ * slow services don't hold up the connections' I/O. Replies may be sent from
+ * the task with rviReplyService(). Completions are still run by the event 
+ * loop. Set the executor before connecting; NULL restores the default.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param executor - The executor, or NULL.
+ * @param executorData - Passed to the executor with each task.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviSetExecutor(TRviHandle handle, TRviExecutor executor, 
+                          void *executorData);
+
+/** @brief Set the number of credential verifier threads.
+ *
+ * Credentials presented by peers that have not been verified before are
+ * checked by these threads instead of the event loop, so that connections
+ * already established keep flowing while many nodes connect at once. A
+ * connection stays in its handshake until its credentials have been checked;
+ * the messages it sends meanwhile are held, and dispatched afterwards. 
+ * Blocking connections, and any checks beyond a bounded queue, are still 
+ * checked by the event loop. The built-in event loop looks for finished
+ * checks every few milliseconds while any are pending; see rviGetTimeout().
+ *
+ * This overrides "verify_threads" from the configuration. Checks already
+ * queued are finished by the old threads first.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param count - The number of threads, 0 (the default) to check credentials
+ *                on the event loop.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviSetVerifyThreads(TRviHandle handle, int count);
+
+/** @brief Bound the output queued for each connection.
+ *
+ * Output to a non-blocking connection, or held for coalescing, waits in a 
+ * queue until the socket can take it. Once the queue of a connection holds
+ * highBytes bytes, or highMsgs messages, invocations sent on it are refused
+ * with RVI_ERR_WOULDBLOCK, so that producers can slow down rather than 
+ * let the queue grow without bound. Replies and the library's own messages
+ * are still queued. Once the queue has drained to lowBytes bytes and lowMsgs
+ * messages, the callback set with rviSetWritableCallback() is called for
+ * the connection, from its event loop. If a connection is reset instead,
+ * the callback is called once it has been reopened.
+ *
+ * A connection that is blocking and not coalescing writes directly and is
+ * never refused.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param highBytes - Bytes queued at which invocations are refused, or 0 for
+ *                    no bound on bytes.
+ * @param lowBytes - Bytes queued at or below which the connection is 
+ *                   writable again, less than highBytes.
+ * @param highMsgs - Messages queued at which invocations are refused, or 0
+ *                   for no bound on messages.
+ * @param lowMsgs - Messages queued at or below which the connection is 
+ *                  writable again, less than highMsgs.
+ *
+ * @return 0 on success,
+ *         EINVAL if a low watermark is not below its high watermark,
+ *         error code otherwise.
+ */
+extern int rviSetSendQueueLimits(TRviHandle handle, size_t highBytes, 
+                                 size_t lowBytes, unsigned int highMsgs, 
+                                 unsigned int lowMsgs);
+
+/** @brief Set the callback for connections that can take output again.
+ *
+ * After invocations on a connection have been refused with 
+ * RVI_ERR_WOULDBLOCK, the callback is called once, on the connection's event
+ * loop, when its output has drained to the low watermarks; see 
+ * rviSetSendQueueLimits().
+ *
+ * @param handle - The handle to the RVI context.
+ * @param writable - The callback, or NULL.
+ * @param writableData - Passed to the callback.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviSetWritableCallback(TRviHandle handle, TRviWritable writable,
+                                  void *writableData);
+
+// ******************
+// RUNTIME STATISTICS
+// ******************
+
+/** @brief Take a snapshot of the statistics of a connection or a context.
+ *
+ * Counters are kept for every connection as a matter of course, at the
+ * cost of an addition each. The counters of closed connections are kept in
+ * the context's totals. The statistics of a connection are changed by its
+ * event loop while the snapshot is taken, so a snapshot taken under load
+ * may be slightly inconsistent.
+ *
+ * Where the platform supports it, the library also has USDT probes in the
+ * "rvi" provider, for tracing tools such as perf, bpftrace or SystemTap:
+ * message__received (fd, bytes), message__sent (fd, bytes), 
+ * handshake__done (fd, ns), credentials__checked (fd, ns), 
+ * reconnect (fd) and service__invoked (fd, service name).
+ *
+ * @param handle - The handle to the RVI context.
+ * @param fd - The file descriptor of a connection, or -1 for the totals of
+ *             the context, including connections closed since rviInit().
+ * @param stats - Filled in with the statistics.
+ *
+ * @return 0 on success,
+ *         ENXIO if there is no connection on fd,
+ *         error code otherwise.
+ */
+extern int rviGetStats(TRviHandle handle, int fd, TRviStats *stats);
+
+/** @brief Time the handling of every message.
+ *
+ * While enabled, the parse, rights and callback histograms of TRviStats are
+ * recorded, at the cost of reading the clock a few times per message. This
+ * overrides "stats_timing" from the configuration.
+ *
+ * @param handle - The handle to the RVI context.
+ * @param enable - true to record timings, false (the default) to stop.
+ *
+ * @return 0 on success,
+ *         error code otherwise.
+ */
+extern int rviSetStatsTiming(TRviHandle handle, bool enable);
+
 #ifdef __cplusplus
 }
 #endif
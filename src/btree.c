@@ -42,7 +42,7 @@ static bt_node_t* allocate_btree_node ( btree_t* btree );
 static void btree_insert_nonfull ( btree_t* btree, bt_node_t* parent_node,
                                    void* data );
 
-static int free_btree_node ( bt_node_t* node );
+static int free_btree_node ( btree_t* btree, bt_node_t* node );
 
 static nodePosition get_btree_node ( btree_t* btree, void* key );
 
@@ -61,6 +61,8 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
 static void btree_traverse_node ( bt_node_t* subtree,
                                   traverseFunc traverseFunction );
 
+static void btree_release_subtree ( btree_t* btree, bt_node_t* node );
+
 /**
 *   Used to create a btree with just an empty root node.  Note that the
 *   "order" parameter below is the minumum number of keys that exist in each
@@ -93,6 +95,17 @@ btree_t* btree_create ( unsigned int order, compareFunc compareFunction )
     btree->sizeofPointers  = 2 * order * sizeof(void*);
     btree->count           = 0;
     btree->compareCB       = compareFunction;
+    btree->slabs           = NULL;
+    btree->freeNodes       = NULL;
+
+    //
+    //  Round the node block (header plus both arrays) up to a whole number
+    //  of cache lines so that every node starts on a cache line boundary.
+    //
+    btree->nodeSize = sizeof(struct bt_node_t) + btree->sizeofKeys +
+                      btree->sizeofPointers;
+    btree->nodeSize = ( btree->nodeSize + BTREE_CACHE_LINE - 1 ) &
+                      ~( (size_t)BTREE_CACHE_LINE - 1 );
 
     //
     //  Go allocate the root node of the tree.
@@ -114,11 +127,38 @@ btree_t* btree_create ( unsigned int order, compareFunc compareFunction )
 static bt_node_t* allocate_btree_node ( btree_t* btree )
 {
     bt_node_t* node;
+    char*      slab;
+    int        i;
+
+    //
+    //  If there are no unused nodes left, go allocate a new slab and put all
+    //  of its nodes on the free list. The first cache line of each slab holds
+    //  the link to the next slab.
+    //
+    if ( btree->freeNodes == NULL )
+    {
+        if ( posix_memalign ( (void**)&slab, BTREE_CACHE_LINE,
+                              BTREE_CACHE_LINE +
+                              BTREE_SLAB_NODES * btree->nodeSize ) != 0 )
+        {
+            return NULL;
+        }
+        *(void**)slab = btree->slabs;
+        btree->slabs  = slab;
 
+        for ( i = BTREE_SLAB_NODES - 1; i >= 0; i-- )
+        {
+            node = (bt_node_t*)( slab + BTREE_CACHE_LINE +
+                                 i * btree->nodeSize );
+            node->next       = btree->freeNodes;
+            btree->freeNodes = node;
+        }
+    }
     //
-    //  Go create a new node data structure.
+    //  Take the next node from the free list.
     //
-    node = (bt_node_t*)MEM_ALLOC ( sizeof(struct bt_node_t) );
+    node = btree->freeNodes;
+    btree->freeNodes = node->next;
 
     TRACE ( "In allocate_btree_node - Allocated %p\n", node );
 
@@ -128,16 +168,13 @@ static bt_node_t* allocate_btree_node ( btree_t* btree )
     node->keysInUse = 0;
 
     //
-    //  Allocate the memory for the array of record pointers and put the
-    //  address of that array into the node.
+    //  The array of record pointers follows the node header in the same
+    //  block, and the array of child node pointers follows that.
     //
-    node->dataRecords = MEM_ALLOC ( btree->sizeofKeys );
+    node->dataRecords = (void**)( node + 1 );
 
-    //
-    //  Allocate the memory for the array of child node pointers and put the
-    //  address of that array into the node.
-    //
-    node->children = MEM_ALLOC ( btree->sizeofPointers );
+    node->children = (bt_node_t**)( (char*)node->dataRecords +
+                                    btree->sizeofKeys );
 
     //
     //  Mark this new node as a leaf node.
@@ -171,13 +208,16 @@ static bt_node_t* allocate_btree_node ( btree_t* btree )
 *       @param order Order of the B-Tree
 *       @return The allocated B-tree node
 */
-static int free_btree_node ( bt_node_t* node )
+static int free_btree_node ( btree_t* btree, bt_node_t* node )
 {
     TRACE ( "In free_btree_node - Freeing %p\n", node );
 
-    MEM_FREE ( node->children );
-    MEM_FREE ( node->dataRecords );
-    MEM_FREE ( node );
+    //
+    //  Return the node to the free list for reuse. The slabs themselves are
+    //  only released when the tree is destroyed.
+    //
+    node->next       = btree->freeNodes;
+    btree->freeNodes = node;
 
     return 0;
 }
@@ -765,7 +805,7 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     //
     else
     {
-        free_btree_node ( parent );
+        free_btree_node ( btree, parent );
 
         leftChild->parent = NULL;
 
@@ -780,7 +820,7 @@ static bt_node_t* merge_siblings ( btree_t* btree, bt_node_t* parent,
     //
     //  Go free up the right child node.
     //
-    free_btree_node ( rightChild );
+    free_btree_node ( btree, rightChild );
 
     //
     //  Return the merged left child node to the caller.
@@ -901,7 +941,7 @@ int delete_key_from_node ( btree_t* btree, nodePosition* nodePosition )
     //
     if ( ( node->keysInUse == 0 ) && ( node != btree->root ) )
     {
-        free_btree_node ( node );
+        free_btree_node ( btree, node );
     }
     //
     //  Return a good completion code to the caller.
@@ -1354,57 +1394,19 @@ nodePosition get_btree_node ( btree_t* btree, void* key )
 */
 void btree_destroy ( btree_t* btree )
 {
-    int i = 0;
+    void* slab;
+    void* next;
 
     TRACE ( "In btree_destroy\n" );
 
-    bt_node_t* head;
-    bt_node_t* tail;
-    bt_node_t* child;
-    bt_node_t* del_node;
-
     //
-    //  Start at the root node...
+    //  Every node, whether in use or on the free list, lives in one of the
+    //  tree's slabs, so releasing the slabs releases all of the nodes.
     //
-    head = tail = btree->root;
-
-    //
-    //  Repeat until the head pointer becomes NULL...
-    //
-    while ( head != NULL )
+    for ( slab = btree->slabs; slab != NULL; slab = next )
     {
-        //
-        //  If this is not a leaf node...
-        //
-        if ( ! head->leaf )
-        {
-            //
-            //  For each record in this node...
-            //
-            //  ??? I think this is chaining all of the nodes into a list
-            //  using the "next" pointer in each node before actually deleting
-            //  any nodes.  I'm not sure if this is needed - Can't we just
-            //  traverse the tree depth first and delete the nodes as we go?
-            //
-            for ( i = 0; i < head->keysInUse + 1; i++ )
-            {
-                child = head->children[i];
-                tail->next = child;
-                tail = child;
-                child->next = NULL;
-            }
-        }
-        //
-        //  Grab the current list head for the delete that follows and then
-        //  update the head to the next node in the list.
-        //
-        del_node = head;
-        head = head->next;
-
-        //
-        //  Go delete the node that we saved above.
-        //
-        free_btree_node ( del_node );
+        next = *(void**)slab;
+        MEM_FREE ( slab );
     }
     MEM_FREE ( btree );
 }
@@ -1561,6 +1563,172 @@ extern void btree_traverse ( btree_t* tree, traverseFunc traverseCB )
 }
 
 
+//
+//  This function will be called by the "btree_foreach" API function with the
+//  root node of the specified btree and then it will call itself recursively
+//  to walk the tree, stopping as soon as the visitor returns non-zero.  The
+//  recursion is only as deep as the tree, so no memory is allocated.
+//
+static int btree_foreach_node ( bt_node_t* node, visitFunc visitCB,
+                                void* context )
+{
+    unsigned int i;
+    int          status;
+
+    TRACE ( "In btree_foreach_node\n" );
+
+    for ( i = 0; i < node->keysInUse; ++i )
+    {
+        //
+        //  Visit the left subtree of this record first, then the record.
+        //
+        if ( ! node->leaf )
+        {
+            status = btree_foreach_node ( node->children[i], visitCB, context );
+            if ( status != 0 )
+            {
+                return status;
+            }
+        }
+        status = visitCB ( node->dataRecords[i], context );
+        if ( status != 0 )
+        {
+            return status;
+        }
+    }
+    //
+    //  Finally, visit the subtree to the right of the last record.
+    //
+    if ( ! node->leaf )
+    {
+        return btree_foreach_node ( node->children[i], visitCB, context );
+    }
+    return 0;
+}
+
+
+//
+//  This is the user-facing API function that will walk the btree in order
+//  starting with the minimum record, calling the visitor for each record with
+//  the user supplied context, until either the whole tree has been visited or
+//  the visitor returns a non-zero value, which is then returned.
+//
+int btree_foreach ( btree_t* btree, visitFunc visitCB, void* context )
+{
+    TRACE ( "In btree_foreach\n" );
+
+    if ( ! btree || ! btree->root || ! visitCB )
+    {
+        return 0;
+    }
+    return btree_foreach_node ( btree->root, visitCB, context );
+}
+
+
+//
+//  This function returns every node of the specified subtree to the tree's
+//  free list.  The records in the nodes are not touched.
+//
+static void btree_release_subtree ( btree_t* btree, bt_node_t* node )
+{
+    unsigned int i;
+
+    if ( ! node->leaf )
+    {
+        for ( i = 0; i <= node->keysInUse; ++i )
+        {
+            btree_release_subtree ( btree, node->children[i] );
+        }
+    }
+    free_btree_node ( btree, node );
+}
+
+
+//
+//  Define the state used by "btree_remove_if" to gather the records that are
+//  being kept while it walks the tree.
+//
+typedef struct
+{
+    visitFunc    matchCB;
+    void*        context;
+    void**       kept;
+    unsigned int keptCount;
+
+}   removeState;
+
+
+static int btree_keep_unmatched ( void* record, void* state )
+{
+    removeState* remove = state;
+
+    if ( ! remove->matchCB ( record, remove->context ) )
+    {
+        remove->kept[remove->keptCount++] = record;
+    }
+    return 0;
+}
+
+
+//
+//  This is the user-facing API function that removes every record for which
+//  the match function returns non-zero.  Rather than deleting the records one
+//  at a time, each delete possibly rebalancing the tree, the records that are
+//  kept are gathered in order in a single walk and the tree is rebuilt from
+//  them.  Since they are inserted in ascending order, every insert descends
+//  the rightmost edge of the tree.  The number of records removed is
+//  returned, or -ENOMEM if no memory could be had for the walk, in which case
+//  the tree is unchanged.
+//
+int btree_remove_if ( btree_t* btree, visitFunc matchCB, void* context )
+{
+    removeState  state;
+    unsigned int total;
+    unsigned int i;
+
+    TRACE ( "In btree_remove_if\n" );
+
+    if ( ! btree || ! matchCB )
+    {
+        return -EINVAL;
+    }
+    total = btree->count;
+    if ( total == 0 )
+    {
+        return 0;
+    }
+
+    state.matchCB   = matchCB;
+    state.context   = context;
+    state.keptCount = 0;
+    state.kept      = MEM_ALLOC ( total * sizeof(void*) );
+    if ( state.kept == NULL )
+    {
+        return -ENOMEM;
+    }
+
+    btree_foreach ( btree, btree_keep_unmatched, &state );
+
+    //
+    //  If nothing matched, leave the tree as it was.
+    //
+    if ( state.keptCount != total )
+    {
+        btree_release_subtree ( btree, btree->root );
+        btree->root  = allocate_btree_node ( btree );
+        btree->count = 0;
+
+        for ( i = 0; i < state.keptCount; ++i )
+        {
+            btree_insert ( btree, state.kept[i] );
+        }
+    }
+    MEM_FREE ( state.kept );
+
+    return total - state.keptCount;
+}
+
+
 /*!----------------------------------------------------------------------------
 
     B t r e e   I t e r a t i o n   F u n c t i o n s
@@ -56,6 +56,16 @@
 #define COPY      memmove
 #define PRINT     printf
 
+//
+//  Each node is stored in a single block holding the node header followed by
+//  its data record pointers and child pointers. Blocks are a multiple of the
+//  cache line size and aligned to it, and are carved out of slabs holding
+//  BTREE_SLAB_NODES nodes each, so walking a node touches as few cache lines
+//  as possible and adding nodes rarely calls the allocator.
+//
+#define BTREE_CACHE_LINE  64
+#define BTREE_SLAB_NODES  32
+
 //
 //  Define the callback function types used by the btree code.
 //
@@ -65,6 +75,8 @@ typedef void (*traverseFunc)( void* );
 
 typedef void (*printFunc)   ( char*, void* );
 
+typedef int  (*visitFunc)   ( void*, void* );
+
 
 //
 //  Define the structure of a single btree node.
@@ -98,6 +110,9 @@ typedef struct btree_t
     unsigned int count;           // The total number of records in the btree
     bt_node_t*   root;            // Root of the btree
     compareFunc  compareCB;       // Key compare function
+    size_t       nodeSize;        // Size of one node block, with its arrays
+    void*        slabs;           // List of slabs that nodes are taken from
+    bt_node_t*   freeNodes;       // Unused nodes, linked through "next"
 
 }   btree_t;
 
@@ -138,6 +153,26 @@ extern void*    btree_search   ( btree_t* btree, void* key );
 
 extern void     btree_traverse ( btree_t* btree, traverseFunc traverseCB );
 
+//
+//  Visit every record in the btree in order, calling the visitor with the
+//  record and the caller's context pointer. If the visitor returns a non-zero
+//  value, the walk stops and that value is returned; otherwise 0 is returned
+//  once every record has been visited. Unlike the iterator functions below,
+//  this allocates no memory, so it is the preferred way to walk a tree on
+//  frequently executed paths. The btree must not be modified by the visitor.
+//
+extern int      btree_foreach  ( btree_t* btree, visitFunc visitCB, void* context );
+
+//
+//  Remove every record for which the match function, called with the record
+//  and the caller's context pointer, returns a non-zero value.  The tree is
+//  rebuilt from the remaining records in one pass, which is much cheaper than
+//  deleting a large share of the records one at a time.  Returns the number
+//  of records removed, or a negative error code, in which case the tree is
+//  unchanged.  The records themselves are not freed.
+//
+extern int      btree_remove_if ( btree_t* btree, visitFunc matchCB, void* context );
+
 //
 //  Define the btree iterator functions.
 //
@@ -10,43 +10,207 @@
  * @author Tatiana Jamison &lt;tjamison@jaguarlandrover.com&gt;
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rvi_alloc.h"
+#include "rvi_buffer.h"
+#include "rvi_hash.h"
 #include "rvi_list.h"
+#include "rvi_msgpack.h"
+#include "rvi_trie.h"
 #include "btree.h"
 
 #include <jansson.h>
 #include <jwt.h>
 
 #include <openssl/err.h>
+#include <openssl/sha.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 
 #include "rvi.h"
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+/* USDT probes in the "rvi" provider, see rviGetStats(). Each is a no-op
+ * until a tracer attaches to it. */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define RVI_PROBE1( name, a ) DTRACE_PROBE1( rvi, name, a )
+#define RVI_PROBE2( name, a, b ) DTRACE_PROBE2( rvi, name, a, b )
+#else
+#define RVI_PROBE1( name, a ) do { } while( 0 )
+#define RVI_PROBE2( name, a, b ) do { } while( 0 )
+#endif
 
 #define TLS_BUFSIZE  16384 /* Maximum TLS frame size is 16K bytes */
+#define RVI_MAX_EVENTS  64 /* Maximum events handled per event loop pass */
+#define RVI_ARENA_CHUNK TLS_BUFSIZE /* Size of message arena chunks */
+
+#define RVI_AUTH_CACHE_SIZE 16 /* Authorization decisions cached per remote, must
+                                * be a power of 2 */
+
+#define RVI_INVOKE_TIMEOUT_MS 10000 /* Default lifetime of an invocation */
+#define RVI_TIMEOUT_MS_MIN 100000000000LL /* Smaller "timeout" values are in
+                                           * seconds, from older peers */
+
+#define RVI_RECONNECT_MIN_MS 100 /* Default first delay before reconnecting */
+#define RVI_RECONNECT_MAX_MS 30000 /* Default limit of the reconnect backoff */
+
+#define RVI_WHEEL_SLOTS 256 /* Slots in the pending call timer wheel, must be a 
+                            * power of 2 */
+#define RVI_WHEEL_TICK_MS 10 /* Time (ms) covered by one slot of the wheel */
+
+#define RVI_BULK_REMOVE_MIN 16 /* Fewest services a remote must own before its
+                               * services are removed from the name btree in
+                               * one pass */
+
+#define RVI_VERIFY_BACKLOG 256 /* Credential checks queued for the verifier
+                               * threads before more are done inline */
+#define RVI_VERIFY_POLL_MS 10 /* How often a loop that can't be woken looks
+                              * for finished credential checks */
+
+#ifndef RVI_CRED_CACHE_SIZE
+#define RVI_CRED_CACHE_SIZE 256 /* Verified peer credentials kept for reuse */
+#endif
 
 /* *************** */
 /* DATA STRUCTURES */
 /* *************** */
 
+/** @brief Rights compiled for matching service names */
+typedef struct TRviRightsIndex {
+    TRviTrie receive;   /* Patterns from every right_to_receive */
+    TRviTrie invoke;    /* Patterns from every right_to_invoke */
+    TRviList *list;     /* The TRviRights the patterns were taken from */
+    long expiration;    /* Earliest expiration of those rights */
+    unsigned int generation;    /* Incremented whenever the rights change */
+} TRviRightsIndex;
+
+/** @brief Cached result of an authorization check for an incoming rcv */
+typedef struct TRviAuthCacheEntry {
+    unsigned long serviceId;    /* Id of the service, 0 if unused */
+    unsigned int localGen;      /* Generation of this node's rights... */
+    unsigned int remoteGen;     /* ...and of the remote's when cached */
+    int err;                    /* RVI_OK, or the error from the check */
+} TRviAuthCacheEntry;
+
+/* Entries in the verified credential cache */
+struct TRviCredCacheEntry;
+
+/* Calls made with rviInvokeServiceAsync() that await a reply */
+struct TRviPendingCall;
+
+/* Checks of the credentials presented by peers, see rviReadAu() */
+struct TRviVerifyJob;
+
 /** @brief verbose variable */
 bool verbose = false;
 
+/** 
+ * @brief An event loop and the connections it serves
+ *
+ * Every context has a built-in loop, driven by the application through 
+ * rviRunOnce() and the like, plus one per I/O worker started with 
+ * rviStartWorkers(). Each remote belongs to exactly one loop, whose thread
+ * alone reads from it, changes its state and runs its timers; other threads
+ * only write to it, under its lock, or flag it for the loop's attention. 
+ */
+typedef struct TRviReactor {
+    /* The context the loop belongs to */
+    struct TRviContext *ctx;
+    /* Descriptor for the epoll instance (-1 if unavailable) */
+    int epfd;
+    /* eventfd that wakes a worker from epoll_wait(); -1 for the built-in
+     * loop, which is only ever woken by its own descriptors */
+    int wakefd;
+    /* Monotonic time (ms) until which a worker sleeps, -1 if indefinitely and
+     * 0 while it is awake, see rviReactorNotify() */
+    long long wakeAt;
+    /* Set to make the loop return, by rviStop() or rviStopWorkers() */
+    bool stop;
+    /* The worker's thread */
+    pthread_t thread;
+
+    /* Monotonic time (ms) taken once per pass of input processing, for 
+     * stamping activity without reading the clock per message */
+    long long loopMs;
+    /* Scratch storage for the JSON trees and strings of one message at a 
+     * time, inbound or outbound. Rewound once the message has been handled. */
+    TRviArena msgArena;
+    /* Nesting depth of input processing. While input is being processed,
+     * disconnected remotes are kept in the graveyard rather than freed, since
+     * the caller may still hold a pointer to them. */
+    unsigned int dispatching;
+    TRviList *graveyard;
+
+    /* The loop's shard of the connections, linked through shardNext. 
+     * remoteCount also includes those handed over but not yet taken in, and
+     * is kept with atomic operations, since other threads read it to spread
+     * new connections evenly. */
+    struct TRviRemote *remotes;
+    unsigned int remoteCount;
+    /* Connections opened by other threads, waiting for the worker to take
+     * them over, under inboxLock */
+    pthread_mutex_t inboxLock;
+    TRviList inbox;
+
+    /* Number of the loop's remotes waiting out their reconnect delay */
+    unsigned int reconnecting;
+    /* Earliest time any of the loop's remotes needs keepalive attention */
+    long long keepaliveNext;
+    /* State of the generator for jittering reconnect delays */
+    uint32_t jitterState;
+    /* Number of the loop's remotes flagged by other threads, because a write
+     * found the connection lost or it was disconnected, see rviRemoteFlag() */
+    int flagged;
+    /* Number of the loop's remotes whose credentials are with the verifier
+     * threads, and how many of those checks have finished, see 
+     * rviVerifyDue(). verified is changed under the context's verifyLock. */
+    unsigned int verifying;
+    unsigned int verified;
+} TRviReactor;
+
 /** @brief RVI context */
 typedef struct TRviContext {
 
     /* 
-     * Btrees for indexing remote connections, RVI services by name, and RVI 
-     * services by registrant. 
+     * Remote connections, indexed directly by file descriptor. Entries for
+     * descriptors without a connection are NULL. 
      */
-    btree_t *remoteIdx;        /* Remote connections by fd */
+    struct TRviRemote **remotes;
+    int remotesSize;            /* Number of entries allocated */
+    unsigned int remoteCount;   /* Number of connections */
+    /* The same connections by normalized "host:port", see rviHostKey() */
+    TRviHash hostIdx;
+
+    /* 
+     * Services by fully qualified service name, for lookups. The btree below
+     * holds the same services, for ordered iteration. The services announced
+     * by a remote node are also listed in the remote, see TRviRemote. 
+     */
+    TRviHash serviceHash;
     btree_t *serviceNameIdx;  /* Services by fully qualified service name */
-    btree_t *serviceRegIdx;   /* Services by fd of registering node ---*/
-                            /*  note: local services designated 0 (stdin)  */
+    unsigned int btreeOrder;  /* Order of the btree, from "btree_order" */
 
     /* Properties set in configuration file */
     char *cadir;    /* Directory containing the trusted certificate store */
@@ -61,26 +225,248 @@ typedef struct TRviContext {
      * negotiating connections */
     TRviList *creds;
 
+    /* CA certificate and its public key as a PEM string, loaded from cafile
+     * once so that credentials can be checked without re-reading the file.
+     * Refreshed by rviReloadTrustStore(). */
+    X509 *caCert;
+    char *caKey;
+
     /* SSL context for spawning new sessions.  */
     /* Contains X509 certs, config settings, etc */
     SSL_CTX *sslCtx;
 
     TRviList *rights;
+    /* The same rights, compiled for matching */
+    TRviRightsIndex rightsIdx;
+
+    /* Credentials presented by peers that passed verification, indexed by
+     * digest, so that a peer reconnecting with the same credentials skips
+     * the signature check. The list is ordered from most to least recently
+     * used; the tail is evicted when the cache is full. */
+    TRviHash credCache;
+    struct TRviCredCacheEntry *credLruHead;
+    struct TRviCredCacheEntry *credLruTail;
+    /* Guards the cache, which the I/O workers share */
+    pthread_mutex_t credLock;
+
+    /* Threads checking the signatures of credentials presented by peers, so
+     * that handshakes don't hold up the event loops, see 
+     * rviSetVerifyThreads(). Checks wait in a queue for a thread; verifyLock
+     * guards the queue and the link from each check to its remote. 
+     * verifyThreads is the number asked for by "verify_threads". */
+    pthread_mutex_t verifyLock;
+    pthread_cond_t verifyCond;
+    pthread_t *verifiers;
+    int verifierCount;
+    int verifyThreads;
+    bool verifyStop;
+    struct TRviVerifyJob *verifyHead;
+    struct TRviVerifyJob *verifyTail;
+    int verifyQueued;
+    /* Incremented by rviReloadTrustStore(), so that checks made against the
+     * old CA key are not cached */
+    unsigned int credGen;
+
+    /* If true, new connections use non-blocking I/O */
+    bool nonblocking;
+
+    /* Time (ms) that output may be held to coalesce messages, from 
+     * "flush_latency_ms"; 0 writes every message immediately */
+    int flushLatency;
+
+    /* While set (see rviDeferAnnounce()), changes to the local services are
+     * collected in pendingAnnounce, by service name, and announced together
+     * once deferral ends */
+    bool deferAnnounce;
+    TRviHash pendingAnnounce;
+
+    /* Keepalive: a ping is sent to a remote that has been silent for 
+     * keepalive ms, and the connection is reopened once it has been silent
+     * for keepaliveTimeout ms. 0 disables both. */
+    int keepalive;
+    int keepaliveTimeout;
+    /* Reconnect backoff: the delay before reconnecting starts at reconnectMin
+     * ms and doubles with every failed attempt up to reconnectMax ms, with
+     * jitter drawn from jitterState. reconnecting counts the remotes
+     * waiting out their delay. */
+    int reconnectMin;
+    int reconnectMax;
+
+    /* Time (ms) an invocation stays valid after it is sent, from 
+     * "invoke_timeout_ms" or rviSetInvokeTimeout() */
+    int invokeTimeout;
+    /* Latest wall clock time (ms) returned by rviWallMs() */
+    long long lastWallMs;
+
+    /* Transaction id for the next service invocation, see rviNextTid() */
+    long long nextTid;
+    /* Guards pendingCalls and the wheel, which the event loop shares with
+     * threads making calls with rviInvokeServiceAsync() */
+    pthread_mutex_t callLock;
+    /* Calls awaiting a reply, by transaction id. Each is also linked into the
+     * slot of the timer wheel for the tick in which it times out; a slot
+     * holds the calls for every tick that maps to it, and each pass over the
+     * wheel completes only those that are due. wheelTick is the first tick
+     * not yet expired. */
+    TRviHash pendingCalls;
+    struct TRviPendingCall *wheel[RVI_WHEEL_SLOTS];
+    long long wheelTick;
+
+    /* How parameters passed to rviInvokeService() are checked */
+    ERviValidation validation;
+    /* Encoding offered to peers in the "au", see rviSetWireEncoding() */
+    ERviEncoding encoding;
+    /* Scratch space for composing "sa" messages, under the registry lock */
+    TRviBuffer obuf;
+
+    /* 
+     * Guards everything that the service API, which may be used from any 
+     * thread, shares with the event loop: the service indexes and the lists
+     * of services in the remotes, the remote and host indexes, the rights of
+     * this node and of the remotes, and the pending announcements. Lookups
+     * hold it for reading; only changes hold it for writing. The event loop
+     * is the only thread that changes the remotes and the rights, so it 
+     * reads those without the lock; with I/O workers, a remote is only 
+     * changed by its own worker, see TRviReactor. 
+     */
+    pthread_rwlock_t registryLock;
+
+    /* The built-in event loop, and the I/O workers started by 
+     * rviStartWorkers(), if any */
+    TRviReactor loop;
+    TRviReactor *workers;
+    int workerCount;
+    /* If set, runs service callbacks in place of the event loop's thread,
+     * see rviSetExecutor() */
+    TRviExecutor executor;
+    void *executorData;
+
+    /* Bounds on the output queued for each remote, see 
+     * rviSetSendQueueLimits(). An invocation is refused once either high
+     * watermark is reached; the writable callback is called once the output
+     * is back down to both low watermarks. A high watermark of 0 leaves that
+     * bound off. */
+    size_t queueHighBytes;
+    size_t queueLowBytes;
+    unsigned int queueHighMsgs;
+    unsigned int queueLowMsgs;
+    TRviWritable writable;
+    void *writableData;
+
+    /* If set, the handling of every message is timed, see 
+     * rviSetStatsTiming() */
+    bool statsTiming;
+    /* Statistics of the connections closed so far, under the registry lock,
+     * see rviGetStats() */
+    TRviStats closedStats;
 } TRviContext;
 
+/** @brief Connection state for remote node */
+typedef enum {
+    /** TCP connection and TLS handshake in progress */
+    RVI_REMOTE_HANDSHAKE    = 0,
+    /** Handshake complete, "au" sent, waiting for the peer's "au" */
+    RVI_REMOTE_AUTH         = 1,
+    /** Credentials exchanged and services announced */
+    RVI_REMOTE_CONNECTED    = 2,
+    /** Connection lost, waiting out the backoff delay before reconnecting */
+    RVI_REMOTE_BACKOFF      = 3
+} ERviRemoteState;
+
 /** @brief Data for connection to remote node */
 typedef struct TRviRemote {
     /** File descriptor for the connection */
     int fd;
+    /** Normalized "host:port" the connection was made to, the key into the
+     * context's host index */
+    char *hostKey;
     /** List of TRviRights structures, containing receive & invoke rights and
      * expiration */
     TRviList *rights;
-    /** Pointer to data buffer for partial I/O operations */
-    void *buf;
-    /** Length of buffer */
-    int buflen;
+    /** The same rights, compiled for matching */
+    TRviRightsIndex rightsIdx;
+    /** Recent authorization decisions for services invoked by the remote,
+     * indexed by service id */
+    TRviAuthCacheEntry authCache[RVI_AUTH_CACHE_SIZE];
+    /** Data received but not yet dispatched, e.g., a partial message */
+    TRviBuffer rbuf;
+    /** Framer state for the messages in rbuf */
+    TRviFramer framer;
     /** Pointer to BIO chain from OpenSSL library */
     BIO *sbio;
+    /** If true, the connection uses non-blocking I/O */
+    bool nonblocking;
+    /** Connection state */
+    ERviRemoteState state;
+    /** Poll events the connection is waiting for (POLLIN/POLLOUT) */
+    short events;
+    /** Output not yet written (non-blocking, or held for coalescing) */
+    TRviBuffer wbuf;
+    /** Monotonic time (ms) by which held output must be written, 0 if none */
+    long long flushDeadline;
+    /** Offsets just past each message in wbuf, as long longs, oldest first,
+     * counted from the start of everything queued since the connection was
+     * opened; and how much of that has been written. Only kept while there 
+     * is a bound on the number of messages queued. */
+    TRviBuffer wends;
+    long long wbufBase;
+    /** Set when an invocation was refused because the output queue was 
+     * full; cleared, setting drained, once the queue is down to the low 
+     * watermarks again */
+    bool throttled;
+    /** Monotonic time (ms) data was last received, and a ping last sent */
+    long long lastRxMs;
+    long long lastPingMs;
+    /** Set when a keepalive ping has been sent since data was last received */
+    bool pingSent;
+    /** TLS session from the last handshake, offered again on reconnect */
+    SSL_SESSION *session;
+    /** Current reconnect delay (ms), 0 after a successful connection */
+    int backoffMs;
+    /** Monotonic time (ms) of the next reconnect attempt, while in backoff */
+    long long reconnectAt;
+    /** Descriptor and events registered with the event loop (-1 if none) */
+    int watchFd;
+    short watchEvents;
+    /** Set when the remote has been disconnected but not yet freed */
+    bool closed;
+    /** Set once an "sa" message has been received from the remote */
+    bool announced;
+    /** Set when this node's "au" offered binary frames, which the remote may
+     * then send; and once the remote's "au" offered them too, when this node
+     * sends them. Both are cleared when the connection is reopened. */
+    bool binaryIn;
+    bool binaryOut;
+    /** Check of the credentials in the remote's "au" by the verifier 
+     * threads, NULL if none is in progress. Messages received after the "au"
+     * are held until it is done. */
+    struct TRviVerifyJob *verify;
+    /** Serializes I/O on the connection between the event loop and threads
+     * writing to it; recursive, since a write may flush held output */
+    pthread_mutex_t lock;
+    /** Set when a write found the connection lost; the event loop reopens
+     * it, see rviRemoteLost() */
+    bool lost;
+    /** Set when another thread disconnected the remote; its I/O worker 
+     * closes it, see rviDisconnect() */
+    bool hangup;
+    /** Set when the output queue has drained, for the event loop to call the
+     * writable callback, see rviRemoteSent() */
+    bool drained;
+    /** Event loop the connection belongs to, and its links in the loop's
+     * shard of the connections */
+    TRviReactor *reactor;
+    struct TRviRemote *shardPrev;
+    struct TRviRemote *shardNext;
+    /** Services announced by the remote, linked through ownerNext */
+    struct TRviService *services;
+    /** Number of services in the list */
+    unsigned int serviceCount;
+    /** Counters and timings, changed by the remote's event loop, or under
+     * its lock for output; see rviGetStats() */
+    TRviStats stats;
+    /** Monotonic time (ns) the current connection attempt started */
+    long long connectNs;
 } TRviRemote;
 
 /** @brief Data for service */
@@ -91,8 +477,17 @@ typedef struct TRviService {
     int registrant;
     /** Callback function to execute upon service invocation */
     TRviCallback callback;
+    /** Alternative callback, given the parameters as they were received */
+    TRviRawCallback rawCallback;
     /** Service data to be passed to the callback */
     void *data;
+    /** Unique id, identifies the service in authorization caches */
+    unsigned long id;
+    /** Remote node that announced the service, NULL if registered locally */
+    TRviRemote *owner;
+    /** Links in the owner's list of services */
+    struct TRviService *ownerPrev;
+    struct TRviService *ownerNext;
 } TRviService;
 
 /** Data structure for rights parsed from validated credential */
@@ -102,6 +497,78 @@ typedef struct TRviRights {
     long expiration;     /* unix epoch time for jwt's validity.end */
 } TRviRights;
 
+/** A change to a local service that has not been announced yet */
+typedef struct TRviPendingAnnounce {
+    char *name;         /* Fully-qualified service name, the hash key */
+    bool available;     /* true if registered, false if unregistered */
+} TRviPendingAnnounce;
+
+/** A call awaiting a reply, see rviInvokeServiceAsync() */
+typedef struct TRviPendingCall {
+    long long tid;              /* Transaction id, the hash key */
+    int fd;                     /* Connection the call was sent on */
+    long long tick;             /* Wheel tick in which the call times out */
+    TRviCompletion completion;  /* Called on reply, timeout or disconnect */
+    void *data;                 /* Passed to the completion */
+    struct TRviPendingCall *prev;   /* Neighbours in the wheel slot */
+    struct TRviPendingCall *next;
+} TRviPendingCall;
+
+/** Cached result of verifying a credential presented by a peer */
+typedef struct TRviCredCacheEntry {
+    /** SHA-256 of the credential and the peer's certificate */
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    /** Rights granted by the credential, expiring at its validity.stop */
+    TRviRights *rights;
+    /** Neighbours in the least recently used list */
+    struct TRviCredCacheEntry *prev;
+    struct TRviCredCacheEntry *next;
+} TRviCredCacheEntry;
+
+/** A service invocation handed to the executor, see rviRunService(). The 
+ * name and parameters are copied into the same allocation, after it. */
+typedef struct TRviInvocation {
+    TRviCallback callback;
+    TRviRawCallback rawCallback;
+    void *data;         /* The service's data */
+    int fd;             /* Connection the invocation arrived on */
+    long long tid;
+    char *name;
+    char *parameters;   /* Null-terminated */
+    size_t len;
+} TRviInvocation;
+
+/** A credential presented by a peer, to be checked by a verifier thread */
+typedef struct TRviVerifyCred {
+    char *cred;
+    /** Digest for the credential cache, if keyed is set */
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    bool keyed;
+    /** Rights granted by the credential, once checked, if it is valid */
+    TRviRights *rights;
+} TRviVerifyCred;
+
+/** The credentials from a peer's "au" that were not found in the cache, 
+ * checked together by a verifier thread */
+typedef struct TRviVerifyJob {
+    /** The remote that presented them, NULL once it no longer waits for the
+     * check, e.g., because it was closed; under verifyLock */
+    TRviRemote *remote;
+    /** The peer's certificate, and a copy of the CA key to check against */
+    X509 *cert;
+    char *caKey;
+    /** The context's credGen when the check was made */
+    unsigned int credGen;
+    /** Monotonic time (ns) the "au" was received */
+    long long startNs;
+    /** Set under verifyLock once the check is done */
+    bool done;
+    /** Next check in the queue */
+    struct TRviVerifyJob *next;
+    int count;
+    TRviVerifyCred creds[];
+} TRviVerifyJob;
+
 /* 
  * Declarations for internal functions not exposed in the API 
  */
@@ -116,10 +583,12 @@ TRviRemote *rviRemoteCreate ( BIO *sbio, const int fd );
 
 void rviRemoteDestroy ( TRviRemote *remote );
 
-TRviRights *rviRightsCreate (   const char *rightToReceive, 
-                                    const char *rightToInvoke, 
+TRviRights *rviRightsCreate (   json_t *rightToReceive, 
+                                    json_t *rightToInvoke, 
                                     long validity );
 
+TRviRights *rviRightsClone ( TRviRights *rights );
+
 void rviRightsDestroy ( TRviRights *rights );
 
 void rviRightsListDestroy ( TRviList *list );
@@ -128,14 +597,26 @@ void rviCredentialListDestroy ( TRviList *list );
 
 char *rviFqsnGet( TRviHandle handle, const char *serviceName );
 
-/* Comparison functions for constructing btrees and retrieving values */
-int rviCompareFd ( void *a, void *b );
+/* Indexes for remote connections and services */
+TRviRemote *rviRemoteLookup( TRviHandle handle, int fd );
 
-int rviCompareRegistrant ( void *a, void *b );
+int rviRemoteIndexInsert( TRviHandle handle, TRviRemote *remote );
 
-int rviCompareName ( void *a, void *b );
+void rviRemoteIndexRemove( TRviHandle handle, TRviRemote *remote );
+
+char *rviHostKey( const char *addr, const char *port );
+
+void rviHostIndexRemove( TRviHandle handle, TRviRemote *remote );
 
-int rviComparePattern ( const char *pattern, const char *fqsn );
+TRviService *rviServiceLookup( TRviHandle handle, const char *name );
+
+int rviServiceIndexInsert( TRviHandle handle, TRviService *service );
+
+void rviServiceIndexRemove( TRviHandle handle, TRviService *service );
+
+/* Comparison functions for constructing btrees and retrieving values */
+
+int rviCompareName ( void *a, void *b );
 
 /* Utility functions related to OpenSSL library */
 int sslVerifyCallback ( int ok, X509_STORE_CTX *store );
@@ -146,25 +627,49 @@ SSL_CTX *rviSetupClientCtx ( TRviHandle handle );
 
 int rviReadJsonConfig ( TRviHandle handle, const char * filename );
 
-int rviReadJsonChunk( json_t **json, char *src, TRviRemote *remote);
+int rviReadMessages( TRviHandle handle, TRviRemote *remote );
+
+int rviLoadCaKey( TRviHandle handle );
+
+int rviDecodeCredential( TRviHandle handle, const char *cred, X509 *cert,
+                         TRviRights **rights );
 
-json_t *rviGetJsonGrant ( jwt_t *jwt, const char *grant );
+int rviDecodeCredentialKey( const char *caKey, const char *cred, X509 *cert,
+                            TRviRights **rights );
 
-char *rviGetPubkeyFile( char *filename );
+int rviCredCacheKey( const char *cred, X509 *cert, unsigned char *digest );
 
-int rviValidateCredential( TRviHandle handle, const char *cred, X509 *cert );
+TRviRights *rviCredCacheLookup( TRviHandle handle, 
+                                const unsigned char *digest );
 
-int rviGetRightsFromCredential( TRviHandle handle, const char *cred, 
-                           TRviList *rights );
+int rviCredCacheInsert( TRviHandle handle, const unsigned char *digest,
+                        TRviRights *rights );
 
-int rviRightToReceiveError( TRviList *rlist, const char *serviceName );
+void rviCredCacheClear( TRviHandle handle );
 
-int rviRightToInvokeError( TRviList *rlist, const char *serviceName );
+void rviRightsIndexInitialize( TRviRightsIndex *index, TRviList *list );
+
+void rviRightsIndexFree( TRviRightsIndex *index );
+
+void rviRightsIndexReset( TRviRightsIndex *index, TRviList *list );
+
+int rviRightsIndexExpire( TRviRightsIndex *index, time_t now );
+
+int rviRightsIndexAdd( TRviRightsIndex *index, TRviRights *rights );
+
+int rviRightToReceiveError( TRviRightsIndex *index, const char *serviceName );
+
+int rviRightToInvokeError( TRviRightsIndex *index, const char *serviceName );
 
 int rviRemoveService(TRviHandle handle, const char *serviceName);
 
 int rviReadAu( TRviHandle handle, json_t *msg, TRviRemote *remote );
 
+int rviRemoteRightsAdd( TRviHandle handle, TRviRemote *remote, 
+                        TRviRights *rights );
+
+void rviRemoteAuthorized( TRviHandle handle, TRviRemote *remote );
+
 int rviWriteAu( TRviHandle handle, TRviRemote *remote );
 
 int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote );
@@ -173,42 +678,179 @@ int rviAllServiceAnnounce( TRviHandle handle, TRviRemote *remote );
 
 int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available );
 
-int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote );
+int rviAnnounceDefer( TRviHandle handle, const char *name, bool available );
 
-/****************************************************************************/
+int rviAnnounceFlush( TRviHandle handle );
 
-/* 
- * This function compares 2 pointers to TRviRemote structures on the basis of
- * the remote's file descriptor. It is used for building the index for remote
- * connections. 
- */
-int rviCompareFd ( void *a, void *b )
-{
-    TRviRemote *remoteA = a;
-    TRviRemote *remoteB = b;
+int rviWriteSa( TRviHandle handle, TRviRemote *remote, const char **names, 
+                int count, bool available );
 
-    return ( remoteA->fd - remoteB->fd );
-}
+int rviRcvRightsError( TRviHandle handle, TRviRemote *remote, 
+                       const char *serviceName );
 
-/* 
- * This function compares 2 pointers to TRviService structures on the basis
- * of the registrant (i.e., file descriptor). For services registered by the
- * same remote RVI node, the service name is used to guarantee a unique
- * position in the b-tree. 
- */
-int rviCompareRegistrant ( void *a, void *b )
-{
-    TRviService *serviceA = a;
-    TRviService *serviceB = b;
+int rviReadRcv( TRviHandle handle, json_t *msg, const char *raw, 
+                size_t rawLen, TRviRemote *remote );
 
-    int result;
-    if ((( result = ( serviceA->registrant - serviceB->registrant)) == 0 ) &&
-            serviceA->name && serviceB->name ) {
-        result = strcmp ( serviceA->name, serviceB->name );
-    }
+int rviDispatchMessage( TRviHandle handle, json_t *msg, const char *raw, 
+                        size_t rawLen, TRviRemote *remote );
 
-    return result;
-}
+int rviRegisterServiceInternal( TRviHandle handle, const char *serviceName, 
+                                TRviCallback callback, 
+                                TRviRawCallback rawCallback, 
+                                void *serviceData );
+
+int rviRegisterServiceLocked( TRviHandle handle, const char *serviceName, 
+                              TRviCallback callback, 
+                              TRviRawCallback rawCallback, 
+                              void *serviceData );
+
+int rviResumeConnection( TRviHandle handle, int fd );
+
+void rviRemoteBackoff( TRviHandle handle, TRviRemote *remote );
+
+int rviRemoteReconnect( TRviHandle handle, TRviRemote *remote );
+
+void rviReconnectDue( TRviHandle handle, TRviReactor *reactor );
+
+void rviTimersDue( TRviHandle handle, TRviReactor *reactor );
+
+/* Utility functions for driving connections in non-blocking mode */
+int rviRemoteAdvance( TRviHandle handle, TRviRemote *remote );
+
+int rviRemoteWrite( TRviHandle handle, TRviRemote *remote, 
+                    const char *data, int len );
+
+int rviRemoteFlush( TRviHandle handle, TRviRemote *remote );
+
+void rviRemoteLost( TRviHandle handle, TRviRemote *remote );
+
+void rviRemoteFlag( TRviRemote *remote, bool *flag );
+
+int rviRemoteFlushHeld( TRviHandle handle, TRviRemote *remote );
+
+bool rviRemoteFull( TRviHandle handle, TRviRemote *remote );
+
+void rviRemoteSent( TRviHandle handle, TRviRemote *remote, size_t written );
+
+void rviLostDue( TRviHandle handle, TRviReactor *reactor );
+
+int rviRemoteQueued( TRviHandle handle, TRviRemote *remote );
+
+void rviFlushDue( TRviHandle handle, TRviReactor *reactor );
+
+void rviKeepaliveDue( TRviHandle handle, TRviReactor *reactor );
+
+int rviRemotePing( TRviHandle handle, TRviRemote *remote );
+
+int rviRemoteWriteRcv( TRviHandle handle, TRviRemote *remote, 
+                       const char *serviceName, long long tid, 
+                       long long timeout, const char *parameters, size_t len );
+
+int rviRemoteWriteRpl( TRviHandle handle, TRviRemote *remote, long long tid,
+                       const char *result, size_t len );
+
+TRviBuffer *rviRemoteOutput( TRviHandle handle, TRviRemote *remote );
+
+int rviRemoteOutputDone( TRviHandle handle, TRviRemote *remote, 
+                         TRviBuffer *out, size_t start );
+
+int rviCheckParameters( TRviHandle handle, const char *parameters, 
+                        size_t len );
+
+/* Utility functions for calls awaiting a reply */
+void rviCallSchedule( TRviHandle handle, TRviPendingCall *call );
+
+void rviCallUnlink( TRviHandle handle, TRviPendingCall *call );
+
+void rviCallsComplete( TRviPendingCall *list, int status );
+
+void rviCallsExpire( TRviHandle handle );
+
+void rviCallsFail( TRviHandle handle, int fd, int status );
+
+long long rviCallsNextDeadline( TRviHandle handle );
+
+int rviReadRpl( TRviHandle handle, json_t *msg, const char *raw, 
+                size_t rawLen, TRviRemote *remote );
+
+/* Utility functions for invocation deadlines and timers */
+static long long rviNowMs( void );
+
+long long rviWallMs( TRviHandle handle );
+
+bool rviDeadlinePassed( TRviHandle handle, long long timeout );
+
+bool rviRcvExpired( TRviHandle handle, const char *raw, size_t len );
+
+bool rviRcvFrameExpired( TRviHandle handle, const char *raw, size_t len );
+
+int rviRemoteProcess( TRviHandle handle, TRviRemote *remote );
+
+void rviServiceLink( TRviRemote *remote, TRviService *service );
+
+void rviServiceUnlink( TRviService *service );
+
+void rviRemoveRemoteServices( TRviHandle handle, TRviRemote *remote );
+
+void rviRemoteSetEvents( TRviHandle handle, TRviRemote *remote, short events );
+
+
+/* Utility functions for the built-in event loop */
+int rviReactorWatch( TRviHandle handle, TRviRemote *remote );
+
+void rviReactorUnwatch( TRviHandle handle, TRviRemote *remote );
+
+void rviReapRemotes( TRviHandle handle, TRviReactor *reactor );
+
+int rviReactorInitialize( TRviHandle handle, TRviReactor *reactor, 
+                          bool worker, uint32_t seed );
+
+void rviReactorFree( TRviHandle handle, TRviReactor *reactor );
+
+void rviReactorLink( TRviReactor *reactor, TRviRemote *remote );
+
+void rviReactorUnlink( TRviRemote *remote );
+
+void rviReactorMove( TRviHandle handle, TRviRemote *remote, 
+                     TRviReactor *reactor );
+
+void rviReactorNotify( TRviReactor *reactor, long long deadline );
+
+void rviReactorAdopt( TRviHandle handle, TRviReactor *reactor );
+
+int rviReactorRunOnce( TRviHandle handle, TRviReactor *reactor, int timeout );
+
+int rviReactorTimeout( TRviHandle handle, TRviReactor *reactor );
+
+TRviReactor *rviReactorPick( TRviHandle handle );
+
+TRviReactor *rviCallsReactor( TRviHandle handle );
+
+/* Utility functions for checking credentials on the verifier threads */
+void rviVerifyRun( TRviVerifyJob *job );
+
+bool rviVerifySubmit( TRviHandle handle, TRviVerifyJob *job );
+
+int rviVerifyApply( TRviHandle handle, TRviRemote *remote, 
+                    TRviVerifyJob *job );
+
+void rviVerifyFree( TRviVerifyJob *job );
+
+void rviVerifyCancel( TRviHandle handle, TRviRemote *remote );
+
+void rviVerifyDue( TRviHandle handle, TRviReactor *reactor );
+
+void rviVerifyStop( TRviHandle handle );
+
+/* Utility functions for the I/O workers */
+void rviWorkersRetire( TRviHandle handle, TRviReactor *workers, 
+                       int started, int count );
+
+int rviRunService( TRviHandle handle, TRviService *service, int fd, 
+                   const char *name, long long tid, 
+                   const char *parameters, size_t len );
+
+/****************************************************************************/
 
 /* 
  * This function will compare 2 pointers to TRviService structures on the
@@ -222,164 +864,635 @@ int rviCompareName ( void *a, void *b )
     return strcmp ( serviceA->name, serviceB->name );
 }
 
-/*
- * This function compares an RVI pattern to a fully-qualified service name. If
- * the service name matches the pattern, it returns RVI_OK or an error
- * otherwise.
+/* 
+ * Find the remote connection on the specified file descriptor. 
  */
-int rviComparePattern ( const char *pattern, const char *fqsn )
+TRviRemote *rviRemoteLookup( TRviHandle handle, int fd )
 {
-    /* Check input */
-    if( !pattern || !fqsn ) { return EINVAL; }
-    /* While there are bytes to compare */
-    while( *pattern != '\0' && *fqsn != '\0' ) {
-        /* If there's a topic wildcard... */
-        if( *pattern == '+' ) {
-            /* Advance topic in pattern */
-            while( *pattern++ != '/' && *pattern != '\0' );
-            /* Advance topic in fqsn */
-            while( *fqsn++ != '/' && *fqsn != '\0' );
-        }
-        /* If the bytes don't match, return error */
-        if( *pattern++ != *fqsn++ ) { return -1; }
-    }
-    /* If the pattern still has characters, the fqsn doesn't match */
-    if( *pattern != '\0' ) { return -1; }
+    TRviContext *ctx = (TRviContext *)handle;
 
-    /* Otherwise, the fqsn matches the pattern */
-    return RVI_OK;
+    if( fd < 0 || fd >= ctx->remotesSize ) { return NULL; }
+
+    return ctx->remotes[fd];
 }
 
 /* 
- * This function initializes a new service struct and sets the name,
- * registrant, and callback to the specified values. 
- *
- * If service name is null or registrant is negative, this returns NULL and
- * performs no operations. 
+ * Add a remote connection to the index, growing it to cover the remote's file
+ * descriptor if necessary. 
  */
-
-TRviService *rviServiceCreate ( const char *name, const int registrant, 
-                                    const TRviCallback callback, 
-                                    const void *serviceData )
+int rviRemoteIndexInsert( TRviHandle handle, TRviRemote *remote )
 {
-    /* If name is NULL or registrant is negative, there's an error */
-    if ( !name || (registrant < 0) ) { return NULL; }
+    TRviContext *ctx = (TRviContext *)handle;
+    TRviRemote  **remotes;
+    int         size;
+
+    if( remote->fd < 0 ) { return EINVAL; }
+
+    if( remote->fd >= ctx->remotesSize ) {
+        size = ctx->remotesSize ? ctx->remotesSize : 16;
+        while( size <= remote->fd ) { size *= 2; }
+        remotes = realloc( ctx->remotes, size * sizeof( TRviRemote * ) );
+        if( !remotes ) { return ENOMEM; }
+        memset( remotes + ctx->remotesSize, 0, 
+                ( size - ctx->remotesSize ) * sizeof( TRviRemote * ) );
+        ctx->remotes = remotes;
+        ctx->remotesSize = size;
+    }
+    if( ctx->remotes[remote->fd] ) { return EEXIST; }
 
-    /* Zero-initialize the struct */
-    TRviService *service = malloc( sizeof ( TRviService ) );
-    if( !service ) { return NULL; }
-    memset(service, 0, sizeof ( TRviService ) );
+    ctx->remotes[remote->fd] = remote;
+    ctx->remoteCount++;
 
-    /* Set the service name */
-    service->name = strdup ( name );
+    /* A new connection counts as activity for the keepalive */
+    if( !remote->lastRxMs ) { remote->lastRxMs = rviNowMs(); }
 
-    /* Set the service registrant */
-    service->registrant = registrant;
+    return RVI_OK;
+}
 
-    /* Set the callback. NULL is valid. */
-    service->callback = callback;
+/*
+ * Return the key a connection to addr and port is indexed by: "host:port" in
+ * lower case, without a trailing dot on the host name, and with an IPv6 
+ * address in brackets. The key is allocated and must be freed.
+ */
+char *rviHostKey( const char *addr, const char *port )
+{
+    size_t          hostLen = strlen( addr );
+    size_t          portLen = strlen( port );
+    bool            bracket;
+    char            *key;
+    char            *p;
+    size_t          i;
 
-    /* Set the serviceData. NULL is valid. */
-    service->data = serviceData;
+    if( hostLen > 1 && addr[hostLen - 1] == '.' ) { hostLen--; }
+    bracket = memchr( addr, ':', hostLen ) && addr[0] != '[';
 
-    /* Return the address of the new service */
-    return service;
+    key = malloc( hostLen + portLen + ( bracket ? 4 : 2 ) );
+    if( !key ) { return NULL; }
+
+    p = key;
+    if( bracket ) { *p++ = '['; }
+    for( i = 0; i < hostLen; i++ ) { *p++ = tolower( (unsigned char)addr[i] ); }
+    if( bracket ) { *p++ = ']'; }
+    *p++ = ':';
+    for( i = 0; i < portLen; i++ ) { *p++ = tolower( (unsigned char)port[i] ); }
+    *p = 0;
+
+    return key;
 }
 
-/* 
- * This function frees all memory allocated by a service struct. 
- * 
- * If service is null, no operations are performed. 
+/*
+ * Remove a remote connection from the host index, if it is the connection
+ * indexed under its key.
  */
-void rviServiceDestroy ( TRviService *service )
+void rviHostIndexRemove( TRviHandle handle, TRviRemote *remote )
 {
-     if ( !service ) { return; }
+    TRviContext *ctx = (TRviContext *)handle;
 
-     free ( service->name );
-     free ( service );
+    if( remote->hostKey && 
+        rviHashFind( &ctx->hostIdx, remote->hostKey ) == remote ) {
+        rviHashRemove( &ctx->hostIdx, remote->hostKey );
+    }
 }
 
-/*  
- * This function initializes a new remote struct and sets the file descriptor
- * and BIO chain to the specified values. 
- * 
- * If sbio is null or fd is negative, this returns NULL and performs no
- * operations. 
+/* 
+ * Remove a remote connection from the index. 
  */
-
-TRviRemote *rviRemoteCreate ( BIO *sbio, const int fd )
+void rviRemoteIndexRemove( TRviHandle handle, TRviRemote *remote )
 {
-    /* If sbio is null or fd is negative, there's a problem */
-    if ( !sbio || fd < 0 ) { return NULL; }
-    
-    /* Create a new data structure and zero-initialize it */
-    TRviRemote *remote = malloc ( sizeof ( TRviRemote ) );
-    if( !remote ) { return NULL; }
-    memset ( remote, 0, sizeof ( TRviRemote ) );
+    TRviContext *ctx = (TRviContext *)handle;
 
-    /* Set the file descriptor and BIO chain */
-    remote->fd = fd;
-    remote->sbio = sbio;
+    if( rviRemoteLookup( handle, remote->fd ) == remote ) {
+        ctx->remotes[remote->fd] = NULL;
+        ctx->remoteCount--;
+    }
+}
 
-    /* Note that we do NOT need to populate rightToReceive or 
-     * rightToInvoke at this time. Those will be populated by parsing the au 
-     * message. */
-    remote->rights = malloc( sizeof( TRviList ) );
-    if( !remote->rights ) { free( remote ); return NULL; }
-    rviListInitialize( remote->rights );
+/* 
+ * Find a service by its fully qualified name. 
+ */
+TRviService *rviServiceLookup( TRviHandle handle, const char *name )
+{
+    TRviContext *ctx = (TRviContext *)handle;
 
-    return remote;
+    return rviHashFind( &ctx->serviceHash, name );
 }
 
 /* 
- * This function frees all memory allocated by a remote struct. 
- * 
- * If remote is null, no operations are performed. 
+ * Add a service to all of the service indexes. Service names are unique, so
+ * a service replaces an existing one with the same name, unless the existing
+ * one was registered locally and the new one was announced by a remote node.
+ * In that case EEXIST is returned and the new service is not added.
  */
-void rviRemoteDestroy ( TRviRemote *remote)
+int rviServiceIndexInsert( TRviHandle handle, TRviService *service )
 {
-    if ( !remote ) { return; }
+    TRviContext *ctx = (TRviContext *)handle;
+    TRviService *old;
+    int         err;
 
-    rviRightsListDestroy( remote->rights );
+    if( ( old = rviServiceLookup( handle, service->name ) ) ) {
+        if( old->registrant == 0 && service->registrant != 0 ) {
+            return EEXIST;
+        }
+        rviServiceIndexRemove( handle, old );
+        rviServiceDestroy( old );
+    }
 
-    BIO_free_all ( remote->sbio );
+    if( ( err = rviHashInsert( &ctx->serviceHash, service->name, service ) ) ) {
+        return err;
+    }
+    btree_insert( ctx->serviceNameIdx, service );
 
-    if ( remote->buflen ) free ( remote->buf );
-    free ( remote );
+    return RVI_OK;
 }
 
-/* This function creates a new rights struct for the given rights and
- * expiration */
-TRviRights *rviRightsCreate (   const char *rightToReceive, 
-                                    const char *rightToInvoke, 
-                                    long validity )
+/* 
+ * Remove a service from all of the service indexes. 
+ */
+void rviServiceIndexRemove( TRviHandle handle, TRviService *service )
 {
-    if( !rightToReceive || !rightToInvoke || validity < 1 ) {
-        return NULL;
-    }
-
-    TRviRights *new = NULL;
-    new = malloc( sizeof( TRviRights ) );
-    if( !new ) { return NULL; }
-    new->receive = json_loads( rightToReceive, 0, NULL);
-    new->invoke = json_loads( rightToInvoke, 0, NULL);
-    new->expiration = validity;
+    TRviContext *ctx = (TRviContext *)handle;
 
-    return new;
+    rviHashRemove( &ctx->serviceHash, service->name );
+    btree_delete( ctx->serviceNameIdx, ctx->serviceNameIdx->root, service );
+    rviServiceUnlink( service );
 }
 
-/* This function destroys a rights struct and frees all allocated memory */
-void rviRightsDestroy ( TRviRights *rights ) 
+/* 
+ * Add a service to the list of services announced by a remote node. 
+ */
+void rviServiceLink( TRviRemote *remote, TRviService *service )
 {
-    if( !rights ) { return; }
-    json_decref( rights->receive );
-    json_decref( rights->invoke );
-    free( rights );
+    service->owner      = remote;
+    service->ownerPrev  = NULL;
+    service->ownerNext  = remote->services;
+    if( remote->services ) {
+        remote->services->ownerPrev = service;
+    }
+    remote->services = service;
+    remote->serviceCount++;
 }
 
-/* This function destroys a list containing rights structures and frees all
- * allocated memory */
-void rviRightsListDestroy ( TRviList *list )
+/* 
+ * Remove a service from the list of its owner, if it has one. 
+ */
+void rviServiceUnlink( TRviService *service )
+{
+    TRviRemote  *remote = service->owner;
+
+    if( !remote ) { return; }
+
+    if( service->ownerPrev ) {
+        service->ownerPrev->ownerNext = service->ownerNext;
+    } else {
+        remote->services = service->ownerNext;
+    }
+    if( service->ownerNext ) {
+        service->ownerNext->ownerPrev = service->ownerPrev;
+    }
+    remote->serviceCount--;
+
+    service->owner      = NULL;
+    service->ownerPrev  = NULL;
+    service->ownerNext  = NULL;
+}
+
+/* Last id assigned to a service, shared by all contexts */
+static unsigned long rviServiceIds;
+
+/* Current time in milliseconds, from a clock that is not affected by changes
+ * to the system time */
+static long long rviNowMs( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* The same clock, in nanoseconds, for timing */
+static long long rviNowNs( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Record a duration in a histogram, in the bucket of its highest bit */
+static void rviHistogramAdd( TRviHistogram *hist, long long ns )
+{
+    int             bucket  = 0;
+
+    if( ns < 0 ) { ns = 0; }
+    if( ns > 0 ) { bucket = 63 - __builtin_clzll( ns ); }
+    if( bucket >= RVI_STATS_BUCKETS ) { bucket = RVI_STATS_BUCKETS - 1; }
+
+    hist->count++;
+    hist->totalNs += ns;
+    if( (unsigned long long)ns > hist->maxNs ) { hist->maxNs = ns; }
+    hist->buckets[bucket]++;
+}
+
+/* Fold one histogram into another */
+static void rviHistogramMerge( TRviHistogram *dst, const TRviHistogram *src )
+{
+    int             i;
+
+    dst->count += src->count;
+    dst->totalNs += src->totalNs;
+    if( src->maxNs > dst->maxNs ) { dst->maxNs = src->maxNs; }
+    for( i = 0; i < RVI_STATS_BUCKETS; i++ ) { 
+        dst->buckets[i] += src->buckets[i]; 
+    }
+}
+
+/* Fold the statistics of one connection, or group of them, into another */
+static void rviStatsMerge( TRviStats *dst, const TRviStats *src )
+{
+    dst->bytesIn += src->bytesIn;
+    dst->bytesOut += src->bytesOut;
+    dst->msgsIn += src->msgsIn;
+    dst->msgsOut += src->msgsOut;
+    dst->reconnects += src->reconnects;
+    dst->credCacheHits += src->credCacheHits;
+    dst->credCacheMisses += src->credCacheMisses;
+    if( src->carryHighWater > dst->carryHighWater ) {
+        dst->carryHighWater = src->carryHighWater;
+    }
+    rviHistogramMerge( &dst->handshake, &src->handshake );
+    rviHistogramMerge( &dst->credentials, &src->credentials );
+    rviHistogramMerge( &dst->parse, &src->parse );
+    rviHistogramMerge( &dst->rights, &src->rights );
+    rviHistogramMerge( &dst->callback, &src->callback );
+}
+
+/* Start timing a step of message handling; 0 if timing is disabled */
+static long long rviStatsStart( TRviContext *ctx )
+{
+    return ctx->statsTiming ? rviNowNs() : 0;
+}
+
+/* Record the time since rviStatsStart(), unless it was disabled then */
+static void rviStatsSince( TRviHistogram *hist, long long start )
+{
+    if( start ) { rviHistogramAdd( hist, rviNowNs() - start ); }
+}
+
+/* 
+ * Pools for the structures that live as long as a connection or a 
+ * registration, shared by all contexts and released with the last one. 
+ * Contexts may be used from different threads, so the pools, like the count
+ * of contexts, are only used under rviPoolLock. 
+ */
+static TRviPool rviServicePool = RVI_POOL_INITIALIZER( sizeof( TRviService ) );
+static TRviPool rviRemotePool = RVI_POOL_INITIALIZER( sizeof( TRviRemote ) );
+static TRviPool rviRightsPool = RVI_POOL_INITIALIZER( sizeof( TRviRights ) );
+static TRviPool rviCallPool = 
+    RVI_POOL_INITIALIZER( sizeof( TRviPendingCall ) );
+static unsigned int rviContexts;
+static pthread_mutex_t rviPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *rviSharedAlloc( TRviPool *pool )
+{
+    void *object;
+
+    pthread_mutex_lock( &rviPoolLock );
+    object = rviPoolAlloc( pool );
+    pthread_mutex_unlock( &rviPoolLock );
+
+    return object;
+}
+
+static void rviSharedRelease( TRviPool *pool, void *object )
+{
+    if( !object ) { return; }
+
+    pthread_mutex_lock( &rviPoolLock );
+    rviPoolRelease( pool, object );
+    pthread_mutex_unlock( &rviPoolLock );
+}
+
+/* Process-wide set up, done by the first rviInit() */
+static pthread_once_t rviInitOnce = PTHREAD_ONCE_INIT;
+
+static void *rviJsonMalloc( size_t size );
+static void rviJsonFree( void *ptr );
+
+/* The allocator jansson had before rviInit(), used outside arena scopes */
+static json_malloc_t rviJsonHeapMalloc = malloc;
+static json_free_t rviJsonHeapFree = free;
+
+static void rviInitProcess( void )
+{
+    json_malloc_t   heapMalloc  = NULL;
+    json_free_t     heapFree    = NULL;
+
+    /* initialize OpenSSL */
+    SSL_library_init();
+    SSL_load_error_strings();
+
+    /* Route jansson's allocations through the message arenas, keeping the
+     * application's allocator, if it installed one, for everything else */
+    json_get_alloc_funcs( &heapMalloc, &heapFree );
+    if( heapMalloc && heapFree ) {
+        rviJsonHeapMalloc = heapMalloc;
+        rviJsonHeapFree = heapFree;
+    }
+    json_set_alloc_funcs( rviJsonMalloc, rviJsonFree );
+}
+
+/* 
+ * Take the registry lock of a context for reading or for writing, see 
+ * TRviContext. 
+ */
+static void rviRegistryRead( TRviContext *ctx )
+{
+    pthread_rwlock_rdlock( &ctx->registryLock );
+}
+
+static void rviRegistryWrite( TRviContext *ctx )
+{
+    pthread_rwlock_wrlock( &ctx->registryLock );
+}
+
+static void rviRegistryUnlock( TRviContext *ctx )
+{
+    pthread_rwlock_unlock( &ctx->registryLock );
+}
+
+/* Take a transaction id, from any thread */
+static long long rviNextTid( TRviContext *ctx )
+{
+    return __sync_fetch_and_add( &ctx->nextTid, 1 );
+}
+
+/* 
+ * JSON built and parsed while handling a message is allocated from the 
+ * context's message arena. rviInit() installs rviJsonMalloc() and 
+ * rviJsonFree() as jansson's allocator; outside of an arena scope they fall 
+ * through to the allocator jansson had before, normally malloc() and free(),
+ * so JSON owned by the application is not affected. Scopes nest, e.g., when a service callback invokes another 
+ * service, and are tracked per thread.
+ */
+typedef struct TRviJsonScope {
+    TRviArena *arena;
+    TRviArenaMark mark;     /* Arena position when the scope was entered */
+    bool paused;            /* Allocate from the heap while set */
+    struct TRviJsonScope *prev;
+} TRviJsonScope;
+
+static __thread TRviJsonScope *rviJsonScope;
+
+/* 
+ * The event loop the thread last ran: the built-in loop of the context it
+ * called rviProcessInput(), rviRunOnce() or rviProcessTimers() on, or the 
+ * loop of the I/O worker it is. That thread alone uses the loop's message 
+ * arena. 
+ */
+static __thread TRviReactor *rviLoopReactor;
+
+static void *rviJsonMalloc( size_t size )
+{
+    if( rviJsonScope && !rviJsonScope->paused ) {
+        return rviArenaAlloc( rviJsonScope->arena, size );
+    }
+    return rviJsonHeapMalloc( size );
+}
+
+/* Frees JSON memory, including strings returned by json_dumps() */
+static void rviJsonFree( void *ptr )
+{
+    TRviJsonScope *scope;
+
+    /* Arena blocks are released all at once when their scope ends */
+    for( scope = rviJsonScope; scope; scope = scope->prev ) {
+        if( rviArenaContains( scope->arena, ptr ) ) { return; }
+    }
+    rviJsonHeapFree( ptr );
+}
+
+static void rviJsonScopeBegin( TRviJsonScope *scope, TRviArena *arena )
+{
+    scope->arena = arena;
+    scope->mark = rviArenaMark( arena );
+    scope->paused = false;
+    scope->prev = rviJsonScope;
+    rviJsonScope = scope;
+}
+
+/* Everything allocated in the scope must be unreferenced by now */
+static void rviJsonScopeEnd( TRviJsonScope *scope )
+{
+    rviJsonScope = scope->prev;
+    rviArenaRewind( scope->arena, scope->mark );
+}
+
+/* 
+ * Send JSON to the heap rather than the arena, for code that keeps what it
+ * allocates (e.g., rights from credentials) or that we don't control (service
+ * callbacks). Returns the previous state, for rviJsonScopeResume(). 
+ */
+static bool rviJsonScopePause( void )
+{
+    bool paused = false;
+
+    if( rviJsonScope ) {
+        paused = rviJsonScope->paused;
+        rviJsonScope->paused = true;
+    }
+    return paused;
+}
+
+static void rviJsonScopeResume( bool paused )
+{
+    if( rviJsonScope ) { rviJsonScope->paused = paused; }
+}
+
+/* 
+ * This function initializes a new service struct and sets the name,
+ * registrant, and callback to the specified values. 
+ *
+ * If service name is null or registrant is negative, this returns NULL and
+ * performs no operations. 
+ */
+
+TRviService *rviServiceCreate ( const char *name, const int registrant, 
+                                    const TRviCallback callback, 
+                                    const void *serviceData )
+{
+    /* If name is NULL or registrant is negative, there's an error */
+    if ( !name || (registrant < 0) ) { return NULL; }
+
+    /* Zero-initialize the struct */
+    TRviService *service = rviSharedAlloc( &rviServicePool );
+    if( !service ) { return NULL; }
+    memset(service, 0, sizeof ( TRviService ) );
+
+    /* Set the service name */
+    service->name = strdup ( name );
+
+    /* Set the service registrant */
+    service->registrant = registrant;
+
+    /* Set the callback. NULL is valid. */
+    service->callback = callback;
+
+    /* Set the serviceData. NULL is valid. */
+    service->data = serviceData;
+
+    /* Ids are never reused, unlike the addresses of freed services */
+    service->id = __sync_add_and_fetch( &rviServiceIds, 1 );
+
+    /* Return the address of the new service */
+    return service;
+}
+
+/* 
+ * This function frees all memory allocated by a service struct. 
+ * 
+ * If service is null, no operations are performed. 
+ */
+void rviServiceDestroy ( TRviService *service )
+{
+     if ( !service ) { return; }
+
+     free ( service->name );
+     rviSharedRelease ( &rviServicePool, service );
+}
+
+/*  
+ * This function initializes a new remote struct and sets the file descriptor
+ * and BIO chain to the specified values. 
+ * 
+ * If sbio is null or fd is negative, this returns NULL and performs no
+ * operations. 
+ */
+
+TRviRemote *rviRemoteCreate ( BIO *sbio, const int fd )
+{
+    /* If sbio is null or fd is negative, there's a problem */
+    if ( !sbio || fd < 0 ) { return NULL; }
+    
+    /* Create a new data structure and zero-initialize it */
+    TRviRemote *remote = rviSharedAlloc( &rviRemotePool );
+    if( !remote ) { return NULL; }
+    memset ( remote, 0, sizeof ( TRviRemote ) );
+
+    /* Writes may flush held output, taking the lock again */
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+    pthread_mutex_init( &remote->lock, &attr );
+    pthread_mutexattr_destroy( &attr );
+
+    /* Set the file descriptor and BIO chain */
+    remote->fd = fd;
+    remote->sbio = sbio;
+    remote->events = POLLIN;
+    remote->watchFd = -1;
+    rviBufferInitialize( &remote->rbuf );
+    rviBufferInitialize( &remote->wbuf );
+    rviBufferInitialize( &remote->wends );
+    rviFramerInitialize( &remote->framer );
+
+    /* Collect the TLS session for resumption, see rviSessionNew() */
+    SSL *ssl = NULL;
+    BIO_get_ssl( sbio, &ssl );
+    if( ssl ) {
+        SSL_set_app_data( ssl, remote );
+        if( SSL_is_init_finished( ssl ) ) { 
+            remote->session = SSL_get1_session( ssl ); 
+        }
+    }
+
+    /* Note that we do NOT need to populate rightToReceive or 
+     * rightToInvoke at this time. Those will be populated by parsing the au 
+     * message. */
+    remote->rights = malloc( sizeof( TRviList ) );
+    if( !remote->rights ) { 
+        pthread_mutex_destroy( &remote->lock );
+        rviSharedRelease( &rviRemotePool, remote ); 
+        return NULL; 
+    }
+    rviListInitialize( remote->rights );
+    rviRightsIndexInitialize( &remote->rightsIdx, remote->rights );
+
+    return remote;
+}
+
+/* 
+ * This function frees all memory allocated by a remote struct. 
+ * 
+ * If remote is null, no operations are performed. 
+ */
+void rviRemoteDestroy ( TRviRemote *remote)
+{
+    if ( !remote ) { return; }
+
+    rviRightsListDestroy( remote->rights );
+    rviRightsIndexFree( &remote->rightsIdx );
+
+    BIO_free_all ( remote->sbio );
+    SSL_SESSION_free ( remote->session );
+    free ( remote->hostKey );
+
+    rviBufferFree ( &remote->rbuf );
+    rviBufferFree ( &remote->wbuf );
+    rviBufferFree ( &remote->wends );
+    pthread_mutex_destroy ( &remote->lock );
+    rviSharedRelease ( &rviRemotePool, remote );
+}
+
+/* This function creates a new rights struct for the given rights and
+ * expiration. The rights arrays are referenced, not copied. */
+TRviRights *rviRightsCreate (   json_t *rightToReceive, 
+                                    json_t *rightToInvoke, 
+                                    long validity )
+{
+    if( !json_is_array( rightToReceive ) || !json_is_array( rightToInvoke ) || 
+        validity < 1 ) {
+        return NULL;
+    }
+
+    TRviRights *new = NULL;
+    new = rviSharedAlloc( &rviRightsPool );
+    if( !new ) { return NULL; }
+    new->receive = json_incref( rightToReceive );
+    new->invoke = json_incref( rightToInvoke );
+    new->expiration = validity;
+
+    return new;
+}
+
+/* This function creates a new rights struct sharing the (read-only) rights
+ * arrays of an existing one */
+TRviRights *rviRightsClone ( TRviRights *rights )
+{
+    if( !rights ) { return NULL; }
+
+    TRviRights *new = rviSharedAlloc( &rviRightsPool );
+    if( !new ) { return NULL; }
+    new->receive = json_incref( rights->receive );
+    new->invoke = json_incref( rights->invoke );
+    new->expiration = rights->expiration;
+
+    return new;
+}
+
+/* This function destroys a rights struct and frees all allocated memory */
+void rviRightsDestroy ( TRviRights *rights ) 
+{
+    if( !rights ) { return; }
+    json_decref( rights->receive );
+    json_decref( rights->invoke );
+    rviSharedRelease( &rviRightsPool, rights );
+}
+
+/* This function destroys a list containing rights structures and frees all
+ * allocated memory */
+void rviRightsListDestroy ( TRviList *list )
 {
     if( !list ) { return; }
     TRviListEntry *ptr = list->listHead;
@@ -458,6 +1571,23 @@ int sslVerifyCallback ( int ok, X509_STORE_CTX *store )
     return ok;
 }
 
+/*
+ * Keep each new TLS session, including TLS 1.3 tickets that arrive after the
+ * handshake, with the remote it belongs to, so that a reconnect can resume it
+ * with an abbreviated handshake.
+ */
+static int rviSessionNew( SSL *ssl, SSL_SESSION *session )
+{
+    TRviRemote *remote = SSL_get_app_data( ssl );
+
+    if( !remote ) { return 0; }
+
+    SSL_SESSION_free( remote->session );
+    remote->session = session;
+
+    return 1; /* The remote now holds the reference */
+}
+
 /* 
  * Set up the SSL context. Configure for outbound connections only. 
  */
@@ -476,6 +1606,11 @@ SSL_CTX *rviSetupClientCtx ( TRviHandle handle )
     SSL_CTX_set_options( sslCtx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 |
                              SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1 );
 
+    /* Sessions are kept per remote rather than in the context's cache */
+    SSL_CTX_set_session_cache_mode( sslCtx, SSL_SESS_CACHE_CLIENT | 
+                                    SSL_SESS_CACHE_NO_INTERNAL_STORE );
+    SSL_CTX_sess_set_new_cb( sslCtx, rviSessionNew );
+
     /* Specify winnowed cipher list here */
     const char *cipherList = "HIGH";
     if(SSL_CTX_set_cipher_list(sslCtx, cipherList) != 1) { 
@@ -522,16 +1657,232 @@ SSL_CTX *rviSetupClientCtx ( TRviHandle handle )
     return sslCtx;
 }
  
-/**
- * This function will parse a JSON configuration file to retrieve the filenames
- * for the device certificate and key, as well as the directory names for CA
- * certificates and RVI credentials.
- *
- * On success, this function returns 0. On error, it will return a positive
- * error code.
+/*
+ * Snapshot of the rights granted by this node's own credentials, written to
+ * the file named by "rights_snapshot" so that later starts can skip checking
+ * the credentials that have not changed. The file holds a header followed by
+ * one record per credential that passed verification, each followed by its
+ * right_to_receive and right_to_invoke arrays as compact JSON. Integers are
+ * in host byte order, since the snapshot never leaves the machine.
  */
-int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
-{
+#define RVI_SNAPSHOT_MAGIC "RVIRSNP1"
+
+typedef struct TRviSnapshotHeader {
+    char magic[8];
+    uint32_t count;     /* Number of records */
+    /* SHA-256 of the CA key the credentials were checked against */
+    unsigned char caDigest[SHA256_DIGEST_LENGTH];
+} TRviSnapshotHeader;
+
+typedef struct TRviSnapshotRecord {
+    /* SHA-256 of the credential and device certificate, see 
+     * rviCredCacheKey() */
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    int64_t mtime;          /* Modification time of the file, in ns */
+    int64_t expiration;     /* The credential's validity.stop */
+    uint32_t receiveLen;    /* Length of the right_to_receive array... */
+    uint32_t invokeLen;     /* ...and of the right_to_invoke array */
+} TRviSnapshotRecord;
+
+/* A snapshot being read while the credentials load, and its replacement */
+typedef struct TRviSnapshot {
+    const char *path;   /* The snapshot file, NULL if not configured */
+    char *map;          /* The file mapped into memory, NULL if unusable */
+    size_t size;
+    TRviBuffer out;     /* Records for the replacement */
+    uint32_t count;     /* Number of records in out */
+    bool stale;         /* If set, the file must be replaced */
+    unsigned char caDigest[SHA256_DIGEST_LENGTH];
+} TRviSnapshot;
+
+/*
+ * Map the snapshot file, if any. A snapshot that is missing, damaged or made
+ * with another CA key is ignored, and replaced once the credentials have 
+ * been checked.
+ */
+static void rviSnapshotOpen( TRviSnapshot *snap, const char *path, 
+                             const char *caKey )
+{
+    TRviSnapshotHeader  header;
+    struct stat         st;
+    void                *map;
+    int                 fd;
+
+    memset( snap, 0, sizeof( *snap ) );
+    rviBufferInitialize( &snap->out );
+    snap->path = path;
+    snap->stale = true;
+    if( !path ) { return; }
+    SHA256( (const unsigned char *)caKey, strlen( caKey ), snap->caDigest );
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) { return; }
+    if( fstat( fd, &st ) || st.st_size < (off_t)sizeof( header ) ) { 
+        close( fd ); 
+        return; 
+    }
+    map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED ) { return; }
+
+    memcpy( &header, map, sizeof( header ) );
+    if( memcmp( header.magic, RVI_SNAPSHOT_MAGIC, sizeof( header.magic ) ) ||
+        memcmp( header.caDigest, snap->caDigest, SHA256_DIGEST_LENGTH ) ) {
+        munmap( map, st.st_size );
+        return;
+    }
+    snap->map = map;
+    snap->size = st.st_size;
+    snap->stale = false;
+}
+
+/*
+ * Look up the rights of a credential in the snapshot. Returns NULL, in which
+ * case the credential must be checked, if it has no record, if the file
+ * changed since the record was made, or if the rights have expired.
+ */
+static TRviRights *rviSnapshotFind( TRviSnapshot *snap, 
+                                    const unsigned char *digest, 
+                                    int64_t mtime, time_t now )
+{
+    TRviSnapshotHeader  header;
+    TRviSnapshotRecord  record;
+    TRviRights          *rights     = NULL;
+    json_t              *receive;
+    json_t              *invoke;
+    size_t              offset      = sizeof( header );
+    uint32_t            i;
+
+    if( !snap->map ) { return NULL; }
+    memcpy( &header, snap->map, sizeof( header ) );
+
+    for( i = 0; i < header.count; i++ ) {
+        if( snap->size - offset < sizeof( record ) ) { return NULL; }
+        memcpy( &record, snap->map + offset, sizeof( record ) );
+        offset += sizeof( record );
+        if( snap->size - offset < 
+            (size_t)record.receiveLen + record.invokeLen ) { 
+            return NULL; 
+        }
+        if( memcmp( record.digest, digest, SHA256_DIGEST_LENGTH ) == 0 ) {
+            break;
+        }
+        offset += (size_t)record.receiveLen + record.invokeLen;
+    }
+    if( i == header.count || record.mtime != mtime || 
+        record.expiration < now ) { 
+        return NULL; 
+    }
+
+    receive = json_loadb( snap->map + offset, record.receiveLen, 0, NULL );
+    invoke = json_loadb( snap->map + offset + record.receiveLen, 
+                         record.invokeLen, 0, NULL );
+    if( receive && invoke ) {
+        rights = rviRightsCreate( receive, invoke, record.expiration );
+    }
+    json_decref( receive );
+    json_decref( invoke );
+
+    return rights;
+}
+
+/* Add the rights of a credential to the replacement for the snapshot */
+static int rviSnapshotAdd( TRviSnapshot *snap, const unsigned char *digest, 
+                           int64_t mtime, TRviRights *rights )
+{
+    TRviSnapshotRecord  record;
+    char                *receive;
+    char                *invoke;
+    size_t              start   = rviBufferLength( &snap->out );
+    int                 err     = RVI_OK;
+
+    if( !snap->path ) { return RVI_OK; }
+
+    receive = json_dumps( rights->receive, JSON_COMPACT );
+    invoke = json_dumps( rights->invoke, JSON_COMPACT );
+    if( !receive || !invoke ) { err = ENOMEM; goto exit; }
+
+    memset( &record, 0, sizeof( record ) );
+    memcpy( record.digest, digest, SHA256_DIGEST_LENGTH );
+    record.mtime = mtime;
+    record.expiration = rights->expiration;
+    record.receiveLen = strlen( receive );
+    record.invokeLen = strlen( invoke );
+    if( rviBufferAppend( &snap->out, &record, sizeof( record ) ) ||
+        rviBufferAppend( &snap->out, receive, record.receiveLen ) ||
+        rviBufferAppend( &snap->out, invoke, record.invokeLen ) ) {
+        rviBufferTruncate( &snap->out, start );
+        err = ENOMEM; goto exit;
+    }
+    snap->count++;
+
+exit:
+    if( receive ) rviJsonFree( receive );
+    if( invoke ) rviJsonFree( invoke );
+
+    return err;
+}
+
+/*
+ * Replace the snapshot file, if save is set and the file no longer matches
+ * the credentials, and release the snapshot. The new file is written beside the old one and moved
+ * over it, so that a start interrupted here finds one or the other whole. 
+ * Failing to write it only costs the next start the full checks.
+ */
+static void rviSnapshotClose( TRviSnapshot *snap, bool save )
+{
+    TRviSnapshotHeader  header;
+    char                *tmpPath    = NULL;
+    FILE                *fp         = NULL;
+    bool                ok;
+    int                 fd;
+
+    if( snap->map ) {
+        memcpy( &header, snap->map, sizeof( header ) );
+        if( header.count != snap->count ) { snap->stale = true; }
+        munmap( snap->map, snap->size );
+    }
+    if( !save || !snap->path || !snap->stale ) { goto exit; }
+
+    tmpPath = malloc( strlen( snap->path ) + sizeof( ".tmp" ) );
+    if( !tmpPath ) { goto exit; }
+    sprintf( tmpPath, "%s.tmp", snap->path );
+
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, RVI_SNAPSHOT_MAGIC, sizeof( header.magic ) );
+    header.count = snap->count;
+    memcpy( header.caDigest, snap->caDigest, SHA256_DIGEST_LENGTH );
+
+    /* Anyone able to write the snapshot could grant this node rights */
+    fd = open( tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 );
+    if( fd < 0 ) { goto exit; }
+    fp = fdopen( fd, "w" );
+    if( !fp ) { close( fd ); unlink( tmpPath ); goto exit; }
+    ok = fwrite( &header, sizeof( header ), 1, fp ) == 1 &&
+         ( !snap->count ||
+           fwrite( rviBufferData( &snap->out ), 1, 
+                   rviBufferLength( &snap->out ), fp ) == 
+               rviBufferLength( &snap->out ) ) &&
+         fflush( fp ) == 0 && fsync( fileno( fp ) ) == 0;
+    if( fclose( fp ) || !ok || rename( tmpPath, snap->path ) ) {
+        unlink( tmpPath );
+    }
+
+exit:
+    free( tmpPath );
+    rviBufferFree( &snap->out );
+}
+
+/**
+ * This function will parse a JSON configuration file to retrieve the filenames
+ * for the device certificate and key, as well as the directory names for CA
+ * certificates and RVI credentials.
+ *
+ * On success, this function returns 0. On error, it will return a positive
+ * error code.
+ */
+int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
+{
     if ( !handle || !conf ) { return EINVAL; }
 
     int             err         = RVI_OK;
@@ -544,6 +1895,12 @@ int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
     BIO             *certbio    = NULL;
     X509            *cert       = NULL;
     char            *cred       = NULL;
+    TRviRights      *rights     = NULL;
+    TRviSnapshot    snap        = { 0 };
+    unsigned char   digest[SHA256_DIGEST_LENGTH];
+    struct stat     st;
+    int64_t         mtime;
+    time_t          now;
 
     tmp = json_object_get( conf, "dev" );
     if(!tmp) { err = RVI_ERR_JSON; goto exit; }
@@ -563,6 +1920,116 @@ int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
     ctx->cafile = strdup( json_string_value( 
                 json_object_get( tmp, "cert" ) ) );
 
+    /* Optional order for the service btrees; must be at least 2 */
+    tmp = json_object_get( conf, "btree_order" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 2 ||
+            json_integer_value( tmp ) > UINT_MAX ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->btreeOrder = json_integer_value( tmp );
+    }
+
+    /* Optional time that output may be held to coalesce messages */
+    tmp = json_object_get( conf, "flush_latency_ms" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 0 ||
+            json_integer_value( tmp ) > INT_MAX ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->flushLatency = json_integer_value( tmp );
+    }
+
+    /* Optional keepalive interval and the silence that ends a connection */
+    tmp = json_object_get( conf, "keepalive_ms" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 0 ||
+            json_integer_value( tmp ) > INT_MAX / 3 ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->keepalive = json_integer_value( tmp );
+        ctx->keepaliveTimeout = 3 * ctx->keepalive;
+    }
+    tmp = json_object_get( conf, "keepalive_timeout_ms" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || 
+            json_integer_value( tmp ) <= ctx->keepalive ||
+            json_integer_value( tmp ) > INT_MAX ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->keepaliveTimeout = json_integer_value( tmp );
+    }
+
+    /* Optional bounds on the delay before reconnecting a lost connection */
+    tmp = json_object_get( conf, "reconnect_min_ms" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 1 ||
+            json_integer_value( tmp ) > INT_MAX / 2 ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->reconnectMin = json_integer_value( tmp );
+    }
+    tmp = json_object_get( conf, "reconnect_max_ms" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 1 ||
+            json_integer_value( tmp ) > INT_MAX / 2 ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->reconnectMax = json_integer_value( tmp );
+    }
+    if( ctx->reconnectMax < ctx->reconnectMin ) { 
+        ctx->reconnectMax = ctx->reconnectMin; 
+    }
+
+    /* Optional number of threads checking the credentials of peers */
+    tmp = json_object_get( conf, "verify_threads" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 0 ||
+            json_integer_value( tmp ) > INT_MAX ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->verifyThreads = json_integer_value( tmp );
+    }
+
+    /* Optional encoding to offer peers */
+    tmp = json_object_get( conf, "wire_encoding" );
+    if( tmp ) {
+        if( json_is_string( tmp ) && 
+            strcmp( json_string_value( tmp ), "json" ) == 0 ) {
+            ctx->encoding = RVI_ENCODING_JSON;
+        } else if( json_is_string( tmp ) && 
+                   strcmp( json_string_value( tmp ), "msgpack" ) == 0 ) {
+            ctx->encoding = RVI_ENCODING_MSGPACK;
+        } else {
+            err = RVI_ERR_JSON; goto exit;
+        }
+    }
+
+    /* Optionally time the handling of every message */
+    tmp = json_object_get( conf, "stats_timing" );
+    if( tmp ) {
+        if( !json_is_boolean( tmp ) ) { err = RVI_ERR_JSON; goto exit; }
+        ctx->statsTiming = json_is_true( tmp );
+    }
+
+    /* Optional lifetime of the invocations sent by this node */
+    tmp = json_object_get( conf, "invoke_timeout_ms" );
+    if( tmp ) {
+        if( !json_is_integer( tmp ) || json_integer_value( tmp ) < 1 ||
+            json_integer_value( tmp ) > INT_MAX ) {
+            err = RVI_ERR_JSON; goto exit;
+        }
+        ctx->invokeTimeout = json_integer_value( tmp );
+    }
+
+    /* Load the CA key once; every credential is checked against it */
+    if( rviLoadCaKey( ctx ) != RVI_OK ) { err = RVI_ERR_NOCRED; goto exit; }
+
+    /* Optional snapshot of the rights granted by the credentials */
+    tmp = json_object_get( conf, "rights_snapshot" );
+    if( tmp && !json_is_string( tmp ) ) { err = RVI_ERR_JSON; goto exit; }
+    rviSnapshotOpen( &snap, json_string_value( tmp ), ctx->caKey );
+
     const char *creddir = json_string_value(
                 json_object_get ( conf, "creddir" ) );
     
@@ -589,6 +2056,7 @@ int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
     int i = 0;
     char *path = NULL;
     size_t pathSize;
+    time( &now );
     while ( ( dir = readdir( d ) ) ) {
         if ( strstr( dir->d_name, ".jwt" ) ) {
             /* if it's a jwt file, open it */
@@ -614,9 +2082,38 @@ int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
             } else {
                 cred[len] = '\0'; /* Ensure string is null-terminated */
             }
-            if( rviValidateCredential( handle, cred, cert ) == RVI_OK ) {
+            /* Credentials recorded in the snapshot need not be checked
+             * again, unless the file has changed or the rights expired */
+            rights = NULL;
+            mtime = -1;
+            if( snap.path && !fstat( fileno( fp ), &st ) ) {
+                mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + 
+                        st.st_mtim.tv_nsec;
+            }
+            if( mtime >= 0 && 
+                rviCredCacheKey( cred, cert, digest ) == RVI_OK ) {
+                rights = rviSnapshotFind( &snap, digest, mtime, now );
+                if( !rights ) { snap.stale = true; }
+            } else {
+                mtime = -1;
+            }
+            /* Keep the credential and its rights if it is valid for us */
+            if( rights || 
+                rviDecodeCredential( handle, cred, cert, &rights ) == RVI_OK ) {
+                if( mtime >= 0 && 
+                    rviSnapshotAdd( &snap, digest, mtime, rights ) ) {
+                    rviRightsDestroy( rights );
+                    err = ENOMEM; goto exit;
+                }
                 rviListInsert( ctx->creds, cred );
+                rviListInsert( ctx->rights, rights );
+                if( rviRightsIndexAdd( &ctx->rightsIdx, rights ) != RVI_OK ) {
+                    err = ENOMEM; goto exit;
+                }
+            } else {
+                free( cred );
             }
+            cred = NULL;
             fclose( fp );
             free(path);
             i++;
@@ -624,6 +2121,7 @@ int rviParseJsonConfig ( TRviHandle handle, json_t *conf )
     }
 
 exit:
+    rviSnapshotClose( &snap, err == RVI_OK );
     BIO_free_all( certbio );
     X509_free( cert );
     if( d ) closedir( d );
@@ -631,210 +2129,323 @@ exit:
     return err;
 }
 
-/* This utility function returns a pointer to the first delim in a buffer, or
- * NULL if delim does not appear in the buffer. IT DOES NOT COPY THE BUFFER: if
- * needed, the partial buffer must be copied to a new buffer and the original
- * buffer freed by the calling function.
- */
-char *start_buf_at_char(char *buf, char delim)
+/* Credential cache entries are hashed on their digest, which is already
+ * uniformly distributed */
+static uint32_t rviCredCacheHash( const void *key )
 {
-    if (!buf) return NULL;
-    while (*buf != '\0' && *buf != delim && *buf++);
-    if (*buf != delim) {
-        buf = NULL;
-    }
-    return buf;
+    uint32_t h;
+
+    memcpy( &h, key, sizeof( h ) );
+    return h;
 }
 
-/* This utility function destructively reads from 'src' to populate '*json'
- * with a parsed json_t object. The remaining string (possibly 'src' exactly)
- * is copied into the buf member of "remote" (and updates the buflen). The
- * original 'src' must not be accessed again by the calling function. */
-int rviReadJsonChunk( json_t **json, char *src, TRviRemote *remote )
+static bool rviCredCacheEqual( const void *key1, const void *key2 )
 {
-    json_error_t error;
-    int ret = 0;
-    int len;
+    return memcmp( key1, key2, SHA256_DIGEST_LENGTH ) == 0;
+}
 
-    *json = json_loads(src, JSON_DISABLE_EOF_CHECK, &error);
+/* Pending calls are hashed on their transaction id */
+static uint32_t rviCallHash( const void *key )
+{
+    return rviHashBytes( key, sizeof( long long ) );
+}
 
-    char *tmp = {0};
+static bool rviCallEqual( const void *key1, const void *key2 )
+{
+    return *(const long long *)key1 == *(const long long *)key2;
+}
 
-    if (!*json) { 
-        /* If we did not get JSON, make sure the buffer starts on a valid char
-         * */ 
-        tmp = start_buf_at_char(src, '{');
-    } else { 
-        /* If we did get JSON, check the remaining buffer for additional JSON
-         * strings */
-        tmp = start_buf_at_char(&src[error.position], '{');
-    }
+static void rviCredCacheUnlink( TRviContext *ctx, TRviCredCacheEntry *entry )
+{
+    if( entry->prev ) entry->prev->next = entry->next;
+    else ctx->credLruHead = entry->next;
+    if( entry->next ) entry->next->prev = entry->prev;
+    else ctx->credLruTail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
 
-    free(remote->buf);
+static void rviCredCachePush( TRviContext *ctx, TRviCredCacheEntry *entry )
+{
+    entry->prev = NULL;
+    entry->next = ctx->credLruHead;
+    if( ctx->credLruHead ) ctx->credLruHead->prev = entry;
+    else ctx->credLruTail = entry;
+    ctx->credLruHead = entry;
+}
 
-    if (!tmp) {
-        remote->buf = NULL;
-        remote->buflen = 0;
-        ret = RVI_ERR_JSON;
-    } else {
-        len = strlen(tmp);
-        remote->buf = malloc(len + 1);
-        if (!(remote->buf)) { ret = -ENOMEM; goto exit; }
-        memset(remote->buf, 0, len + 1);
-        memcpy(remote->buf, tmp, len);
-        remote->buflen = len;
-        ret = RVI_ERR_JSON_PART;
+static void rviCredCacheRemove( TRviContext *ctx, TRviCredCacheEntry *entry )
+{
+    rviCredCacheUnlink( ctx, entry );
+    rviHashRemove( &ctx->credCache, entry->digest );
+    rviRightsDestroy( entry->rights );
+    free( entry );
+}
+
+/** 
+ * Compute the cache key for a credential presented by the peer with the given
+ * certificate. The certificate is part of the key because a credential is
+ * only valid for the device whose certificate it embeds.
+ */
+int rviCredCacheKey( const char *cred, X509 *cert, unsigned char *digest )
+{
+    if( !cred || !cert || !digest ) { return EINVAL; }
+
+    unsigned char   md[EVP_MAX_MD_SIZE];
+    unsigned int    mdlen;
+    EVP_MD_CTX      *sha;
+    int             ret     = RVI_OK;
+
+    if( X509_digest( cert, EVP_sha256(), md, &mdlen ) != 1 ) {
+        return RVI_ERR_OPENSSL;
     }
 
-    free(src);
+    /* The names OpenSSL has had since 0.9.7, still defined by later versions */
+    sha = EVP_MD_CTX_create();
+    if( !sha ) { return ENOMEM; }
+    if( EVP_DigestInit_ex( sha, EVP_sha256(), NULL ) != 1 ||
+        EVP_DigestUpdate( sha, cred, strlen( cred ) ) != 1 ||
+        EVP_DigestUpdate( sha, md, mdlen ) != 1 ||
+        EVP_DigestFinal_ex( sha, digest, NULL ) != 1 ) {
+        ret = RVI_ERR_OPENSSL;
+    }
+    EVP_MD_CTX_destroy( sha );
 
-exit:
     return ret;
 }
 
-/** This utility function returns a pointer to a new json_t populated with the
- * contents of the value associated with the key "grant" */
-json_t *rviGetJsonGrant ( jwt_t *jwt, const char *grant )
+/** 
+ * Look up a previously verified credential. Returns the cached rights, or NULL
+ * if the credential is not cached or has expired, in which case it must be
+ * verified again.
+ */
+TRviRights *rviCredCacheLookup( TRviHandle handle, 
+                                const unsigned char *digest )
 {
-    if( !jwt || !grant || !strlen(grant) ) { return NULL; }
-
-    /* get token in plaintext */
-    char *plaintext = jwt_dump_str( jwt, 0 );
+    if( !handle || !digest ) { return NULL; }
 
-    /* store pointer to free memory */
-    char *start = plaintext;
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviCredCacheEntry  *entry;
 
-    /* advance past header */
-    while( *plaintext++ != '.');
+    entry = rviHashFind( &ctx->credCache, digest );
+    if( !entry ) { return NULL; }
 
-    json_t *body = json_loads( plaintext, JSON_REJECT_DUPLICATES, NULL );
+    if( entry->rights->expiration < time( NULL ) ) {
+        rviCredCacheRemove( ctx, entry );
+        return NULL;
+    }
 
-    free( start );
+    /* Move the entry to the front of the LRU list */
+    rviCredCacheUnlink( ctx, entry );
+    rviCredCachePush( ctx, entry );
 
-    json_t *claim = json_object_get( body, grant );
+    return entry->rights;
+}
 
-    json_t *new = json_deep_copy( claim );
+/** 
+ * Remember the rights granted by a credential that has just been verified.
+ * If the cache is full, the least recently used entry is evicted.
+ */
+int rviCredCacheInsert( TRviHandle handle, const unsigned char *digest,
+                        TRviRights *rights )
+{
+    if( !handle || !digest || !rights ) { return EINVAL; }
 
-    json_decref( body );
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviCredCacheEntry  *entry;
+    int                 ret;
 
-    return new;
-}
+    if( RVI_CRED_CACHE_SIZE == 0 ) { return RVI_OK; }
 
-/** Get arrays of rightToReceive and rightToInvoke */
-int rviGetRightsFromCredential( TRviHandle handle, const char *cred, 
-                           TRviList *rights )
-{
-    if( !handle || !cred ||  !rights ) { return EINVAL; }
+    /* The same credential may be presented more than once */
+    if( rviHashFind( &ctx->credCache, digest ) ) { return RVI_OK; }
 
-    TRviContext     *ctx = (TRviContext *)handle;
-    jwt_t           *jwt;
-    char            *key;
-    int             ret;
-    time_t          rawtime;
+    while( rviHashGetCount( &ctx->credCache ) >= RVI_CRED_CACHE_SIZE ) {
+        rviCredCacheRemove( ctx, ctx->credLruTail );
+    }
 
-    key = rviGetPubkeyFile( ctx->cafile );
-    if( !key  ){ ret = -1; goto exit; }
+    entry = malloc( sizeof( TRviCredCacheEntry ) );
+    if( !entry ) { return ENOMEM; }
+    memcpy( entry->digest, digest, SHA256_DIGEST_LENGTH );
+    entry->rights = rviRightsClone( rights );
+    if( !entry->rights ) { free( entry ); return ENOMEM; }
+
+    ret = rviHashInsert( &ctx->credCache, entry->digest, entry );
+    if( ret != 0 ) {
+        rviRightsDestroy( entry->rights );
+        free( entry );
+        return ret;
+    }
+    rviCredCachePush( ctx, entry );
 
-    /* Load the JWT into memory from base64-encoded string */
-    ret = jwt_decode(&jwt, cred, (unsigned char *)key, strlen(key));
-    if( ret != 0 ) { goto exit; }
+    return RVI_OK;
+}
 
-    /* Check that we are using public/private key cryptography */
-    if( jwt_get_alg( jwt ) != JWT_ALG_RS256 ) { ret = 1; goto exit; }
-    
-    /* Check validity: start/stop */
-    time(&rawtime);
-    json_t *validity = rviGetJsonGrant( jwt, "validity" );
+/** Forget all verified credentials, e.g., when the trust store changes */
+void rviCredCacheClear( TRviHandle handle )
+{
+    if( !handle ) { return; }
 
-    int start = json_integer_value( json_object_get( validity, "start" ) );
-    int stop = json_integer_value( json_object_get( validity, "stop" ) );
+    TRviContext *ctx = (TRviContext *)handle;
 
-    if( ( start > rawtime ) || ( stop < rawtime ) ) { ret = -1; goto exit; }
-    
-    /* Load the rights to receive */
-    json_t *receive = rviGetJsonGrant( jwt, "right_to_receive" );
-    char *rcv = json_dumps(receive, JSON_ENCODE_ANY);
-    json_decref(receive);
-    /* Load the right to invoke */
-    json_t *invoke = rviGetJsonGrant(jwt, "right_to_invoke" );
-    char *inv = json_dumps(invoke, JSON_ENCODE_ANY);
-    json_decref(invoke);
-
-    TRviRights *new = rviRightsCreate( rcv, inv, stop );
-
-    rviListInsert( rights, new );
- 
-    free( rcv );
+    while( ctx->credLruHead ) {
+        rviCredCacheRemove( ctx, ctx->credLruHead );
+    }
+}
 
-    free( inv );
+void rviRightsIndexInitialize( TRviRightsIndex *index, TRviList *list )
+{
+    rviTrieInitialize( &index->receive );
+    rviTrieInitialize( &index->invoke );
+    index->list = list;
+    index->expiration = LONG_MAX;
+    /* Unused authorization cache entries have generation 0 */
+    index->generation = 1;
+}
 
-exit:
-    free(key);
-    jwt_free(jwt);
-    if ( validity ) json_decref( validity );
+void rviRightsIndexFree( TRviRightsIndex *index )
+{
+    rviTrieFree( &index->receive );
+    rviTrieFree( &index->invoke );
+}
 
-    return ret;
+/* Empty the index when its rights have been replaced by a new list */
+void rviRightsIndexReset( TRviRightsIndex *index, TRviList *list )
+{
+    rviRightsIndexFree( index );
+    index->list = list;
+    index->expiration = LONG_MAX;
+    index->generation++;
 }
 
-int rviRightToReceiveError( TRviList *rlist, const char *serviceName )
+/* 
+ * Remove expired rights from the list and rebuild the index if any have
+ * expired. This is a single comparison unless the earliest expiration has
+ * passed. The index changes, so the registry lock must be held for writing.
+ */
+int rviRightsIndexExpire( TRviRightsIndex *index, time_t now )
 {
-    if( !rlist || !serviceName ) { return EINVAL; }
+    if( !index ) { return EINVAL; }
+    if( now <= index->expiration || !index->list ) { return RVI_OK; }
 
-    int     err     = -1; /* By default, assume no rights */
-    json_t  *value  = NULL;
-    size_t  index;
+    int             err = RVI_OK;
+    TRviListEntry   *ptr;
+    TRviRights      *rights;
+
+    rviRightsIndexReset( index, index->list );
 
-    TRviListEntry *ptr = rlist->listHead;
+    ptr = index->list->listHead;
     while( ptr ) {
-        TRviRights *tmp = (TRviRights *)ptr->pointer;
-        if( !tmp ) goto exit;
-        //json_array_foreach( tmp->receive, index, value ) {
-        for( index = 0; 
-             index < json_array_size( tmp->receive ) && ( value = json_array_get( tmp->receive, index ) ); 
-             index ++) {
-            const char *pattern = json_string_value( value );
-            if( ( err = rviComparePattern( pattern, serviceName ) ) == RVI_OK )
-                goto exit; /* We found a match, exit immediately */
-        }
+        rights = (TRviRights *)ptr->pointer;
         ptr = ptr->next;
+        if( rights->expiration < now ) {
+            rviListRemove( index->list, rights );
+            rviRightsDestroy( rights );
+        } else if( ( err = rviRightsIndexAdd( index, rights ) ) ) {
+            break;
+        }
     }
 
-exit:
     return err;
 }
 
-int rviRightToInvokeError( TRviList *rlist, const char *serviceName )
+/* 
+ * Compile the patterns of a rights struct into the index. This is done once
+ * when the rights are loaded, so that each check only walks the service name.
+ */
+int rviRightsIndexAdd( TRviRightsIndex *index, TRviRights *rights )
 {
-    if( !rlist || !serviceName ) { return EINVAL; }
+    if( !index || !rights ) { return EINVAL; }
 
-    int     err     = -1; /* By default, assume no rights */
+    int     err     = RVI_OK;
     json_t  *value  = NULL;
-    size_t  index;
+    size_t  i;
 
-    TRviListEntry *ptr = rlist->listHead;
-    while( ptr ) {
-        TRviRights *tmp = (TRviRights *)ptr->pointer;
-        //json_array_foreach( tmp->invoke, index, value ) {
-        for( index = 0; 
-             index < json_array_size( tmp->invoke ) && ( value = json_array_get( tmp->invoke, index ) ); 
-             index ++) {
-            const char *pattern = json_string_value( value );
-            if( ( err = rviComparePattern( pattern, serviceName ) ) == RVI_OK )
-                goto exit; /* We found a match, exit immediately */
+    if( rights->expiration < index->expiration ) {
+        index->expiration = rights->expiration;
+    }
+    index->generation++;
+
+    for( i = 0; 
+         i < json_array_size( rights->receive ) && ( value = json_array_get( rights->receive, i ) ); 
+         i ++) {
+        if( json_is_string( value ) &&
+            ( err = rviTrieInsert( &index->receive, 
+                                   json_string_value( value ) ) ) ) {
+            return err;
+        }
+    }
+    for( i = 0; 
+         i < json_array_size( rights->invoke ) && ( value = json_array_get( rights->invoke, i ) ); 
+         i ++) {
+        if( json_is_string( value ) &&
+            ( err = rviTrieInsert( &index->invoke, 
+                                   json_string_value( value ) ) ) ) {
+            return err;
         }
-        ptr = ptr->next;
     }
 
-exit:
-    return err;
+    return RVI_OK;
+}
+
+/*
+ * Check a service name against the rights in an index. The index is only
+ * read, so checks may run with the registry lock held for reading. Expired
+ * rights are dropped beforehand, see rviRightsExpireDue(); if some have 
+ * expired since, the index may still hold them, and no rights are assumed
+ * until it has been rebuilt.
+ */
+int rviRightToReceiveError( TRviRightsIndex *index, const char *serviceName )
+{
+    if( !index || !serviceName ) { return EINVAL; }
+
+    if( time( NULL ) > index->expiration ) { return -1; }
+
+    /* By default, assume no rights */
+    return rviTrieMatch( &index->receive, serviceName ) ? RVI_OK : -1;
+}
+
+int rviRightToInvokeError( TRviRightsIndex *index, const char *serviceName )
+{
+    if( !index || !serviceName ) { return EINVAL; }
+
+    if( time( NULL ) > index->expiration ) { return -1; }
+
+    /* By default, assume no rights */
+    return rviTrieMatch( &index->invoke, serviceName ) ? RVI_OK : -1;
+}
+
+/*
+ * Drop the expired rights of this node, and of a remote if one is given,
+ * before checking rights with the registry lock held for reading or not at
+ * all. The lock is only taken, for writing, when some rights have expired,
+ * so it must not be held by the caller.
+ */
+static void rviRightsExpireDue( TRviHandle handle, TRviRemote *remote )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    time_t          now     = time( NULL );
+
+    if( now <= ctx->rightsIdx.expiration &&
+        ( !remote || now <= remote->rightsIdx.expiration ) ) {
+        return;
+    }
 
+    rviRegistryWrite( ctx );
+    rviRightsIndexExpire( &ctx->rightsIdx, now );
+    if( remote ) { rviRightsIndexExpire( &remote->rightsIdx, now ); }
+    rviRegistryUnlock( ctx );
 }
 
-/** Get the public key from a certificate file */
-char *rviGetPubkeyFile( char *filename )
+/** 
+ * Load the CA certificate from the configured cafile and cache it, together
+ * with its public key as a PEM string, in the RVI context. The cached copies
+ * are only replaced if the new certificate loads successfully.
+ */
+int rviLoadCaKey( TRviHandle handle )
 {
-    if( !filename ) { return NULL; }
+    if( !handle ) { return EINVAL; }
 
+    TRviContext *ctx        = (TRviContext *)handle;
     EVP_PKEY    *pkey       = NULL;
     BIO         *certbio    = NULL;
     BIO         *mbio       = NULL;
@@ -844,9 +2455,11 @@ char *rviGetPubkeyFile( char *filename )
     int         ret = RVI_OK;
     int         ok = 0; /* Status for OpenSSL calls */
 
+    if( !ctx->cafile ) { return RVI_ERR_NOCONFIG; }
+
     /* Get public key from root certificate */
     /* First, load PEM string into memory */
-    certbio = BIO_new_file( filename, "r" );
+    certbio = BIO_new_file( ctx->cafile, "r" );
     if( !certbio ) { ret = ENOMEM; goto exit; }
     /* Then read the certificate from the string */
     cert = PEM_read_bio_X509( certbio, NULL, 0, NULL );
@@ -868,68 +2481,138 @@ char *rviGetPubkeyFile( char *filename )
     if( !key ) { ret = ENOMEM; goto exit; }
     /* Load the string into memory */
     ret = BIO_read(mbio, key, length);
-    if(verbose){
-        fprintf(stderr, "rviGetPubkeyFile, received %d bytes, : '%s'\n", ret, key);
-    }
-    if( ret != length) { goto exit; }
+    if( ret != length) { ret = RVI_ERR_OPENSSL; goto exit; }
     /* Make sure it's null-formatted, just in case */
     key[length] = '\0';
+    if(verbose){
+        fprintf(stderr, "rviLoadCaKey, received %ld bytes, : '%s'\n", 
+                length, key);
+    }
+
+    /* Swap in the new certificate and key */
+    X509_free( ctx->caCert );
+    free( ctx->caKey );
+    ctx->caCert = cert;
+    ctx->caKey = key;
+    cert = NULL;
+    key = NULL;
 
     ret = RVI_OK;
 
 exit:
     /* Free all the memory */
+    free(key);
     EVP_PKEY_free(pkey);
     X509_free(cert);
     BIO_free_all(certbio);
     BIO_free_all(mbio);
 
-    if( ret != RVI_OK ) { return NULL; }
-    return key;
+    return ret;
+}
+
+/*
+ * Reload the CA certificate and trusted certificate store after the files
+ * have been replaced.
+ */
+int rviReloadTrustStore( TRviHandle handle )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext *ctx    = (TRviContext *)handle;
+    X509_STORE  *store  = NULL;
+    int         ret;
+
+    if( !ctx->sslCtx ) { return EINVAL; }
+    /* The workers verify credentials against the CA key being replaced */
+    if( ctx->workerCount ) { return EBUSY; }
+
+    /* Build the new store first, so a failure leaves the old one in place */
+    store = X509_STORE_new();
+    if( !store ) { return ENOMEM; }
+    if( X509_STORE_load_locations( store, ctx->cafile, ctx->cadir ) != 1 ||
+        X509_STORE_set_default_paths( store ) != 1 ) {
+        X509_STORE_free( store );
+        return RVI_ERR_OPENSSL;
+    }
+
+    ret = rviLoadCaKey( handle );
+    if( ret != RVI_OK ) {
+        X509_STORE_free( store );
+        return ret;
+    }
+
+    /* The SSL context takes ownership of the store and frees the old one.
+     * Connections that are already established are not affected. */
+    SSL_CTX_set_cert_store( ctx->sslCtx, store );
+
+    /* Credentials verified against the old CA must be checked again */
+    rviCredCacheClear( handle );
+    ctx->credGen++;
+
+    return RVI_OK;
+}
+
+/**
+ * Decode an RVI credential against the CA key of the context, see 
+ * rviDecodeCredentialKey().
+ */
+int rviDecodeCredential( TRviHandle handle, const char *cred, X509 *cert,
+                         TRviRights **rights )
+{
+    if( !handle || !cred || !cert ) { return EINVAL; }
+
+    TRviContext     *ctx = (TRviContext *)handle;
+
+    return rviDecodeCredentialKey( ctx->caKey, cred, cert, rights );
 }
 
 /** 
- * This function tests whether a credential is valid.
+ * This function decodes an RVI credential, tests whether it is valid, and
+ * extracts the rights it grants. The JWT is decoded and its signature checked
+ * once, and all claims are read from a single parse of its body.
  *
  * Tests:
  *  * Signed by trusted authority
  *  * Timestamp is valid
  *  * Embedded device cert matches supplied cert
  *
- * @param[in] handle    - handle to the RVI context
+ * It uses nothing from the context, so the verifier threads may call it
+ * while the trust store is reloaded.
+ *
+ * @param[in] caKey     - public key of the trusted CA, as a PEM string
  * @param[in] cred      - JWT-encoded RVI credential
  * @param[in] cert      - the expected certificate for the device, e.g., peer certificate
+ * @param[out] rights   - if not NULL, set to a new rights structure built from
+ *                        the credential on success
  *
  * @return RVI_OK (0) on success, or an error code on failure.
  */
-int rviValidateCredential( TRviHandle handle, const char *cred, X509 *cert )
+int rviDecodeCredentialKey( const char *caKey, const char *cred, X509 *cert,
+                            TRviRights **rights )
 {
-    if( !handle || !cred ) { return EINVAL; }
+    if( !cred || !cert ) { return EINVAL; }
 
     int             ret;
-    TRviContext     *ctx = (TRviContext *)handle;
-    char            *key;
-    jwt_t           *jwt;
-    long            length;
+    jwt_t           *jwt = NULL;
     time_t          rawtime;
     BIO             *bio = {0};
     X509            *dcert = {0};
     const char      certHead[] = "-----BEGIN CERTIFICATE-----\n";
     const char      certFoot[] = "\n-----END CERTIFICATE-----";
-    json_t          *validity = NULL;
+    char            *plaintext = NULL;
+    char            *claims;
+    json_t          *body = NULL;
+    json_t          *validity;
     char            *tmp = NULL;
 
     ret = RVI_OK;
+    if( rights ) { *rights = NULL; }
 
-    /* Get the public key from the trusted CA */
-    key = rviGetPubkeyFile( ctx->cafile );
-
-    if( !key ) { ret = -1; goto exit; }
-
-    length = strlen(key) + 1;
+    /* Use the public key from the trusted CA */
+    if( !caKey ) { ret = -1; goto exit; }
 
     /* If token does not pass sig check, libjwt supplies errno */
-    ret = jwt_decode( &jwt, cred, (unsigned char *)key, length );
+    ret = jwt_decode( &jwt, cred, (unsigned char *)caKey, strlen( caKey ) );
     if( ret ) {
         goto exit;
     }
@@ -937,16 +2620,26 @@ int rviValidateCredential( TRviHandle handle, const char *cred, X509 *cert )
     /* RVI credentials use RS256 */
     if( jwt_get_alg( jwt ) != JWT_ALG_RS256 ) { ret = 1; goto exit; }
 
+    /* Parse the claims once. The plaintext token is "header.body" */
+    plaintext = jwt_dump_str( jwt, 0 );
+    if( !plaintext ) { ret = ENOMEM; goto exit; }
+    claims = strchr( plaintext, '.' );
+    if( !claims ) { ret = RVI_ERR_JSON; goto exit; }
+    body = json_loads( claims + 1, JSON_REJECT_DUPLICATES, NULL );
+    if( !body ) { ret = RVI_ERR_JSON; goto exit; }
+
     /* Check validity: start/stop */
     time(&rawtime);
-    validity = rviGetJsonGrant( jwt, "validity" );
+    validity = json_object_get( body, "validity" );
 
-    int start = json_integer_value( json_object_get( validity, "start" ) );
-    int stop = json_integer_value( json_object_get( validity, "stop" ) );
+    json_int_t start = json_integer_value( json_object_get( validity, "start" ) );
+    json_int_t stop = json_integer_value( json_object_get( validity, "stop" ) );
 
     if( ( start > rawtime ) || ( stop < rawtime ) ) { ret = -1; goto exit; }
 
-    const char *deviceCert = jwt_get_grant( jwt, "device_cert" );
+    const char *deviceCert = json_string_value( 
+                                json_object_get( body, "device_cert" ) );
+    if( !deviceCert ) { ret = RVI_ERR_JSON; goto exit; }
     tmp = malloc( strlen( deviceCert ) + strlen( certHead ) 
                         + strlen ( certFoot ) + 1 );
     if( !tmp ) { ret = ENOMEM; goto exit; }
@@ -956,17 +2649,26 @@ int rviValidateCredential( TRviHandle handle, const char *cred, X509 *cert )
     bio = BIO_new( BIO_s_mem() );
 
     if(verbose){
-        fprintf(stderr, "rviValidateCredential, sending: '%s'\n", tmp);
+        fprintf(stderr, "rviDecodeCredentialKey, sending: '%s'\n", tmp);
     }
     BIO_puts( bio, (const char *)tmp );
     dcert = PEM_read_bio_X509( bio, NULL, 0, NULL );
     if( !dcert ) { ret = RVI_ERR_OPENSSL; goto exit; }
     ret = X509_cmp( dcert, cert );
+    if( ret ) { goto exit; }
+
+    /* Build the rights directly from the parsed arrays */
+    if( rights ) {
+        *rights = rviRightsCreate( json_object_get( body, "right_to_receive" ),
+                                   json_object_get( body, "right_to_invoke" ),
+                                   stop );
+        if( !*rights ) { ret = RVI_ERR_JSON; goto exit; }
+    }
 
 exit:
     jwt_free( jwt );
-    if( key ) free( key );
-    if( validity ) json_decref( validity );
+    free( plaintext );
+    json_decref( body );
     if( tmp ) free( tmp );
     BIO_free_all( bio );
     X509_free( dcert );
@@ -983,18 +2685,67 @@ void rviSetVerboseLogs (bool verboseEnable )
     verbose = verboseEnable;
 }
 
+/*
+ * Enables or disables non-blocking I/O for new connections.
+ */
+
+int rviSetNonBlocking ( TRviHandle handle, bool enable )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+
+    /* The I/O workers only serve non-blocking connections */
+    if( !enable && ctx->workerCount ) { return EBUSY; }
+
+    ctx->nonblocking = enable;
+
+    return RVI_OK;
+}
+
 
 /*
- * Initialize the RVI library. Call before using any other functions.
+ * Selects how the parameters passed to rviInvokeService() are checked
  */
 
+int rviSetValidation ( TRviHandle handle, ERviValidation mode )
+{
+    if( !handle || mode < RVI_VALIDATE_NONE || mode > RVI_VALIDATE_FULL ) { 
+        return EINVAL; 
+    }
 
-TRviHandle rviInitInternal (json_t *configContent )
+    TRviContext *ctx = (TRviContext *)handle;
+
+    ctx->validation = mode;
+
+    return RVI_OK;
+}
+
+int rviSetWireEncoding ( TRviHandle handle, ERviEncoding encoding )
 {
-    if( !configContent ) { return NULL; }
-    /* initialize OpenSSL */
-    SSL_library_init();
-    SSL_load_error_strings();
+    if( !handle || encoding < RVI_ENCODING_JSON || 
+        encoding > RVI_ENCODING_MSGPACK ) { 
+        return EINVAL; 
+    }
+
+    TRviContext *ctx = (TRviContext *)handle;
+
+    ctx->encoding = encoding;
+
+    return RVI_OK;
+}
+
+
+/*
+ * Initialize the RVI library. Call before using any other functions.
+ */
+
+
+TRviHandle rviInitInternal (json_t *configContent )
+{
+    if( !configContent ) { return NULL; }
+    /* initialize OpenSSL and jansson's allocator, once per process */
+    pthread_once( &rviInitOnce, rviInitProcess );
     
     /* Allocate memory for an RVI context structure. 
      * This structure contains:
@@ -1008,6 +2759,20 @@ TRviHandle rviInitInternal (json_t *configContent )
         return NULL;
     }
     ctx = memset ( ctx, 0, sizeof ( TRviContext ) );
+    ctx->btreeOrder = 2;
+    ctx->validation = RVI_VALIDATE_STRUCTURE;
+    ctx->invokeTimeout = RVI_INVOKE_TIMEOUT_MS;
+    ctx->reconnectMin = RVI_RECONNECT_MIN_MS;
+    ctx->reconnectMax = RVI_RECONNECT_MAX_MS;
+    rviBufferInitialize( &ctx->obuf );
+    pthread_rwlock_init( &ctx->registryLock, NULL );
+    pthread_mutex_init( &ctx->callLock, NULL );
+    pthread_mutex_init( &ctx->credLock, NULL );
+    pthread_mutex_init( &ctx->verifyLock, NULL );
+    pthread_cond_init( &ctx->verifyCond, NULL );
+    pthread_mutex_lock( &rviPoolLock );
+    rviContexts++;
+    pthread_mutex_unlock( &rviPoolLock );
 
     /* Allocate a block of memory for storing credentials, then initialize each 
      * pointer to null */
@@ -1021,6 +2786,8 @@ TRviHandle rviInitInternal (json_t *configContent )
 
     rviListInitialize( ctx->creds );
     rviListInitialize( ctx->rights );
+    rviRightsIndexInitialize( &ctx->rightsIdx, ctx->rights );
+    rviHashInitialize( &ctx->credCache, rviCredCacheHash, rviCredCacheEqual );
 
     if ( rviParseJsonConfig ( ctx, configContent ) != 0 ) {
         fprintf(stderr, "Error reading config file\n");
@@ -1032,14 +2799,6 @@ TRviHandle rviInitInternal (json_t *configContent )
         goto err;
     }
 
-    TRviListEntry *ptr = ctx->creds->listHead;
-    while( ptr ) {
-        int ret = rviGetRightsFromCredential( ctx, (char *)ptr->pointer, 
-                                         ctx->rights );
-        if( ret != RVI_OK ) { goto err; }
-        ptr = ptr->next;
-    }
-
     if ( !(ctx->rights->count) ) {
         fprintf(stderr, "Error: no rights available\n");
         goto err;
@@ -1052,32 +2811,43 @@ TRviHandle rviInitInternal (json_t *configContent )
         goto err;
     }
 
+    /*   
+     * Services are looked up by the fully-qualified service name, which is
+     * unique across the RVI infrastructure. Remote connections are indexed
+     * by the socket's file descriptor, in ctx->remotes, which grows as 
+     * connections are made.
+     */  
+    rviHashInitialize( &ctx->serviceHash, rviHashString, rviHashStringEqual );
+    rviHashInitialize( &ctx->hostIdx, rviHashString, rviHashStringEqual );
+    rviHashInitialize( &ctx->pendingAnnounce, rviHashString, 
+                       rviHashStringEqual );
+    rviHashInitialize( &ctx->pendingCalls, rviCallHash, rviCallEqual );
+    ctx->nextTid = 1;
+    ctx->wheelTick = rviNowMs() / RVI_WHEEL_TICK_MS;
+
     /*  
-     * Create empty btrees for indexing remote connections and services. 
+     * Create empty btrees for iterating over services in order. 
      * 
-     * Since we expect that records will frequently be added and removed, use a 
-     * small order for each tree. This means that the tree will be deeper, but 
-     * addition/deletion will usually result in simply changing pointers rather 
-     * than copying data. 
+     * Since we expect that records will frequently be added and removed, the 
+     * default is a small order for each tree. This means that the tree will 
+     * be deeper, but addition/deletion will usually result in simply changing 
+     * pointers rather than copying data. Nodes with large numbers of services
+     * may set a larger "btree_order" for shallower trees and faster lookups.
      */
-    
-    /*   
-     * Remote connections will be indexed by the socket's file descriptor.    
-     */  
-    ctx->remoteIdx = btree_create(2, rviCompareFd);
+    ctx->serviceNameIdx = btree_create(ctx->btreeOrder, rviCompareName);
 
-    /*   
-     * Services will be indexed by the fully-qualified service name, which is
-     * unique across the RVI infrastructure. 
-     */  
-    ctx->serviceNameIdx = btree_create(2, rviCompareName);
+    /* Set up the built-in event loop, including its epoll instance */
+    if( rviReactorInitialize( ctx, &ctx->loop, false, 
+                              (uint32_t)( rviNowMs() ^ ( getpid() << 16 ) ) ) ) {
+        fprintf(stderr, "Error creating event loop\n");
+        goto err;
+    }
 
-    /*
-     * Services will also be indexed by the file descriptor of the entity 
-     * registering the service. Service names are used as a tie-breaker to 
-     * ensure each record has a unique position in the tree. 
-     */
-    ctx->serviceRegIdx = btree_create(2, rviCompareRegistrant);
+    if( ctx->verifyThreads && 
+        rviSetVerifyThreads( ctx, ctx->verifyThreads ) != RVI_OK ) {
+        fprintf(stderr, "Error starting verifier threads\n");
+        goto err;
+    }
     
     return (TRviHandle)ctx;
 
@@ -1139,6 +2909,10 @@ int rviCleanup(TRviHandle handle)
     TRviContext * ctx = (TRviContext *)handle;
     TRviRemote *  rtmp;
     TRviService * stmp;
+    int           i;
+
+    /* Bring the connections back to the built-in loop, to be closed below */
+    rviStopWorkers( handle );
 
     /* free all SSL structs */
     SSL_CTX_free(ctx->sslCtx);
@@ -1148,53 +2922,38 @@ int rviCleanup(TRviHandle handle)
      */
     
     /*  
-     * As long as the context contains remote connections, find the first 
-     * struct in the tree, and disconnect the corresponding file descriptor. 
-     * The disconnect function removes the entry from the tree and frees the 
-     * underlying memory. 
+     * Disconnect each remote connection. The disconnect function removes the
+     * entry from the index and frees the underlying memory. 
      */
-
-    if(ctx->remoteIdx) {
-        while(ctx->remoteIdx->count != 0) {
-            rtmp = (TRviRemote *)ctx->remoteIdx->root->dataRecords[0];
-            if(!rtmp) {
-                perror("Getting remote data in cleanup"); 
-                break;
-            }
+    for( i = 0; i < ctx->remotesSize; i++ ) {
+        if( ( rtmp = ctx->remotes[i] ) ) {
             /* Disconnect the remote SSL connection, delete the entry from the 
-            * tree & free the remote struct */
+            * index & free the remote struct */
             rviDisconnect(handle, rtmp->fd);
         }
-        btree_destroy(ctx->remoteIdx);
     }
+    free(ctx->remotes);
+    rviHashFree( &ctx->hostIdx );
+
+    /* The checks still queued were given up by the remotes just closed */
+    rviVerifyStop( handle );
+
+    rviReactorFree( handle, &ctx->loop );
 
     /* 
-     * As long as the context contains services, find the first struct from 
-     * either service tree. Delete the entry from each service tree, then free 
-     * the underlying memory. 
+     * Free every service, then the indexes that refer to them. Destroying the
+     * btrees only frees their nodes. 
      */
     if(ctx->serviceNameIdx) {
-        while(ctx->serviceNameIdx->count != 0) {
-            /* Delete the first data record in the root node */
-            stmp = (TRviService *)ctx->serviceNameIdx->root->dataRecords[0];
-            if ( !stmp ) {
-                perror("Getting service data in cleanup"); 
-                break;
-            }
-            /* Delete the entry from the service name index */
-            btree_delete ( ctx->serviceNameIdx, 
-                           ctx->serviceNameIdx->root, stmp);
-            /* Delete the entry from the service registrant index */
-            btree_delete ( ctx->serviceRegIdx, 
-                           ctx->serviceRegIdx->root, stmp);
+        size_t index = 0;
+        while( ( stmp = rviHashNext( &ctx->serviceHash, &index ) ) ) {
             /* Free the service memory */
             rviServiceDestroy ( stmp );
         }
+        rviHashFree( &ctx->serviceHash );
 
-        /* Destroy both service trees */
+        /* Destroy the service tree */
         btree_destroy(ctx->serviceNameIdx);
-
-        btree_destroy(ctx->serviceRegIdx);
     }
 
     /* Free all credentials and other entities set when parsing config */
@@ -1206,6 +2965,9 @@ int rviCleanup(TRviHandle handle)
         free ( ctx->keyfile );
     if( ctx->cafile )
         free ( ctx->cafile );
+    X509_free( ctx->caCert );
+    if( ctx->caKey )
+        free ( ctx->caKey );
     if( ctx->cadir )
         free ( ctx->cadir );
     if( ctx->creddir )
@@ -1214,6 +2976,41 @@ int rviCleanup(TRviHandle handle)
         free ( ctx->id );
 
     rviRightsListDestroy( ctx->rights );
+    rviRightsIndexFree( &ctx->rightsIdx );
+
+    rviCredCacheClear( ctx );
+    rviHashFree( &ctx->credCache );
+
+    /* Every pending call belonged to a remote disconnected above */
+    rviHashFree( &ctx->pendingCalls );
+
+    if( ctx->pendingAnnounce.hashFn ) {
+        TRviPendingAnnounce *pending;
+        size_t index = 0;
+        while( ( pending = rviHashNext( &ctx->pendingAnnounce, &index ) ) ) {
+            free( pending->name );
+            free( pending );
+        }
+        rviHashFree( &ctx->pendingAnnounce );
+    }
+
+    rviBufferFree( &ctx->obuf );
+
+    pthread_rwlock_destroy( &ctx->registryLock );
+    pthread_mutex_destroy( &ctx->callLock );
+    pthread_mutex_destroy( &ctx->credLock );
+    pthread_mutex_destroy( &ctx->verifyLock );
+    pthread_cond_destroy( &ctx->verifyCond );
+
+    /* The last context returns the pooled structures to the system */
+    pthread_mutex_lock( &rviPoolLock );
+    if( --rviContexts == 0 ) {
+        rviPoolFree( &rviServicePool );
+        rviPoolFree( &rviRemotePool );
+        rviPoolFree( &rviRightsPool );
+        rviPoolFree( &rviCallPool );
+    }
+    pthread_mutex_unlock( &rviPoolLock );
 
     /* Free the memory allocated to the TRviContext struct */
     memset( ctx, 0, sizeof( TRviContext ) );
@@ -1238,10 +3035,26 @@ int rviConnect(TRviHandle handle, const char *addr, const char *port)
     SSL             *ssl    = NULL;
     TRviRemote    *remote = NULL;
     TRviContext   *ctx    = (TRviContext *)handle;
+    TRviReactor   *reactor;
+    char          *key    = NULL;
+    long long     start   = rviNowNs();
+    long long     elapsed;
+    int fd;
     int ret;
 
     ret = RVI_OK;
 
+    /* Check if we're already connected to that host, before any set up */
+    key = rviHostKey( addr, port );
+    if( !key ) { return -ENOMEM; }
+    rviRegistryRead( ctx );
+    ret = rviHashFind( &ctx->hostIdx, key ) ? -1 : RVI_OK;
+    rviRegistryUnlock( ctx );
+    if( ret != RVI_OK ) {
+        free( key );
+        return ret;
+    }
+
     /* 
      * Spawn new SSL session from handle->ctx. BIO_new_ssl_connect spawns a new
      * chain including a SSL BIO (using ctx) and a connect BIO
@@ -1257,12 +3070,23 @@ int rviConnect(TRviHandle handle, const char *addr, const char *port)
         goto err;
     }
 
-    /* 
-     * When performing I/O, automatically retry all reads and complete
-     * negotiations before returning. Note that all BIOs have their I/O flag
-     * set to blocking by default. 
-     */
-    SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
+    if( ctx->nonblocking ) {
+        /* 
+         * Put the connect BIO in non-blocking mode. Writes may complete
+         * partially and be retried from the remote's output buffer, which
+         * may move between attempts.
+         */
+        BIO_set_nbio(sbio, 1);
+        SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | 
+                          SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    } else {
+        /* 
+         * When performing I/O, automatically retry all reads and complete
+         * negotiations before returning. Note that all BIOs have their I/O
+         * flag set to blocking by default. 
+         */
+        SSL_set_mode(ssl, SSL_MODE_AUTO_RETRY);
+    }
 
     /* 
      * Set the addr and port 
@@ -1270,56 +3094,146 @@ int rviConnect(TRviHandle handle, const char *addr, const char *port)
     BIO_set_conn_hostname(sbio, addr);
     BIO_set_conn_port(sbio, port);
 
-    /* check if we're already connected to that host... */
-    if( ctx->remoteIdx->count ) {
-        btree_iter iter = btree_iter_begin( ctx->remoteIdx );
-        while( !btree_iter_at_end( iter ) ) {
-            TRviRemote *rtmp = btree_iter_data( iter );
-            if( 0 == strcmp( BIO_get_conn_hostname ( sbio ), 
-                             BIO_get_conn_hostname( rtmp->sbio )
-                           )  
-              ) { /* We already have a connection to that host */
+    if( ctx->nonblocking ) {
+        /* 
+         * Start the connection. This resolves the address and creates the
+         * socket, but will usually return before the TCP connection is 
+         * established. The remaining handshake is driven by rviProcessInput
+         */
+        if( BIO_do_connect(sbio) <= 0 && !BIO_should_retry(sbio) ) {
+            ret = -RVI_ERR_OPENSSL;
+            goto err;
+        }
+        if( SSL_get_fd( ssl ) < 0 ) {
+            ret = -RVI_ERR_OPENSSL;
+            goto err;
+        }
+
+        remote = rviRemoteCreate ( sbio, SSL_get_fd ( ssl ) );
+        if( !remote ) { ret = -ENOMEM; goto err; }
+        sbio = NULL; /* Now owned by the remote */
+        remote->nonblocking = true;
+        remote->connectNs = start;
+        remote->hostKey = key;
+        key = NULL;
+        remote->reactor = reactor = rviReactorPick( handle );
+
+        rviRegistryWrite( ctx );
+        ret = rviRemoteIndexInsert( handle, remote );
+        if( ret == RVI_OK && ctx->workerCount ) {
+            /* Another thread may be connecting to the same host */
+            if( rviHashFind( &ctx->hostIdx, remote->hostKey ) ) {
+                rviRemoteIndexRemove( handle, remote );
                 ret = -1;
-                break;
+            } else {
+                rviHashInsert( &ctx->hostIdx, remote->hostKey, remote );
             }
-            btree_iter_next( iter );
         }
-        btree_iter_cleanup( iter );
-    }
-    if( ret != RVI_OK ) goto err;
+        rviRegistryUnlock( ctx );
+        if( ret != RVI_OK ) {
+            ret = ( ret < 0 ) ? ret : -ret;
+            goto err;
+        }
 
-    if(BIO_do_connect(sbio) <= 0) {
-        ret = -RVI_ERR_OPENSSL;
-        goto err;
+        if( ctx->workerCount ) {
+            /* The worker drives the handshake from here on, and may close 
+             * the connection before this returns */
+            fd = remote->fd;
+            __sync_fetch_and_add( &reactor->remoteCount, 1 );
+            pthread_mutex_lock( &reactor->inboxLock );
+            ret = rviListInsert( &reactor->inbox, remote );
+            pthread_mutex_unlock( &reactor->inboxLock );
+            if( ret != RVI_OK ) {
+                __sync_fetch_and_sub( &reactor->remoteCount, 1 );
+                rviRegistryWrite( ctx );
+                rviRemoteIndexRemove( handle, remote );
+                rviHostIndexRemove( handle, remote );
+                rviRegistryUnlock( ctx );
+                ret = -ENOMEM;
+                goto err;
+            }
+            rviReactorNotify( reactor, 0 );
+            return fd;
+        }
+        rviReactorWatch( handle, remote );
+
+        /* Advance as far as possible without blocking */
+        if( ( ret = rviRemoteAdvance( handle, remote ) ) != RVI_OK ) {
+            rviRegistryWrite( ctx );
+            rviRemoteIndexRemove( handle, remote );
+            rviRegistryUnlock( ctx );
+            rviReactorUnwatch( handle, remote );
+            ret = -ret;
+            goto err;
+        }
+
+        rviRegistryWrite( ctx );
+        rviHashInsert( &ctx->hostIdx, remote->hostKey, remote );
+        rviRegistryUnlock( ctx );
+        rviReactorLink( reactor, remote );
+        __sync_fetch_and_add( &reactor->remoteCount, 1 );
+
+        return remote->fd;
     }
 
-    if(BIO_do_handshake(sbio) <= 0) {
+    /* 
+     * Open the TCP connection alone first, so that the remote is attached to
+     * the SSL object before the handshake and keeps the session it yields
+     */
+    if(BIO_do_connect(BIO_next(sbio)) <= 0) {
         ret = -RVI_ERR_OPENSSL;
         goto err;
     }
 
     remote = rviRemoteCreate ( sbio, SSL_get_fd ( ssl ) );
+    if( !remote ) { ret = -ENOMEM; goto err; }
+    sbio = NULL; /* Now owned by the remote */
+    remote->hostKey = key;
+    key = NULL;
+    remote->reactor = reactor = &ctx->loop;
 
-    /* Add this data structure to our lookup tree */
-    btree_insert(ctx->remoteIdx, remote);
+    if(BIO_do_handshake(remote->sbio) <= 0) {
+        ret = -RVI_ERR_OPENSSL;
+        goto err;
+    }
+    elapsed = rviNowNs() - start;
+    rviHistogramAdd( &remote->stats.handshake, elapsed );
+    RVI_PROBE2( handshake__done, remote->fd, elapsed );
+
+    /* Add this data structure to our lookup indexes */
+    rviRegistryWrite( ctx );
+    if( ( ret = rviRemoteIndexInsert( handle, remote ) ) == RVI_OK ) {
+        rviHashInsert( &ctx->hostIdx, remote->hostKey, remote );
+    }
+    rviRegistryUnlock( ctx );
+    if( ret != RVI_OK ) {
+        ret = -ret;
+        goto err;
+    }
+    rviReactorLink( reactor, remote );
+    __sync_fetch_and_add( &reactor->remoteCount, 1 );
+    rviReactorWatch( handle, remote );
     
+    pthread_mutex_lock( &remote->lock );
     rviWriteAu( handle, remote ); 
+    remote->state = RVI_REMOTE_AUTH;
+    pthread_mutex_unlock( &remote->lock );
     
-    /* parse incoming "au" message */
+    /* parse incoming "au" message, which also announces all services */
     rviProcessInput( handle, &remote->fd, 1 );
 
-    /* create JSON array of all services */
-    rviAllServiceAnnounce( handle, remote );
-
-    /* parse incoming "sa" message */
-    rviProcessInput( handle, &remote->fd, 1 );
+    /* parse incoming "sa" message, unless it arrived with the "au" */
+    if( !remote->announced ) {
+        rviProcessInput( handle, &remote->fd, 1 );
+    }
 
     return remote->fd;
 
 err:
     ERR_print_errors_fp( stderr );
+    free( key );
     rviRemoteDestroy( remote );
-    BIO_free( sbio );
+    BIO_free_all( sbio );
 
     return ret;
 }
@@ -1332,317 +3246,2770 @@ int rviDisconnect(TRviHandle handle, int fd)
     if( !handle || fd < 3 ) { return -EINVAL; }
     
     TRviContext * ctx = (TRviContext *)handle;
-    TRviRemote    rkey = {0};
+    TRviReactor * reactor;
     TRviRemote *  rtmp;
-    TRviService   skey = {0};
-    TRviService * stmp;
-    int             res;
-    
-    rkey.fd = fd;
 
-    rtmp = btree_search(ctx->remoteIdx, &rkey);
+    rviRegistryRead( ctx );
+    rtmp = rviRemoteLookup( handle, fd );
+    if( rtmp && ctx->workerCount && rtmp->reactor != rviLoopReactor ) {
+        /* Only the worker serving the connection may close it */
+        pthread_mutex_lock( &rtmp->lock );
+        rviRemoteFlag( rtmp, &rtmp->hangup );
+        pthread_mutex_unlock( &rtmp->lock );
+        rviRegistryUnlock( ctx );
+        return RVI_OK;
+    }
+    rviRegistryUnlock( ctx );
     if(!rtmp) {
         return -ENXIO;
     }
-
-    if( ( res = btree_delete(ctx->remoteIdx, 
-                             ctx->remoteIdx->root, rtmp ) ) < 0 ) {
-        return res;
-    } 
-    /* Search the service tree for any services registered by the remote */
-    skey.registrant = fd;
-    while((stmp = btree_search(ctx->serviceRegIdx, &skey))) {
-        /* We have a match, so delete the service and free the node from
-        * the tree */
-        btree_delete(ctx->serviceNameIdx, ctx->serviceNameIdx->root, stmp);
-        btree_delete(ctx->serviceRegIdx, ctx->serviceRegIdx->root, stmp);
-        /* Close connection & free memory for the service structure */
-        rviServiceDestroy(stmp);
+    reactor = rtmp->reactor;
+
+    /* Once out of the indexes, no other thread can reach the remote */
+    rviRegistryWrite( ctx );
+    rviRemoteIndexRemove( handle, rtmp );
+    rviHostIndexRemove( handle, rtmp );
+    rviRemoveRemoteServices( handle, rtmp );
+    rviStatsMerge( &ctx->closedStats, &rtmp->stats );
+    rviRegistryUnlock( ctx );
+
+    if( rtmp->state == RVI_REMOTE_BACKOFF ) { reactor->reconnecting--; }
+    if( rtmp->lost || rtmp->hangup || rtmp->drained ) { 
+        __sync_fetch_and_sub( &reactor->flagged, 1 ); 
     }
+    rviVerifyCancel( handle, rtmp );
+
+    /* Nothing more will arrive for the calls made on this connection */
+    rviCallsFail( handle, fd, ECONNRESET );
 
-    rviRemoteDestroy( rtmp );
+    rviReactorUnwatch( handle, rtmp );
+    rviReactorUnlink( rtmp );
+    __sync_fetch_and_sub( &reactor->remoteCount, 1 );
+
+    if( reactor->dispatching ) {
+        /* Input is being processed, possibly on this remote, so defer
+         * freeing it until processing is complete */
+        rtmp->closed = true;
+        rviListInsert( reactor->graveyard, rtmp );
+    } else {
+        rviRemoteDestroy( rtmp );
+    }
 
     return RVI_OK;
 }
 
 /*
- * Resume the connection on the specified file descriptor
+ * Free all remotes that were disconnected while an event loop was processing
+ * input.
  */
-int rviResumeConnection(TRviHandle handle, int fd)
+void rviReapRemotes( TRviHandle handle, TRviReactor *reactor )
 {
-    if( !handle || fd < 3 ) { return -EINVAL; }
-    
-    TRviContext     *ctx = (TRviContext *)handle;
-    TRviRemote      rkey = {0};
-    TRviRemote      *rtmp;
-    int             ret = RVI_OK;
-    
-    rkey.fd = fd;
+    TRviListEntry   *ptr    = reactor->graveyard->listHead;
+    TRviListEntry   *tmp;
 
-    rtmp = btree_search(ctx->remoteIdx, &rkey);
-    if(!rtmp) {
-        ret = ENXIO;
-        goto exit;
+    while( ptr ) {
+        tmp = ptr;
+        rviRemoteDestroy( (TRviRemote *)ptr->pointer );
+        ptr = ptr->next;
+        free( tmp );
     }
+    rviListInitialize( reactor->graveyard );
+}
 
-    BIO_reset(rtmp->sbio);
+/* Match the services owned by a remote, for btree_remove_if() */
+static int rviServiceOwnedBy( void *record, void *context )
+{
+    return ( (TRviService *)record )->owner == context;
+}
 
-    if(BIO_do_connect(rtmp->sbio) <= 0) {
-        ret = -RVI_ERR_OPENSSL;
-        goto exit;
-    }
+/*
+ * Remove all services announced by the specified remote node. 
+ *
+ * The remote lists its services, so nothing has to be searched for. When the
+ * remote owns a fair share of all services, deleting them from the name
+ * btree one at a time would rebalance it over and over, so the btree is
+ * rebuilt without them in a single pass instead.
+ */
+void rviRemoveRemoteServices( TRviHandle handle, TRviRemote *remote )
+{
+    TRviContext * ctx = (TRviContext *)handle;
+    TRviService * stmp;
 
-    if(BIO_do_handshake(rtmp->sbio) <= 0) {
-        ret = -RVI_ERR_OPENSSL;
-        goto exit;
+    if( remote->serviceCount >= RVI_BULK_REMOVE_MIN &&
+        remote->serviceCount * 4 >= ctx->serviceNameIdx->count &&
+        btree_remove_if( ctx->serviceNameIdx, rviServiceOwnedBy, remote ) >= 0 ) {
+        while( ( stmp = remote->services ) ) {
+            remote->services = stmp->ownerNext;
+            rviHashRemove( &ctx->serviceHash, stmp->name );
+            rviServiceDestroy( stmp );
+        }
+        remote->serviceCount = 0;
+        return;
     }
 
-exit:
-    return ret;
+    while( ( stmp = remote->services ) ) {
+        /* Delete the service from the indexes, which unlinks it */
+        rviServiceIndexRemove( handle, stmp );
+        /* Free memory for the service structure */
+        rviServiceDestroy( stmp );
+    }
 }
 
-/* 
- * Return all file descriptors in the RVI context
+/*
+ * Resume the connection on the specified file descriptor. This never blocks:
+ * the connection is reopened in the background once its backoff delay has
+ * passed.
  */
-int rviGetConnections(TRviHandle handle, int *conn, int *connSize)
+int rviResumeConnection(TRviHandle handle, int fd)
 {
-    if( !handle || !conn || !connSize ) { return EINVAL; }
-
-    TRviContext *ctx = (TRviContext *)handle;
+    if( !handle || fd < 3 ) { return -EINVAL; }
+    
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *rtmp;
 
-    if( ctx->remoteIdx->count == 0 ) {
-        *connSize = 0;
+    rviRegistryRead( ctx );
+    rtmp = rviRemoteLookup( handle, fd );
+    if( rtmp && ctx->workerCount && rtmp->reactor != rviLoopReactor ) {
+        /* The worker serving the connection reopens it */
+        pthread_mutex_lock( &rtmp->lock );
+        rviRemoteLost( handle, rtmp );
+        pthread_mutex_unlock( &rtmp->lock );
+        rviRegistryUnlock( ctx );
         return RVI_OK;
     }
-    btree_iter iter = btree_iter_begin( ctx->remoteIdx );
-    int i = 0;
-    while( ! btree_iter_at_end( iter ) ) {
-        if( i == *connSize )
-            break;
-        TRviRemote *remote = btree_iter_data( iter );
-        if( ! remote )
-            break;
-        *conn++ = remote->fd ;
-        i++;
-        btree_iter_next( iter );
+    rviRegistryUnlock( ctx );
+    if(!rtmp) {
+        return ENXIO;
+    }
+
+    if( rtmp->state != RVI_REMOTE_BACKOFF ) {
+        rviRemoteBackoff( handle, rtmp );
     }
-    *connSize = i;
-    btree_iter_cleanup( iter );
 
     return RVI_OK;
 }
 
-
-/* ********************** */
-/* RVI SERVICE MANAGEMENT */
-/* ********************** */
-
-
-/* 
- * Register a service with a callback function
+/*
+ * Tear down a lost connection and schedule the attempt to reopen it. 
+ * Everything learned from the old session is discarded; once reconnected,
+ * the "au" and "sa" exchange is replayed. The socket is shut down but kept
+ * open until the attempt, so its descriptor is not handed to another 
+ * connection in the meantime.
  */
-int rviRegisterService( TRviHandle handle, const char *serviceName, 
-                          TRviCallback callback, 
-                          void *serviceData )
+void rviRemoteBackoff( TRviHandle handle, TRviRemote *remote )
 {
-    if( !handle || !serviceName ) { return EINVAL; }
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviReactor     *reactor = remote->reactor;
+    TRviListEntry   *ptr    = remote->rights->listHead;
+    TRviListEntry   *tmp;
+    int             delay;
 
-    int             err         = 0;
-    TRviContext     *ctx        =   (TRviContext *)handle;
-    TRviService     *service    = NULL;
-    char            *fqsn       = NULL;
+    /* The new session presents its credentials again */
+    rviVerifyCancel( handle, remote );
 
-    fqsn = rviFqsnGet( handle, serviceName );
-    if( !fqsn ) { return ENOMEM; }
-    
-    if( (err = rviRightToReceiveError( ctx->rights, fqsn ) ) ) {
-        goto exit;
-    }
+    rviRegistryWrite( ctx );
+    rviRemoveRemoteServices( handle, remote );
 
-    /* Create a new TRviService structure */
-    service = rviServiceCreate( fqsn, 0, callback, serviceData );
+    /* Empty the rights list in place, once nothing indexes them */
+    rviRightsIndexReset( &remote->rightsIdx, remote->rights );
+    while( ptr ) {
+        tmp = ptr;
+        rviRightsDestroy( (TRviRights *)ptr->pointer );
+        ptr = ptr->next;
+        free( tmp );
+    }
+    rviListInitialize( remote->rights );
+    rviRegistryUnlock( ctx );
 
-    /* Add service to services by name */
-    btree_insert( ctx->serviceNameIdx, service );
-    /* Add service to services by registrant */
-    btree_insert( ctx->serviceRegIdx, service );
+    rviCallsFail( handle, remote->fd, ECONNRESET );
 
-    rviServiceAnnounce( handle, service, 1 );
+    pthread_mutex_lock( &remote->lock );
+    /* A producer held back by the lost output hears once it's reconnected */
+    if( remote->drained ) { remote->throttled = true; }
+    if( ( remote->lost || remote->drained ) && !remote->hangup ) {
+        __sync_fetch_and_sub( &reactor->flagged, 1 );
+    }
+    remote->lost = false;
+    remote->drained = false;
+    rviBufferFree( &remote->rbuf );
+    rviBufferFree( &remote->wbuf );
+    rviBufferFree( &remote->wends );
+    remote->wbufBase = 0;
+    remote->flushDeadline = 0;
+    rviFramerInitialize( &remote->framer );
+    remote->announced = false;
+    remote->binaryIn = false;
+    remote->binaryOut = false;
+
+    shutdown( remote->fd, SHUT_RDWR );
+    rviReactorUnwatch( handle, remote );
+    remote->events = 0;
+
+    /* Double the delay each time, and pick a point in its upper half */
+    if( !remote->backoffMs ) {
+        remote->backoffMs = ctx->reconnectMin;
+    } else if( ( remote->backoffMs *= 2 ) > ctx->reconnectMax ) {
+        remote->backoffMs = ctx->reconnectMax;
+    }
+    reactor->jitterState ^= reactor->jitterState << 13;
+    reactor->jitterState ^= reactor->jitterState >> 17;
+    reactor->jitterState ^= reactor->jitterState << 5;
+    delay = remote->backoffMs / 2 + reactor->jitterState % 
+            ( remote->backoffMs - remote->backoffMs / 2 + 1 );
 
-exit:
-    free( fqsn );
+    if(verbose){
+        fprintf(stderr, "rviRemoteBackoff, reconnecting %d in %d ms\n", 
+                remote->fd, delay);
+    }
 
-    return err;
+    remote->reconnectAt = rviNowMs() + delay;
+    remote->state = RVI_REMOTE_BACKOFF;
+    reactor->reconnecting++;
+    pthread_mutex_unlock( &remote->lock );
 }
 
-/* 
- * Unregister a previously registered service
+/*
+ * Open a new socket to a remote's peer and start connecting it without 
+ * blocking. The socket is moved onto the remote's descriptor, which closes
+ * the old socket, so that the application keeps the descriptor returned by
+ * rviConnect() and no other connection can be given it. The SSL BIO is 
+ * attached to the socket through a socket BIO, in place of the BIO it had.
  */
-int rviUnregisterService(TRviHandle handle, const char *serviceName)
+static int rviRemoteResocket( TRviRemote *remote )
 {
-    if( !handle || !serviceName ) { return EINVAL; }
-
-    int             err     = RVI_OK;
-    TRviContext     *ctx    = (TRviContext *)handle;
-    TRviService     skey    = { 0 };
-    
-    skey.name = rviFqsnGet( handle, serviceName );
-    TRviService *stmp = btree_search( ctx->serviceNameIdx, &skey );
-    
-    if( !stmp ) {
-        err = -ENXIO;
-        goto exit;
+    BIO             *conn;
+    BIO             *sock;
+    BIO             *old;
+    int             fd      = -1;
+    int             err;
+
+    /* The host key is "host:port", as BIO_new_connect() expects */
+    if( !remote->hostKey ) { return EINVAL; }
+    conn = BIO_new_connect( remote->hostKey );
+    if( !conn ) { return ENOMEM; }
+    BIO_set_nbio( conn, 1 );
+    if( ( BIO_do_connect( conn ) <= 0 && !BIO_should_retry( conn ) ) ||
+        BIO_get_fd( conn, &fd ) < 0 ) {
+        BIO_free( conn );
+        return RVI_ERR_OPENSSL;
+    }
+    sock = BIO_new_socket( remote->fd, BIO_CLOSE );
+    if( !sock ) { 
+        BIO_free( conn ); 
+        return ENOMEM; 
     }
+    if( dup2( fd, remote->fd ) < 0 ) {
+        err = errno;
+        BIO_set_close( sock, BIO_NOCLOSE );
+        BIO_free( sock );
+        BIO_free( conn );
+        return err;
+    }
+    /* The new socket lives on under the remote's descriptor alone */
+    BIO_set_close( conn, BIO_NOCLOSE );
+    BIO_free( conn );
+    close( fd );
+
+    /* The old BIO names the same descriptor, which must stay open */
+    old = BIO_pop( remote->sbio );
+    if( old ) {
+        BIO_set_close( old, BIO_NOCLOSE );
+        BIO_free( old );
+    }
+    BIO_reset( remote->sbio );
+    BIO_push( remote->sbio, sock );
 
-    if( stmp->registrant != 0 ) {
-        err = -RVI_ERR_RIGHTS;
-        goto exit;
+    return RVI_OK;
+}
+
+/*
+ * Start reopening a connection, offering the TLS session of the previous
+ * handshake. The new handshake is driven by rviRemoteAdvance() without 
+ * blocking, whether or not the connection is otherwise non-blocking.
+ */
+int rviRemoteReconnect( TRviHandle handle, TRviRemote *remote )
+{
+    SSL             *ssl    = NULL;
+    int             err;
+
+    remote->reactor->reconnecting--;
+    remote->stats.reconnects++;
+    remote->connectNs = rviNowNs();
+    RVI_PROBE1( reconnect, remote->fd );
+
+    pthread_mutex_lock( &remote->lock );
+    BIO_get_ssl( remote->sbio, &ssl );
+    if( ssl ) {
+        /* The old session is dead; don't try to send it a close_notify */
+        SSL_set_shutdown( ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN );
     }
+    if( ( err = rviRemoteResocket( remote ) ) ) {
+        pthread_mutex_unlock( &remote->lock );
+        rviRemoteBackoff( handle, remote );
+        return err;
+    }
+    /* Closing the old socket removed it from epoll */
+    remote->watchFd = -1;
+    if( ssl && remote->session ) { SSL_set_session( ssl, remote->session ); }
+    BIO_set_nbio( remote->sbio, 1 );
 
-    rviServiceAnnounce( handle, stmp, 0 );
+    /* Give the new session a full keepalive timeout to show signs of life */
+    remote->lastRxMs = rviNowMs();
+    remote->pingSent = false;
 
-    err = rviRemoveService( handle, skey.name );
+    remote->state = RVI_REMOTE_HANDSHAKE;
+    remote->events = POLLOUT;
+    pthread_mutex_unlock( &remote->lock );
 
-exit:
-    free( skey.name );
+    if( ( err = rviRemoteAdvance( handle, remote ) ) ) {
+        rviRemoteBackoff( handle, remote );
+    }
 
     return err;
 }
 
-int rviRemoveService(TRviHandle handle, const char *serviceName)
+/*
+ * Start reopening every connection of an event loop whose backoff delay has
+ * passed
+ */
+void rviReconnectDue( TRviHandle handle, TRviReactor *reactor )
 {
-    if( !handle || !serviceName ) { return EINVAL; }
-
-    TRviContext   *ctx    = (TRviContext *)handle;
-    TRviService   skey    = { 0 };
-    
-    skey.name = strdup( serviceName );
-    TRviService *stmp = btree_search( ctx->serviceNameIdx, &skey );
-    free( skey.name );
-    
-    if( !stmp ) { return ENOENT; }
-    btree_delete( ctx->serviceNameIdx, 
-                          ctx->serviceNameIdx->root, stmp );
-    btree_delete( ctx->serviceRegIdx, 
-                          ctx->serviceRegIdx->root, stmp );
-    rviServiceDestroy( stmp );
+    TRviRemote      *remote;
+    TRviRemote      *next;
+    long long       now;
+
+    if( !reactor->reconnecting ) { return; }
+
+    now = rviNowMs();
+    for( remote = reactor->remotes; remote; remote = next ) {
+        next = remote->shardNext;
+        if( !remote->closed && remote->state == RVI_REMOTE_BACKOFF && 
+            remote->reconnectAt <= now ) {
+            rviRemoteReconnect( handle, remote );
+        }
+    }
+}
 
-    return RVI_OK;
+/*
+ * Run everything that is due on a timer in an event loop: finished 
+ * credential checks, held output, keepalives and reconnects for its 
+ * connections, and call timeouts if the
+ * loop keeps those, see rviCallsReactor()
+ */
+void rviTimersDue( TRviHandle handle, TRviReactor *reactor )
+{
+    rviVerifyDue( handle, reactor );
+    rviLostDue( handle, reactor );
+    rviFlushDue( handle, reactor );
+    if( reactor == rviCallsReactor( handle ) ) { rviCallsExpire( handle ); }
+    rviKeepaliveDue( handle, reactor );
+    rviReconnectDue( handle, reactor );
 }
 
-/* 
- * Get list of services available
+/*
+ * Run the timers, for applications with their own event loop
  */
-int rviGetServices(TRviHandle handle, char **result, int *len)
+int rviProcessTimers( TRviHandle handle )
 {
-    if( !handle || !result || ( *len < 1 ) ) { return EINVAL; }
+    if( !handle ) { return EINVAL; }
 
-    TRviContext *ctx = (TRviContext *)handle;
+    TRviContext     *ctx    = (TRviContext *)handle;
 
-    if( ctx->serviceNameIdx->count == 0 ) {
-        *len = 0;
-        return RVI_OK;
-    }
+    /* The workers run their own timers */
+    if( ctx->workerCount ) { return EBUSY; }
 
-    btree_iter iter = btree_iter_begin( ctx->serviceNameIdx );
-    int i = 0;
-    while( ! btree_iter_at_end( iter ) ) {
-        if( i == *len )
-            break;
-        TRviService *service = btree_iter_data( iter );
-        if( ! service )
-            break;
-        *result++ = strdup( service->name );
-        i++;
-        btree_iter_next( iter );
-    }
-    *len = i;
-    btree_iter_cleanup( iter );
+    rviLoopReactor = &ctx->loop;
+    ctx->loop.dispatching++;
+    rviTimersDue( handle, &ctx->loop );
+    ctx->loop.dispatching--;
+
+    if( !ctx->loop.dispatching ) { rviReapRemotes( handle, &ctx->loop ); }
 
     return RVI_OK;
 }
 
 /* 
- * Invoke a remote service
+ * Return all file descriptors in the RVI context
  */
-int rviInvokeService(TRviHandle handle, const char *serviceName, 
-                              const char *parameters)
+int rviGetConnections(TRviHandle handle, int *conn, int *connSize)
 {
-    if( !handle || !serviceName ) { return EINVAL; }
-    /* get service from service name index */
+    if( !handle || !conn || !connSize ) { return EINVAL; }
 
     TRviContext *ctx = (TRviContext *)handle;
-    TRviService skey = {0};
-    TRviService *stmp = NULL;
-    TRviRemote rkey = {0};
-    TRviRemote *rtmp = NULL;
-    time_t rawtime; /* the unix epoch time for the current time */
-    int wait = 1000; /* the timeout length in ms */
-    long long timeout;
-    json_t *params = NULL;
-    json_t *rcv;
-    int ret;
-    
-    skey.name = strdup(serviceName);
+    int         fd;
+    int         i = 0;
+
+    /* I/O workers may be adding or closing connections */
+    rviRegistryRead( ctx );
+    for( fd = 0; fd < ctx->remotesSize && i < *connSize; fd++ ) {
+        if( ctx->remotes[fd] ) {
+            conn[i++] = fd;
+        }
+    }
+    rviRegistryUnlock( ctx );
+    *connSize = i;
+
+    return RVI_OK;
+}
+
+
+/* 
+ * Return the poll events each remote connection is waiting for
+ */
+int rviGetPollEvents(TRviHandle handle, struct pollfd *fds, int *fdsSize)
+{
+    if( !handle || !fds || !fdsSize ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+    TRviRemote  *remote;
+    int         fd;
+    int         i = 0;
+
+    for( fd = 0; fd < ctx->remotesSize && i < *fdsSize; fd++ ) {
+        if( !( remote = ctx->remotes[fd] ) ) { continue; }
+
+        /* A thread writing to the remote may be changing its events */
+        pthread_mutex_lock( &remote->lock );
+        /* Connections waiting to be reopened have no socket to poll */
+        if( remote->events ) {
+            fds[i].fd = remote->fd;
+            fds[i].events = remote->events;
+            fds[i].revents = 0;
+            i++;
+        }
+        pthread_mutex_unlock( &remote->lock );
+    }
+    *fdsSize = i;
+
+    return RVI_OK;
+}
+
+/*
+ * Drive the TLS handshake on a non-blocking connection. Once the handshake
+ * completes, the "au" message is sent and the remote waits for the peer's
+ * credentials. If the handshake cannot make progress without blocking, the
+ * events the connection is waiting for are recorded and RVI_OK is returned.
+ */
+int rviRemoteAdvance( TRviHandle handle, TRviRemote *remote )
+{
+    if( !handle || !remote ) { return EINVAL; }
+
+    long long       elapsed;
+    int             ret;
+
+    if( remote->state != RVI_REMOTE_HANDSHAKE ) { return RVI_OK; }
+
+    pthread_mutex_lock( &remote->lock );
+    ret = BIO_do_handshake( remote->sbio );
+    if( ret <= 0 ) {
+        if( !BIO_should_retry( remote->sbio ) ) {
+            pthread_mutex_unlock( &remote->lock );
+            ERR_print_errors_fp( stderr );
+            return RVI_ERR_OPENSSL;
+        }
+        /* Still connecting, or waiting to read/write handshake records */
+        rviRemoteSetEvents( handle, remote, 
+                            BIO_should_read( remote->sbio ) ? POLLIN : POLLOUT );
+        pthread_mutex_unlock( &remote->lock );
+        return RVI_OK;
+    }
+
+    if( !remote->nonblocking ) {
+        /* A blocking connection was reopened without blocking; restore it */
+        BIO_set_nbio( remote->sbio, 0 );
+        BIO_socket_nbio( remote->fd, 0 );
+    }
+
+    if(verbose){
+        SSL *ssl = NULL;
+        BIO_get_ssl( remote->sbio, &ssl );
+        fprintf(stderr, "rviRemoteAdvance, connected on %d, session %s\n", 
+                remote->fd, ( ssl && SSL_session_reused( ssl ) ) ? 
+                            "resumed" : "new" );
+    }
+
+    elapsed = rviNowNs() - remote->connectNs;
+    rviHistogramAdd( &remote->stats.handshake, elapsed );
+    RVI_PROBE2( handshake__done, remote->fd, elapsed );
+
+    remote->state = RVI_REMOTE_AUTH;
+    rviRemoteSetEvents( handle, remote, POLLIN );
+    ret = rviWriteAu( handle, remote );
+    pthread_mutex_unlock( &remote->lock );
+
+    return ret;
+}
+
+/* Append the MessagePack encoding of a JSON value given as text */
+static int rviMsgpackEncodeText( TRviBuffer *out, const char *json, 
+                                 size_t len )
+{
+    json_t          *value;
+    int             err;
+
+    value = json_loadb( json, len, JSON_DECODE_ANY, NULL );
+    if( !value ) { return RVI_ERR_JSON; }
+    err = rviMsgpackEncode( out, value );
+    json_decref( value );
+
+    return err;
+}
+
+/* Append a JSON message given as text to a buffer as a binary frame */
+static int rviFrameJson( TRviBuffer *out, const char *json, size_t len )
+{
+    size_t          start;
+    int             err;
+
+    if( ( err = rviMsgpackFrameBegin( out, &start ) ) ||
+        ( err = rviMsgpackEncodeText( out, json, len ) ) ||
+        ( err = rviMsgpackFrameEnd( out, start ) ) ) {
+        rviBufferTruncate( out, start );
+    }
+
+    return err;
+}
+
+/*
+ * Write a message to a remote connection. For blocking connections, this
+ * blocks until the whole message has been written. For non-blocking
+ * connections, the message is appended to the remote's output buffer, and as
+ * much as possible of the buffer is written without blocking. The rest is
+ * written by rviRemoteFlush() once the socket becomes writable. Once binary
+ * frames have been negotiated, the message is sent as one.
+ */
+int rviRemoteWrite( TRviHandle handle, TRviRemote *remote, 
+                    const char *data, int len )
+{
+    if( !handle || !remote || !data || len < 0 ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+    TRviBuffer  frame;
+    int         err = RVI_OK;
+
+    rviBufferInitialize( &frame );
+    pthread_mutex_lock( &remote->lock );
+
+    if( remote->binaryOut ) {
+        if( ( err = rviFrameJson( &frame, data, len ) ) ) { goto exit; }
+        data = rviBufferData( &frame );
+        len = rviBufferLength( &frame );
+    }
+
+    /* Nothing can be sent until the connection has been reopened */
+    if( remote->state == RVI_REMOTE_BACKOFF || remote->lost ) { 
+        err = RVI_ERR_STREAMEND;
+    } else if( !remote->nonblocking && !ctx->flushLatency &&
+               remote->state != RVI_REMOTE_HANDSHAKE ) {
+        if( BIO_write( remote->sbio, data, len ) != len ) {
+            /* The connection was likely closed by the peer, attempt to 
+             * resume */
+            rviRemoteLost( handle, remote );
+            err = RVI_ERR_STREAMEND;
+        } else {
+            remote->stats.bytesOut += len;
+        }
+    } else if( rviBufferAppend( &remote->wbuf, data, len ) ) { 
+        err = ENOMEM; 
+    } else {
+        err = rviRemoteQueued( handle, remote );
+    }
+    if( err == RVI_OK ) {
+        remote->stats.msgsOut++;
+        RVI_PROBE2( message__sent, remote->fd, len );
+    }
+
+exit:
+    pthread_mutex_unlock( &remote->lock );
+    rviBufferFree( &frame );
+
+    return err;
+}
+
+/*
+ * Note that a write found a remote's connection lost. The connection is not 
+ * reopened here, since the writer may be any thread, holding the registry 
+ * lock that reopening takes for writing, but by the event loop through
+ * rviLostDue(). Until then, writes to the remote fail. Called with the 
+ * remote's lock held.
+ */
+void rviRemoteLost( TRviHandle handle, TRviRemote *remote )
+{
+    rviRemoteFlag( remote, &remote->lost );
+}
+
+/*
+ * Set one of the flags that ask a remote's event loop to deal with it, lost,
+ * hangup or drained, and wake the loop if it is a worker. The loop counts the
+ * remotes with any of them set. Called with the remote's lock held.
+ */
+void rviRemoteFlag( TRviRemote *remote, bool *flag )
+{
+    bool            counted = remote->lost || remote->hangup || 
+                              remote->drained;
+
+    *flag = true;
+    if( !counted ) {
+        __sync_fetch_and_add( &remote->reactor->flagged, 1 );
+        rviReactorNotify( remote->reactor, 0 );
+    }
+}
+
+/*
+ * Reopen every connection of an event loop that a write found lost, close 
+ * those that other threads disconnected, and tell the application about 
+ * those whose output has drained
+ */
+void rviLostDue( TRviHandle handle, TRviReactor *reactor )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    TRviRemote      *next;
+    bool            lost;
+    bool            hangup;
+    bool            drained;
+
+    if( !reactor->flagged ) { return; }
+
+    for( remote = reactor->remotes; remote; remote = next ) {
+        next = remote->shardNext;
+        if( remote->closed ) { continue; }
+
+        pthread_mutex_lock( &remote->lock );
+        lost = remote->lost;
+        hangup = remote->hangup;
+        drained = remote->drained && !lost && !hangup;
+        if( drained ) { 
+            remote->drained = false;
+            __sync_fetch_and_sub( &reactor->flagged, 1 );
+        }
+        pthread_mutex_unlock( &remote->lock );
+        if( hangup ) { 
+            rviDisconnect( handle, remote->fd ); 
+        } else if( lost ) { 
+            rviRemoteBackoff( handle, remote ); 
+        } else if( drained && ctx->writable ) {
+            ctx->writable( remote->fd, ctx->writableData );
+        }
+    }
+}
+
+/*
+ * Decide what to do with output just added to a remote's output buffer. It is
+ * held until the handshake completes on a non-blocking connection. If a flush
+ * latency is configured, it is held until the deadline set by the first
+ * message in the buffer, or until a full TLS record has accumulated. 
+ * Otherwise, it is written right away.
+ */
+int rviRemoteQueued( TRviHandle handle, TRviRemote *remote )
+{
+    TRviContext *ctx = (TRviContext *)handle;
+    long long   end;
+
+    /* Failing to note the end only makes the queue look shorter */
+    if( ctx->queueHighMsgs ) {
+        end = remote->wbufBase + rviBufferLength( &remote->wbuf );
+        rviBufferAppend( &remote->wends, &end, sizeof( end ) );
+    }
+
+    if( remote->state == RVI_REMOTE_HANDSHAKE ) { return RVI_OK; }
+
+    if( ctx->flushLatency && rviBufferLength( &remote->wbuf ) < TLS_BUFSIZE ) {
+        if( !remote->flushDeadline ) {
+            remote->flushDeadline = rviNowMs() + ctx->flushLatency;
+            rviReactorNotify( remote->reactor, remote->flushDeadline );
+        }
+        return RVI_OK;
+    }
+
+    return rviRemoteFlush( handle, remote );
+}
+
+/*
+ * Return the buffer to compose a message to a remote in, with the remote's 
+ * lock held: the remote's output buffer. Writing to a blocking connection 
+ * sends the buffer straight away, which leaves it empty again. Returns NULL,
+ * without the lock held, if nothing can be sent to the remote.
+ */
+TRviBuffer *rviRemoteOutput( TRviHandle handle, TRviRemote *remote )
+{
+    pthread_mutex_lock( &remote->lock );
+
+    if( remote->state == RVI_REMOTE_BACKOFF || remote->lost ) {
+        pthread_mutex_unlock( &remote->lock );
+        return NULL;
+    }
+
+    return &remote->wbuf;
+}
+
+/*
+ * Send a message composed from start onwards in the buffer returned by
+ * rviRemoteOutput(), and release the remote's lock.
+ */
+int rviRemoteOutputDone( TRviHandle handle, TRviRemote *remote, 
+                         TRviBuffer *out, size_t start )
+{
+    int             err;
+
+    if(verbose){
+        fprintf(stderr, "rviRemoteOutputDone, sending: '%.*s'\n", 
+                (int)( rviBufferLength( out ) - start ), 
+                rviBufferData( out ) + start );
+    }
+
+    remote->stats.msgsOut++;
+    RVI_PROBE2( message__sent, remote->fd, rviBufferLength( out ) - start );
+    err = rviRemoteQueued( handle, remote );
+    pthread_mutex_unlock( &remote->lock );
+
+    return err;
+}
+
+/* Compose an "rcv" message as a binary frame, with the same members */
+static int rviFrameRcv( TRviBuffer *out, const char *serviceName, 
+                        long long tid, long long timeout, 
+                        const char *parameters, size_t len )
+{
+    size_t          start;
+    int             err;
+
+    if( ( err = rviMsgpackFrameBegin( out, &start ) ) ||
+        ( err = rviMsgpackPutMap( out, 4 ) ) ||
+        ( err = rviMsgpackPutString( out, "cmd", 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "rcv", 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "tid", 3 ) ) ||
+        ( err = rviMsgpackPutInteger( out, tid ) ) ||
+        ( err = rviMsgpackPutString( out, "mod", 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "proto_json_rpc", 14 ) ) ||
+        ( err = rviMsgpackPutString( out, "data", 4 ) ) ||
+        ( err = rviMsgpackPutMap( out, 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "service", 7 ) ) ||
+        ( err = rviMsgpackPutString( out, serviceName, 
+                                     strlen( serviceName ) ) ) ||
+        ( err = rviMsgpackPutString( out, "timeout", 7 ) ) ||
+        ( err = rviMsgpackPutInteger( out, timeout ) ) ||
+        ( err = rviMsgpackPutString( out, "parameters", 10 ) ) ||
+        ( err = rviMsgpackEncodeText( out, parameters, len ) ) ||
+        ( err = rviMsgpackFrameEnd( out, start ) ) ) {
+        rviBufferTruncate( out, start );
+    }
+
+    return err;
+}
+
+/* Compose an "rpl" message as a binary frame, with the same members */
+static int rviFrameRpl( TRviBuffer *out, long long tid, const char *result,
+                        size_t len )
+{
+    size_t          start;
+    int             err;
+
+    if( ( err = rviMsgpackFrameBegin( out, &start ) ) ||
+        ( err = rviMsgpackPutMap( out, 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "cmd", 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "rpl", 3 ) ) ||
+        ( err = rviMsgpackPutString( out, "tid", 3 ) ) ||
+        ( err = rviMsgpackPutInteger( out, tid ) ) ||
+        ( err = rviMsgpackPutString( out, "result", 6 ) ) ||
+        ( err = rviMsgpackEncodeText( out, result, len ) ) ||
+        ( err = rviMsgpackFrameEnd( out, start ) ) ) {
+        rviBufferTruncate( out, start );
+    }
+
+    return err;
+}
+
+/*
+ * Write an "rcv" message to a remote connection without building a JSON tree.
+ * The envelope is composed directly in the remote's output buffer (or, for a
+ * blocking connection, in the context's scratch buffer) and the parameters,
+ * which must already be valid JSON, are spliced in unchanged. The message is
+ * equivalent to:
+ *
+ *   {"cmd":"rcv","tid":<tid>,"mod":"proto_json_rpc",
+ *    "data":{"service":<name>,"timeout":<timeout>,"parameters":<parameters>}}
+ *
+ * Once binary frames have been negotiated, the same message is sent as one.
+ */
+int rviRemoteWriteRcv( TRviHandle handle, TRviRemote *remote, 
+                       const char *serviceName, long long tid, 
+                       long long timeout, const char *parameters, size_t len )
+{
+    if( !handle || !remote || !serviceName || !parameters ) { return EINVAL; }
+
+    TRviBuffer      *out;
+    size_t          start;
+    char            head[64];
+    char            num[64];
+    int             h;
+    int             n;
+    int             err;
+
+    out = rviRemoteOutput( handle, remote );
+    if( !out ) { return RVI_ERR_STREAMEND; }
+    /* Producers are held back, rather than queueing without bound */
+    if( rviRemoteFull( handle, remote ) ) {
+        remote->throttled = true;
+        pthread_mutex_unlock( &remote->lock );
+        return RVI_ERR_WOULDBLOCK;
+    }
+    start = rviBufferLength( out );
+
+    if( remote->binaryOut ) {
+        err = rviFrameRcv( out, serviceName, tid, timeout, parameters, len );
+        if( err ) {
+            pthread_mutex_unlock( &remote->lock );
+            return err;
+        }
+        return rviRemoteOutputDone( handle, remote, out, start );
+    }
+
+    h = snprintf( head, sizeof( head ), 
+                  "{\"cmd\":\"rcv\",\"tid\":%lld,\"mod\":\"proto_json_rpc\","
+                  "\"data\":{\"service\":", tid );
+    n = snprintf( num, sizeof( num ), ",\"timeout\":%lld,\"parameters\":", 
+                  timeout );
+
+    if( rviBufferAppend( out, head, h ) ||
+        rviBufferAppendJsonString( out, serviceName ) ||
+        rviBufferAppend( out, num, n ) ||
+        rviBufferAppend( out, parameters, len ) ||
+        rviBufferAppend( out, "}}", 2 ) ) {
+        /* Leave no partial message behind */
+        rviBufferTruncate( out, start );
+        pthread_mutex_unlock( &remote->lock );
+        return ENOMEM;
+    }
+
+    return rviRemoteOutputDone( handle, remote, out, start );
+}
+
+/*
+ * Write an "rpl" message, carrying the result of the call with transaction id
+ * tid back to the remote that made it. Like an "rcv", it is composed directly
+ * with the result spliced in unchanged:
+ *
+ *   {"cmd":"rpl","tid":<tid>,"result":<result>}
+ */
+int rviRemoteWriteRpl( TRviHandle handle, TRviRemote *remote, long long tid,
+                       const char *result, size_t len )
+{
+    if( !handle || !remote || !result ) { return EINVAL; }
+
+    TRviBuffer      *out;
+    size_t          start;
+    char            head[64];
+    int             h;
+    int             err;
+
+    out = rviRemoteOutput( handle, remote );
+    if( !out ) { return RVI_ERR_STREAMEND; }
+    start = rviBufferLength( out );
+
+    if( remote->binaryOut ) {
+        err = rviFrameRpl( out, tid, result, len );
+        if( err ) {
+            pthread_mutex_unlock( &remote->lock );
+            return err;
+        }
+        return rviRemoteOutputDone( handle, remote, out, start );
+    }
+
+    h = snprintf( head, sizeof( head ), 
+                  "{\"cmd\":\"rpl\",\"tid\":%lld,\"result\":", tid );
+
+    if( rviBufferAppend( out, head, h ) ||
+        rviBufferAppend( out, result, len ) ||
+        rviBufferAppend( out, "}", 1 ) ) {
+        rviBufferTruncate( out, start );
+        pthread_mutex_unlock( &remote->lock );
+        return ENOMEM;
+    }
+
+    return rviRemoteOutputDone( handle, remote, out, start );
+}
+
+/*
+ * Write as much of a remote's output buffer as possible, without blocking if 
+ * the connection is non-blocking. If data remains, the remote waits for 
+ * POLLOUT.
+ */
+int rviRemoteFlush( TRviHandle handle, TRviRemote *remote )
+{
+    if( !handle || !remote ) { return EINVAL; }
+
+    SSL             *ssl    = NULL;
+    int             written;
+    int             err     = RVI_OK;
+
+    pthread_mutex_lock( &remote->lock );
+
+    /* Whatever remains after this is written when the socket is writable */
+    remote->flushDeadline = 0;
+
+    BIO_get_ssl( remote->sbio, &ssl );
+    if( !ssl ) { err = RVI_ERR_OPENSSL; goto exit; }
+    if( remote->lost ) { goto exit; }
+
+    while( rviBufferLength( &remote->wbuf ) > 0 ) {
+        written = SSL_write( ssl, rviBufferData( &remote->wbuf ), 
+                             rviBufferLength( &remote->wbuf ) );
+        if( written <= 0 ) {
+            err = SSL_get_error( ssl, written );
+            if( err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ ) {
+                rviRemoteSetEvents( handle, remote, POLLIN | POLLOUT );
+            } else {
+                /* The peer probably closed the connection, so reopen it */
+                rviRemoteLost( handle, remote );
+            }
+            err = RVI_OK;
+            goto exit;
+        }
+        rviBufferConsume( &remote->wbuf, written );
+        remote->stats.bytesOut += written;
+        rviRemoteSent( handle, remote, written );
+    }
+    rviRemoteSetEvents( handle, remote, POLLIN );
+
+exit:
+    pthread_mutex_unlock( &remote->lock );
+
+    return err;
+}
+
+/*
+ * Number of messages in a remote's output buffer, see TRviRemote
+ */
+static size_t rviRemoteQueuedMsgs( TRviRemote *remote )
+{
+    return rviBufferLength( &remote->wends ) / sizeof( long long );
+}
+
+/*
+ * Test whether a remote's output buffer has reached either high watermark.
+ * Called with the remote's lock held.
+ */
+bool rviRemoteFull( TRviHandle handle, TRviRemote *remote )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    return ( ctx->queueHighBytes && 
+             rviBufferLength( &remote->wbuf ) >= ctx->queueHighBytes ) ||
+           ( ctx->queueHighMsgs && 
+             rviRemoteQueuedMsgs( remote ) >= ctx->queueHighMsgs );
+}
+
+/*
+ * Account for output just written from a remote's output buffer, and flag the
+ * remote for its event loop to call the writable callback once a refused
+ * producer may try again. Called with the remote's lock held.
+ */
+void rviRemoteSent( TRviHandle handle, TRviRemote *remote, size_t written )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    long long       end;
+
+    remote->wbufBase += written;
+    while( rviBufferLength( &remote->wends ) ) {
+        memcpy( &end, rviBufferData( &remote->wends ), sizeof( end ) );
+        if( end > remote->wbufBase ) { break; }
+        rviBufferConsume( &remote->wends, sizeof( end ) );
+    }
+
+    if( remote->throttled &&
+        ( !ctx->queueHighBytes || 
+          rviBufferLength( &remote->wbuf ) <= ctx->queueLowBytes ) &&
+        ( !ctx->queueHighMsgs || 
+          rviRemoteQueuedMsgs( remote ) <= ctx->queueLowMsgs ) ) {
+        remote->throttled = false;
+        rviRemoteFlag( remote, &remote->drained );
+    }
+}
+
+/*
+ * Write the held output of every remote of an event loop whose flush 
+ * deadline has passed.
+ */
+void rviFlushDue( TRviHandle handle, TRviReactor *reactor )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    long long       now;
+
+    if( !ctx->flushLatency ) { return; }
+
+    now = rviNowMs();
+    for( remote = reactor->remotes; remote; remote = remote->shardNext ) {
+
+        /* Other threads may be queueing output meanwhile */
+        pthread_mutex_lock( &remote->lock );
+        if( remote->flushDeadline && remote->flushDeadline <= now &&
+            remote->state != RVI_REMOTE_HANDSHAKE ) {
+            rviRemoteFlush( handle, remote );
+        }
+        pthread_mutex_unlock( &remote->lock );
+    }
+}
+
+/*
+ * Ping the remotes of an event loop that have been silent for the keepalive
+ * interval and reopen those silent for the keepalive timeout. Nothing is 
+ * done until the earliest time found by the previous pass, so the remotes 
+ * are only scanned when one of them may need attention.
+ */
+void rviKeepaliveDue( TRviHandle handle, TRviReactor *reactor )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    long long       now;
+    long long       next;
+    long long       due;
+
+    if( !ctx->keepalive ) { return; }
+
+    now = rviNowMs();
+    if( now < reactor->keepaliveNext ) { return; }
+
+    next = now + ctx->keepalive;
+    for( remote = reactor->remotes; remote; remote = remote->shardNext ) {
+        if( remote->closed || remote->state == RVI_REMOTE_BACKOFF ) { 
+            continue; 
+        }
+
+        if( now - remote->lastRxMs >= ctx->keepaliveTimeout ) {
+            if(verbose){
+                fprintf(stderr, "rviKeepaliveDue, no data on %d for %lld ms, "
+                        "reconnecting\n", remote->fd, now - remote->lastRxMs );
+            }
+            rviRemoteBackoff( handle, remote );
+            continue;
+        } else if( remote->pingSent ) {
+            due = remote->lastRxMs + ctx->keepaliveTimeout;
+        } else if( now - remote->lastRxMs >= ctx->keepalive &&
+                   remote->state == RVI_REMOTE_CONNECTED ) {
+            rviRemotePing( handle, remote );
+            remote->pingSent = true;
+            due = remote->lastRxMs + ctx->keepaliveTimeout;
+        } else {
+            due = remote->lastRxMs + ctx->keepalive;
+        }
+        if( due < next ) { next = due; }
+    }
+    reactor->keepaliveNext = next;
+}
+
+/*
+ * Send a ping, to which the peer answers with a ping of its own
+ */
+int rviRemotePing( TRviHandle handle, TRviRemote *remote )
+{
+    const char      ping[]  = "{\"cmd\":\"ping\"}";
+
+    if(verbose){
+        fprintf(stderr, "rviRemotePing, sending: '%s'\n", ping);
+    }
+
+    remote->lastPingMs = remote->reactor->loopMs ? remote->reactor->loopMs : 
+                                                   rviNowMs();
+
+    return rviRemoteWrite( handle, remote, ping, sizeof( ping ) - 1 );
+}
+
+/*
+ * Set the keepalive interval and timeout
+ */
+int rviSetKeepalive( TRviHandle handle, int intervalMs, int timeoutMs )
+{
+    if( !handle || intervalMs < 0 || 
+        ( intervalMs && timeoutMs <= intervalMs ) ) { 
+        return EINVAL; 
+    }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    int             i;
+
+    ctx->keepalive = intervalMs;
+    ctx->keepaliveTimeout = intervalMs ? timeoutMs : 0;
+    ctx->loop.keepaliveNext = 0;
+    for( i = 0; i < ctx->workerCount; i++ ) {
+        ctx->workers[i].keepaliveNext = 0;
+        rviReactorNotify( &ctx->workers[i], 0 );
+    }
+
+    return RVI_OK;
+}
+
+/*
+ * Write held output to one remote connection, or to all of them
+ */
+int rviFlush( TRviHandle handle, int fd )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    int             err     = RVI_OK;
+    int             ret;
+    int             i;
+
+    rviRegistryRead( ctx );
+
+    if( fd >= 0 ) {
+        remote = rviRemoteLookup( handle, fd );
+        err = remote ? rviRemoteFlushHeld( handle, remote ) : ENXIO;
+    } else {
+        for( i = 0; i < ctx->remotesSize; i++ ) {
+            if( !( remote = ctx->remotes[i] ) ) { continue; }
+            ret = rviRemoteFlushHeld( handle, remote );
+            if( ret && !err ) { err = ret; }
+        }
+    }
+
+    rviRegistryUnlock( ctx );
+
+    return err;
+}
+
+/*
+ * Write a remote's held output, if there is any and it can be written
+ */
+int rviRemoteFlushHeld( TRviHandle handle, TRviRemote *remote )
+{
+    int             err     = RVI_OK;
+
+    pthread_mutex_lock( &remote->lock );
+    if( rviBufferLength( &remote->wbuf ) &&
+        remote->state != RVI_REMOTE_HANDSHAKE && 
+        remote->state != RVI_REMOTE_BACKOFF ) {
+        err = rviRemoteFlush( handle, remote );
+    }
+    pthread_mutex_unlock( &remote->lock );
+
+    return err;
+}
+
+/*
+ * Return the time until held output must be written
+ */
+int rviGetTimeout( TRviHandle handle, int *timeout )
+{
+    if( !handle || !timeout ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    *timeout = rviReactorTimeout( handle, &ctx->loop );
+
+    return RVI_OK;
+}
+
+/*
+ * Return the time (ms) until something is due on an event loop's timers, or
+ * -1 if nothing is
+ */
+int rviReactorTimeout( TRviHandle handle, TRviReactor *reactor )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    long long       first   = 0;
+    long long       now;
+
+    /* Connections flagged by other threads, or whose credentials have been 
+     * checked, are dealt with right away */
+    if( reactor->flagged || __sync_add_and_fetch( &reactor->verified, 0 ) ) {
+        return 0;
+    }
+
+    for( remote = reactor->remotes; ctx->flushLatency && remote; 
+         remote = remote->shardNext ) {
+        pthread_mutex_lock( &remote->lock );
+        if( remote->flushDeadline && 
+            ( !first || remote->flushDeadline < first ) ) {
+            first = remote->flushDeadline;
+        }
+        pthread_mutex_unlock( &remote->lock );
+    }
+    /* Wake up in time to expire calls awaiting a reply, too */
+    if( reactor == rviCallsReactor( handle ) ) {
+        now = rviCallsNextDeadline( handle );
+        if( now && ( !first || now < first ) ) { first = now; }
+    }
+    /* And to reopen lost connections */
+    for( remote = reactor->remotes; reactor->reconnecting && remote; 
+         remote = remote->shardNext ) {
+        if( remote->state == RVI_REMOTE_BACKOFF &&
+            ( !first || remote->reconnectAt < first ) ) {
+            first = remote->reconnectAt;
+        }
+    }
+    /* And to look after idle connections */
+    if( ctx->keepalive && reactor->remotes && 
+        ( !first || reactor->keepaliveNext < first ) ) {
+        first = reactor->keepaliveNext;
+    }
+    /* A loop that can't be woken looks for finished credential checks */
+    if( reactor->verifying && reactor->wakefd < 0 ) {
+        now = rviNowMs() + RVI_VERIFY_POLL_MS;
+        if( !first || now < first ) { first = now; }
+    }
+    if( !first ) { return -1; }
+
+    now = rviNowMs();
+
+    return ( first > now ) ? (int)( first - now ) : 0;
+}
+
+/*
+ * Record the poll events a remote is waiting for, and update its registration
+ * with the event loop to match.
+ */
+void rviRemoteSetEvents( TRviHandle handle, TRviRemote *remote, short events )
+{
+    remote->events = events;
+    rviReactorWatch( handle, remote );
+}
+
+/*
+ * Register a remote's descriptor with the event loop, or update the events it
+ * is registered for. The remote itself is stored with the registration, so
+ * ready events can be dispatched without looking it up.
+ */
+int rviReactorWatch( TRviHandle handle, TRviRemote *remote )
+{
+    if( !handle || !remote ) { return EINVAL; }
+
+#ifdef HAVE_SYS_EPOLL_H
+    int                 epfd    = remote->reactor->epfd;
+    struct epoll_event  ev      = {0};
+    int                 op;
+
+    if( epfd < 0 || remote->closed || remote->fd < 0 ) { return RVI_OK; }
+
+    if( !remote->events ) {
+        rviReactorUnwatch( handle, remote );
+        return RVI_OK;
+    }
+
+    if( remote->watchFd == remote->fd && remote->watchEvents == remote->events )
+        return RVI_OK; /* Nothing changed */
+
+    ev.events = ( ( remote->events & POLLIN ) ? EPOLLIN : 0 ) |
+                ( ( remote->events & POLLOUT ) ? EPOLLOUT : 0 );
+    ev.data.ptr = remote;
+
+    op = ( remote->watchFd == remote->fd ) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if( epoll_ctl( epfd, op, remote->fd, &ev ) < 0 ) {
+        /* The descriptor may have been closed and reopened behind our back */
+        op = ( errno == ENOENT ) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        if( ( errno != ENOENT && errno != EEXIST ) || 
+            epoll_ctl( epfd, op, remote->fd, &ev ) < 0 ) {
+            return errno;
+        }
+    }
+
+    remote->watchFd = remote->fd;
+    remote->watchEvents = remote->events;
+#endif
+
+    return RVI_OK;
+}
+
+/*
+ * Remove a remote's descriptor from the event loop.
+ */
+void rviReactorUnwatch( TRviHandle handle, TRviRemote *remote )
+{
+#ifdef HAVE_SYS_EPOLL_H
+    int                 epfd    = remote->reactor->epfd;
+    struct epoll_event  ev      = {0};
+
+    if( epfd >= 0 && remote->watchFd >= 0 && remote->watchFd == remote->fd ) {
+        epoll_ctl( epfd, EPOLL_CTL_DEL, remote->watchFd, &ev );
+    }
+#endif
+    remote->watchFd = -1;
+}
+
+/*
+ * Set up an event loop: the built-in one, or an I/O worker, which also gets
+ * an eventfd for other threads to wake it with.
+ */
+int rviReactorInitialize( TRviHandle handle, TRviReactor *reactor, 
+                          bool worker, uint32_t seed )
+{
+    memset( reactor, 0, sizeof( TRviReactor ) );
+    reactor->ctx = (TRviContext *)handle;
+    reactor->epfd = -1;
+    reactor->wakefd = -1;
+    reactor->jitterState = seed | 1;
+    rviArenaInitialize( &reactor->msgArena, RVI_ARENA_CHUNK );
+    rviListInitialize( &reactor->inbox );
+    pthread_mutex_init( &reactor->inboxLock, NULL );
+
+    reactor->graveyard = malloc( sizeof( TRviList ) );
+    if( !reactor->graveyard ) { return ENOMEM; }
+    rviListInitialize( reactor->graveyard );
+
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event  ev      = {0};
+
+    /* Connections are registered as they are opened */
+    reactor->epfd = epoll_create1( EPOLL_CLOEXEC );
+    if( reactor->epfd < 0 ) { return errno; }
+
+    if( worker ) {
+        /* Told apart from the connections by its NULL pointer */
+        reactor->wakefd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        if( reactor->wakefd < 0 ) { return errno; }
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if( epoll_ctl( reactor->epfd, EPOLL_CTL_ADD, reactor->wakefd, 
+                       &ev ) < 0 ) { 
+            return errno; 
+        }
+    }
+#endif
+
+    return RVI_OK;
+}
+
+/*
+ * Release an event loop's resources. Its connections must all have been
+ * closed, or moved to another loop.
+ */
+void rviReactorFree( TRviHandle handle, TRviReactor *reactor )
+{
+    if( !reactor->ctx ) { return; } /* Never set up */
+
+    if( reactor->graveyard ) {
+        rviReapRemotes( handle, reactor );
+        free( reactor->graveyard );
+    }
+    if( reactor->epfd >= 0 ) { close( reactor->epfd ); }
+    if( reactor->wakefd >= 0 ) { close( reactor->wakefd ); }
+    rviArenaFree( &reactor->msgArena );
+    pthread_mutex_destroy( &reactor->inboxLock );
+
+    memset( reactor, 0, sizeof( TRviReactor ) );
+}
+
+/*
+ * Add a remote to the shard of the event loop it belongs to, or take it out
+ * again. Only the loop's own thread does either while the loop runs.
+ */
+void rviReactorLink( TRviReactor *reactor, TRviRemote *remote )
+{
+    remote->shardPrev = NULL;
+    remote->shardNext = reactor->remotes;
+    if( reactor->remotes ) { reactor->remotes->shardPrev = remote; }
+    reactor->remotes = remote;
+}
+
+void rviReactorUnlink( TRviRemote *remote )
+{
+    if( remote->shardPrev ) {
+        remote->shardPrev->shardNext = remote->shardNext;
+    } else if( remote->reactor->remotes == remote ) {
+        remote->reactor->remotes = remote->shardNext;
+    } else {
+        return; /* Not linked */
+    }
+    if( remote->shardNext ) { 
+        remote->shardNext->shardPrev = remote->shardPrev; 
+    }
+    /* shardNext is left alone, for loops walking the shard */
+    remote->shardPrev = NULL;
+}
+
+/*
+ * Move a remote to another event loop, with its registration and its share
+ * of the loops' timers. Neither loop may be running.
+ */
+void rviReactorMove( TRviHandle handle, TRviRemote *remote, 
+                     TRviReactor *reactor )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviReactor     *from   = remote->reactor;
+
+    rviReactorUnwatch( handle, remote );
+    rviReactorUnlink( remote );
+    from->remoteCount--;
+    if( remote->state == RVI_REMOTE_BACKOFF ) { 
+        from->reconnecting--;
+        reactor->reconnecting++;
+    }
+    if( remote->lost || remote->hangup || remote->drained ) {
+        from->flagged--;
+        reactor->flagged++;
+    }
+
+    /* A verifier thread finishing a check wakes the remote's loop */
+    pthread_mutex_lock( &ctx->verifyLock );
+    if( remote->verify ) {
+        from->verifying--;
+        reactor->verifying++;
+        if( remote->verify->done ) {
+            from->verified--;
+            reactor->verified++;
+        }
+    }
+    remote->reactor = reactor;
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    rviReactorLink( reactor, remote );
+    reactor->remoteCount++;
+    reactor->keepaliveNext = 0;
+    rviReactorWatch( handle, remote );
+
+    /* A handshake in progress sets the events it is waiting for again */
+    if( rviRemoteAdvance( handle, remote ) ) {
+        rviRemoteBackoff( handle, remote );
+    }
+}
+
+/*
+ * Wake an I/O worker that is sleeping past a deadline, e.g., for held output,
+ * just set by another thread. A deadline of 0 means right away. 
+ *
+ * A worker publishes when it will wake up before it goes to sleep, and 
+ * clears it as soon as it wakes; the deadline is set before it is checked
+ * here, so either the worker sees the deadline when it computes its timeout,
+ * or this sees the time it will wake up at. A spurious wakeup only costs a 
+ * pass of the loop.
+ */
+void rviReactorNotify( TRviReactor *reactor, long long deadline )
+{
+    uint64_t        one     = 1;
+    long long       wakeAt;
+
+    if( reactor->wakefd < 0 || reactor == rviLoopReactor ) { return; }
+
+    wakeAt = __sync_add_and_fetch( &reactor->wakeAt, 0 );
+    if( deadline && wakeAt > 0 && wakeAt <= deadline ) { return; }
+
+    if( write( reactor->wakefd, &one, sizeof( one ) ) < 0 && 
+        errno != EAGAIN ) {
+        fprintf( stderr, "Unable to wake I/O worker: %s\n", strerror( errno ) );
+    }
+}
+
+/*
+ * Take over the connections handed to an I/O worker, after it has been woken.
+ * Their handshakes are started here, as rviConnect() would for the built-in
+ * loop.
+ */
+void rviReactorAdopt( TRviHandle handle, TRviReactor *reactor )
+{
+    TRviRemote      *remote;
+    TRviListEntry   *ptr;
+    TRviListEntry   *tmp;
+    uint64_t        count;
+
+    /* Reset the wakeup; whatever it was for is handled by this pass */
+    while( read( reactor->wakefd, &count, sizeof( count ) ) < 0 && 
+           errno == EINTR ) {
+        continue;
+    }
+
+    pthread_mutex_lock( &reactor->inboxLock );
+    ptr = reactor->inbox.listHead;
+    rviListInitialize( &reactor->inbox );
+    pthread_mutex_unlock( &reactor->inboxLock );
+
+    while( ptr ) {
+        tmp = ptr;
+        remote = ptr->pointer;
+        ptr = ptr->next;
+        free( tmp );
+
+        rviReactorLink( reactor, remote );
+        rviReactorWatch( handle, remote );
+        if( rviRemoteAdvance( handle, remote ) ) {
+            rviRemoteBackoff( handle, remote );
+        }
+    }
+}
+
+/*
+ * Choose the event loop for a new connection: the built-in one, or the I/O
+ * worker serving the fewest connections
+ */
+TRviReactor *rviReactorPick( TRviHandle handle )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviReactor     *best   = &ctx->loop;
+    unsigned int    load    = 0;
+    unsigned int    count;
+    int             i;
+
+    for( i = 0; i < ctx->workerCount; i++ ) {
+        count = __sync_add_and_fetch( &ctx->workers[i].remoteCount, 0 );
+        if( i == 0 || count < load ) {
+            best = &ctx->workers[i];
+            load = count;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * The event loop that times out calls awaiting a reply: the first I/O worker
+ * if there are any, otherwise the built-in loop. Only one loop does, so the
+ * others need not wake up for every deadline.
+ */
+TRviReactor *rviCallsReactor( TRviHandle handle )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    return ctx->workerCount ? &ctx->workers[0] : &ctx->loop;
+}
+
+/*
+ * Run one iteration of an event loop
+ */
+int rviReactorRunOnce( TRviHandle handle, TRviReactor *reactor, int timeout )
+{
+    TRviRemote          *remote = NULL;
+    int                 err     = RVI_OK;
+    int                 due;
+    int                 n;
+    int                 i;
+
+    rviLoopReactor = reactor;
+
+    /* Wake up in time to write held output */
+    due = rviReactorTimeout( handle, reactor );
+    if( due >= 0 && ( timeout < 0 || due < timeout ) ) { timeout = due; }
+
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event  events[RVI_MAX_EVENTS];
+
+    /* Tell other threads when to wake us, see rviReactorNotify() */
+    if( reactor->wakefd >= 0 ) {
+        __sync_lock_test_and_set( &reactor->wakeAt, 
+                                  timeout < 0 ? -1 : rviNowMs() + timeout );
+    }
+    n = epoll_wait( reactor->epfd, events, RVI_MAX_EVENTS, timeout );
+    if( reactor->wakefd >= 0 ) { 
+        __sync_lock_test_and_set( &reactor->wakeAt, 0 ); 
+    }
+    if( n < 0 ) { return ( errno == EINTR ) ? RVI_OK : errno; }
+    reactor->loopMs = rviNowMs();
+
+    reactor->dispatching++;
+    for( i = 0; i < n; i++ ) {
+        remote = events[i].data.ptr;
+        if( !remote ) {
+            rviReactorAdopt( handle, reactor );
+            continue;
+        }
+        /* A callback may have disconnected it earlier in this pass */
+        if( remote->closed ) { continue; }
+        err = rviRemoteProcess( handle, remote );
+        if( err == ENOMEM ) { break; }
+    }
+    reactor->dispatching--;
+#else
+    /* Without epoll, build the descriptor set on every pass. There are no
+     * workers then, so this is the built-in loop, serving every connection */
+    TRviContext         *ctx    = (TRviContext *)handle;
+    struct pollfd       *fds    = NULL;
+    int                 len     = ctx->remoteCount;
+
+    fds = malloc( ( len + 1 ) * sizeof( struct pollfd ) );
+    if( !fds ) { return ENOMEM; }
+    rviGetPollEvents( handle, fds, &len );
+
+    n = poll( fds, len, timeout );
+    if( n < 0 ) { 
+        free( fds );
+        return ( errno == EINTR ) ? RVI_OK : errno; 
+    }
+    reactor->loopMs = rviNowMs();
+
+    reactor->dispatching++;
+    for( i = 0; i < len && n > 0; i++ ) {
+        if( !fds[i].revents ) { continue; }
+        n--;
+        remote = rviRemoteLookup( handle, fds[i].fd );
+        if( !remote ) { continue; }
+        err = rviRemoteProcess( handle, remote );
+        if( err == ENOMEM ) { break; }
+    }
+    reactor->dispatching--;
+
+    free( fds );
+#endif
+
+    rviTimersDue( handle, reactor );
+
+    if( !reactor->dispatching ) { rviReapRemotes( handle, reactor ); }
+
+    return err;
+}
+
+/*
+ * Run one iteration of the built-in event loop
+ */
+int rviRunOnce(TRviHandle handle, int timeout)
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext         *ctx    = (TRviContext *)handle;
+
+    /* The workers serve every connection */
+    if( ctx->workerCount ) { return EBUSY; }
+
+    return rviReactorRunOnce( handle, &ctx->loop, timeout );
+}
+
+/*
+ * Run the built-in event loop until rviStop() is called
+ */
+int rviRun(TRviHandle handle)
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    int             err     = RVI_OK;
+
+    if( ctx->workerCount ) { return EBUSY; }
+
+    ctx->loop.stop = false;
+    while( !ctx->loop.stop ) {
+        err = rviRunOnce( handle, -1 );
+        /* Errors on individual connections don't stop the loop */
+        if( err == ENOMEM || err == EBADF || err == EINVAL ) { break; }
+        err = RVI_OK;
+    }
+
+    return err;
+}
+
+/*
+ * Stop the built-in event loop
+ */
+int rviStop(TRviHandle handle)
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+
+    ctx->loop.stop = true;
+
+    return RVI_OK;
+}
+
+/*
+ * The body of an I/O worker's thread
+ */
+static void *rviWorkerMain( void *arg )
+{
+    TRviReactor     *reactor    = arg;
+
+    while( !*(volatile bool *)&reactor->stop ) {
+        /* Errors on individual connections don't stop the worker, and its
+         * connections have nowhere else to go */
+        rviReactorRunOnce( reactor->ctx, reactor, -1 );
+    }
+
+    return NULL;
+}
+
+/*
+ * Start I/O workers, each with its own event loop and shard of the 
+ * connections
+ */
+int rviStartWorkers( TRviHandle handle, int count )
+{
+    if( !handle || count < 1 ) { return EINVAL; }
+
+#ifdef HAVE_SYS_EPOLL_H
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviReactor     *workers;
+    TRviRemote      *remote;
+    TRviRemote      *next;
+    uint32_t        seed;
+    int             err     = RVI_OK;
+    int             i;
+    int             n;
+
+    if( ctx->workerCount || ctx->loop.dispatching ) { return EBUSY; }
+
+    /* A worker must never block on one of its connections */
+    if( !ctx->nonblocking ) { return EINVAL; }
+    for( remote = ctx->loop.remotes; remote; remote = remote->shardNext ) {
+        if( !remote->nonblocking ) { return EBUSY; }
+    }
+
+    workers = calloc( count, sizeof( TRviReactor ) );
+    if( !workers ) { return ENOMEM; }
+
+    seed = ctx->loop.jitterState;
+    for( n = 0; n < count; n++ ) {
+        seed = seed * 1103515245 + 12345;
+        if( ( err = rviReactorInitialize( handle, &workers[n], true, seed ) ) ) {
+            rviWorkersRetire( handle, workers, 0, n + 1 );
+            return err;
+        }
+    }
+
+    /* Deal out the open connections before any worker runs */
+    i = 0;
+    for( remote = ctx->loop.remotes; remote; remote = next ) {
+        next = remote->shardNext;
+        rviReactorMove( handle, remote, &workers[i++ % count] );
+    }
+
+    ctx->workers = workers;
+    ctx->workerCount = count;
+
+    for( i = 0; i < count; i++ ) {
+        if( ( err = pthread_create( &workers[i].thread, NULL, rviWorkerMain, 
+                                    &workers[i] ) ) ) {
+            rviWorkersRetire( handle, workers, i, count );
+            return err;
+        }
+    }
+
+    return RVI_OK;
+#else
+    return ENOSYS;
+#endif
+}
+
+/*
+ * Stop the I/O workers, returning their connections to the built-in loop
+ */
+int rviStopWorkers( TRviHandle handle )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    if( !ctx->workerCount ) { return RVI_OK; }
+
+    /* A worker can't wait for itself to finish */
+    if( rviLoopReactor && rviLoopReactor->ctx == ctx && 
+        rviLoopReactor != &ctx->loop ) { 
+        return EDEADLK; 
+    }
+
+    rviWorkersRetire( handle, ctx->workers, ctx->workerCount, 
+                      ctx->workerCount );
+
+    return RVI_OK;
+}
+
+/*
+ * Stop the first started of count I/O workers, wait for them, and free them 
+ * all, moving their connections, including those they had not taken over 
+ * yet, to the built-in loop.
+ */
+void rviWorkersRetire( TRviHandle handle, TRviReactor *workers, 
+                       int started, int count )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviReactor     *reactor;
+    TRviRemote      *remote;
+    TRviRemote      *next;
+    TRviListEntry   *ptr;
+    TRviListEntry   *tmp;
+    int             i;
+
+    for( i = 0; i < started; i++ ) {
+        workers[i].stop = true;
+        __sync_synchronize();
+        rviReactorNotify( &workers[i], 0 );
+    }
+    for( i = 0; i < started; i++ ) {
+        pthread_join( workers[i].thread, NULL );
+    }
+
+    ctx->workers = NULL;
+    ctx->workerCount = 0;
+
+    for( i = 0; i < count; i++ ) {
+        reactor = &workers[i];
+        for( ptr = reactor->inbox.listHead; ptr; ) {
+            tmp = ptr;
+            rviReactorLink( reactor, (TRviRemote *)ptr->pointer );
+            ptr = ptr->next;
+            free( tmp );
+        }
+        rviListInitialize( &reactor->inbox );
+        for( remote = reactor->remotes; remote; remote = next ) {
+            next = remote->shardNext;
+            rviReactorMove( handle, remote, &ctx->loop );
+        }
+        rviReactorFree( handle, reactor );
+    }
+    free( workers );
+}
+
+/*
+ * Bound the output queued for each remote
+ */
+int rviSetSendQueueLimits( TRviHandle handle, size_t highBytes, 
+                           size_t lowBytes, unsigned int highMsgs, 
+                           unsigned int lowMsgs )
+{
+    if( !handle || ( highBytes && lowBytes >= highBytes ) || 
+        ( highMsgs && lowMsgs >= highMsgs ) ) { 
+        return EINVAL; 
+    }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    ctx->queueHighBytes = highBytes;
+    ctx->queueLowBytes = lowBytes;
+    ctx->queueHighMsgs = highMsgs;
+    ctx->queueLowMsgs = lowMsgs;
+
+    return RVI_OK;
+}
+
+/*
+ * Set the callback for connections whose output has drained
+ */
+int rviSetWritableCallback( TRviHandle handle, TRviWritable writable, 
+                            void *writableData )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    ctx->writable = writable;
+    ctx->writableData = writableData;
+
+    return RVI_OK;
+}
+
+/*
+ * Take a snapshot of the statistics of a connection, or of the whole context
+ */
+int rviGetStats( TRviHandle handle, int fd, TRviStats *stats )
+{
+    if( !handle || !stats || fd < -1 ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    int             err     = RVI_OK;
+    int             i;
+
+    rviRegistryRead( ctx );
+    if( fd >= 0 ) {
+        if( ( remote = rviRemoteLookup( handle, fd ) ) ) {
+            pthread_mutex_lock( &remote->lock );
+            *stats = remote->stats;
+            pthread_mutex_unlock( &remote->lock );
+            stats->connections = 1;
+        } else {
+            err = ENXIO;
+        }
+    } else {
+        *stats = ctx->closedStats;
+        for( i = 0; i < ctx->remotesSize; i++ ) {
+            if( !( remote = ctx->remotes[i] ) ) { continue; }
+            pthread_mutex_lock( &remote->lock );
+            rviStatsMerge( stats, &remote->stats );
+            pthread_mutex_unlock( &remote->lock );
+        }
+        stats->connections = ctx->remoteCount;
+    }
+    rviRegistryUnlock( ctx );
+
+    return err;
+}
+
+/*
+ * Start or stop timing the handling of every message
+ */
+int rviSetStatsTiming( TRviHandle handle, bool enable )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    ctx->statsTiming = enable;
+
+    return RVI_OK;
+}
+
+/*
+ * Hand service callbacks to an executor rather than running them on the 
+ * event loop's thread
+ */
+int rviSetExecutor( TRviHandle handle, TRviExecutor executor, 
+                    void *executorData )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    ctx->executor = executor;
+    ctx->executorData = executorData;
+
+    return RVI_OK;
+}
+
+/* ********************** */
+/* RVI SERVICE MANAGEMENT */
+/* ********************** */
+
+
+/* 
+ * Register a service with a callback function
+ */
+int rviRegisterService( TRviHandle handle, const char *serviceName, 
+                          TRviCallback callback, 
+                          void *serviceData )
+{
+    return rviRegisterServiceInternal( handle, serviceName, callback, NULL, 
+                                       serviceData );
+}
+
+/* 
+ * Register a service whose callback is given a view of the parameters as 
+ * they were received
+ */
+int rviRegisterServiceRaw( TRviHandle handle, const char *serviceName, 
+                           TRviRawCallback callback, 
+                           void *serviceData )
+{
+    return rviRegisterServiceInternal( handle, serviceName, NULL, callback, 
+                                       serviceData );
+}
+
+int rviRegisterServiceInternal( TRviHandle handle, const char *serviceName, 
+                                TRviCallback callback, 
+                                TRviRawCallback rawCallback, 
+                                void *serviceData )
+{
+    if( !handle || !serviceName ) { return EINVAL; }
+
+    TRviContext     *ctx        = (TRviContext *)handle;
+    int             err;
+
+    rviRegistryWrite( ctx );
+    err = rviRegisterServiceLocked( handle, serviceName, callback, 
+                                    rawCallback, serviceData );
+    rviRegistryUnlock( ctx );
+
+    return err;
+}
+
+/* 
+ * Register a service, holding the registry lock for writing 
+ */
+int rviRegisterServiceLocked( TRviHandle handle, const char *serviceName, 
+                              TRviCallback callback, 
+                              TRviRawCallback rawCallback, 
+                              void *serviceData )
+{
+    if( !serviceName ) { return EINVAL; }
+
+    int             err         = 0;
+    TRviContext     *ctx        =   (TRviContext *)handle;
+    TRviService     *service    = NULL;
+    char            *fqsn       = NULL;
+
+    fqsn = rviFqsnGet( handle, serviceName );
+    if( !fqsn ) { return ENOMEM; }
+    
+    rviRightsIndexExpire( &ctx->rightsIdx, time( NULL ) );
+    if( (err = rviRightToReceiveError( &ctx->rightsIdx, fqsn ) ) ) {
+        goto exit;
+    }
+
+    /* Create a new TRviService structure */
+    service = rviServiceCreate( fqsn, 0, callback, serviceData );
+    if( !service ) { err = ENOMEM; goto exit; }
+    service->rawCallback = rawCallback;
+
+    /* Add service to the service indexes */
+    if( ( err = rviServiceIndexInsert( handle, service ) ) ) {
+        rviServiceDestroy( service );
+        goto exit;
+    }
+
+    if( ctx->deferAnnounce ) {
+        rviAnnounceDefer( handle, service->name, true );
+    } else {
+        rviServiceAnnounce( handle, service, 1 );
+    }
+
+exit:
+    free( fqsn );
+
+    return err;
+}
+
+/* 
+ * Register several services, announcing them together
+ */
+int rviRegisterServices( TRviHandle handle, const char **serviceNames, 
+                         TRviCallback *callbacks, void **serviceData, 
+                         int count )
+{
+    if( !handle || !serviceNames || !callbacks || count < 0 ) { 
+        return EINVAL; 
+    }
+
+    TRviContext     *ctx        = (TRviContext *)handle;
+    bool            deferred;
+    int             err         = RVI_OK;
+    int             ret;
+    int             i;
+
+    /* Other threads see all of the services registered or none of them */
+    rviRegistryWrite( ctx );
+    deferred = ctx->deferAnnounce;
+    ctx->deferAnnounce = true;
+    for( i = 0; i < count; i++ ) {
+        ret = rviRegisterServiceLocked( handle, serviceNames[i], 
+                                        callbacks[i], NULL, 
+                                        serviceData ? serviceData[i] : NULL );
+        if( ret && !err ) { err = ret; }
+    }
+    ctx->deferAnnounce = deferred;
+
+    /* Unless the caller is deferring announcements too, send them now */
+    if( !deferred ) {
+        rviAnnounceFlush( handle );
+    }
+    rviRegistryUnlock( ctx );
+
+    return err;
+}
+
+/* 
+ * Start or stop collecting service announcements
+ */
+int rviDeferAnnounce( TRviHandle handle, bool defer )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+    int         err = RVI_OK;
+
+    rviRegistryWrite( ctx );
+    ctx->deferAnnounce = defer;
+    if( !defer ) {
+        err = rviAnnounceFlush( handle );
+    }
+    rviRegistryUnlock( ctx );
+
+    return err;
+}
+
+/*
+ * Record a change to a local service for a later announcement. A change that
+ * undoes one still pending cancels it, since remotes never heard of either.
+ */
+int rviAnnounceDefer( TRviHandle handle, const char *name, bool available )
+{
+    TRviContext             *ctx    = (TRviContext *)handle;
+    TRviPendingAnnounce     *pending;
+
+    pending = rviHashFind( &ctx->pendingAnnounce, name );
+    if( pending ) {
+        if( pending->available != available ) {
+            rviHashRemove( &ctx->pendingAnnounce, name );
+            free( pending->name );
+            free( pending );
+        }
+        return RVI_OK;
+    }
+
+    pending = malloc( sizeof( TRviPendingAnnounce ) );
+    if( !pending ) { return ENOMEM; }
+    pending->name = strdup( name );
+    pending->available = available;
+    if( !pending->name || 
+        rviHashInsert( &ctx->pendingAnnounce, pending->name, pending ) ) {
+        free( pending->name );
+        free( pending );
+        return ENOMEM;
+    }
+
+    return RVI_OK;
+}
+
+/*
+ * Send the pending changes to the local services. Each remote receives at 
+ * most one "sa" listing the services that became available and one listing 
+ * those that went away, filtered by the services it may invoke.
+ */
+int rviAnnounceFlush( TRviHandle handle )
+{
+    TRviContext             *ctx    = (TRviContext *)handle;
+    TRviPendingAnnounce     *pending;
+    TRviRemote              *remote;
+    const char              **names = NULL;
+    size_t                  index   = 0;
+    int                     count;
+    int                     av      = 0;
+    int                     un;
+    int                     err     = RVI_OK;
+    int                     ret;
+    int                     fd;
+
+    count = rviHashGetCount( &ctx->pendingAnnounce );
+    if( !count ) { return RVI_OK; }
+
+    /* Available services go at the front, unavailable ones at the back */
+    names = malloc( count * sizeof( char * ) );
+    if( !names ) { return ENOMEM; }
+    un = count;
+    while( ( pending = rviHashNext( &ctx->pendingAnnounce, &index ) ) ) {
+        if( pending->available ) {
+            names[av++] = pending->name;
+        } else {
+            names[--un] = pending->name;
+        }
+    }
+
+    for( fd = 0; fd < ctx->remotesSize; fd++ ) {
+        if( !( remote = ctx->remotes[fd] ) ) { continue; }
+        ret = rviWriteSa( handle, remote, names, av, true );
+        if( ret && !err ) { err = ret; }
+        ret = rviWriteSa( handle, remote, names + un, count - un, false );
+        if( ret && !err ) { err = ret; }
+    }
+    free( names );
+
+    index = 0;
+    while( ( pending = rviHashNext( &ctx->pendingAnnounce, &index ) ) ) {
+        free( pending->name );
+        free( pending );
+    }
+    rviHashClear( &ctx->pendingAnnounce );
+
+    return err;
+}
+
+/*
+ * Send one "sa" message announcing the services in names that the remote may 
+ * invoke. Nothing is sent if it may invoke none of them. The message is 
+ * composed directly, without building a JSON tree. Called with the registry
+ * lock held for writing.
+ */
+int rviWriteSa( TRviHandle handle, TRviRemote *remote, const char **names, 
+                int count, bool available )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviBuffer      *out    = &ctx->obuf;
+    int             sent    = 0;
+    int             err     = RVI_OK;
+    int             i;
+
+    static const char avHead[] = "{\"cmd\":\"sa\",\"stat\":\"av\",\"svcs\":[";
+    static const char unHead[] = "{\"cmd\":\"sa\",\"stat\":\"un\",\"svcs\":[";
+
+    rviRightsIndexExpire( &remote->rightsIdx, time( NULL ) );
+    rviBufferClear( out );
+    if( rviBufferAppend( out, available ? avHead : unHead, 
+                         sizeof( avHead ) - 1 ) ) {
+        err = ENOMEM;
+        goto exit;
+    }
+    for( i = 0; i < count; i++ ) {
+        if( rviRightToInvokeError( &remote->rightsIdx, names[i] ) ) {
+            continue; /* If the remote can't invoke, don't announce */
+        }
+        if( ( sent && rviBufferAppend( out, ",", 1 ) ) ||
+            rviBufferAppendJsonString( out, names[i] ) ) {
+            err = ENOMEM;
+            goto exit;
+        }
+        sent++;
+    }
+    if( !sent ) { goto exit; }
+    if( rviBufferAppend( out, "]}", 2 ) ) { err = ENOMEM; goto exit; }
+
+    if(verbose){
+        fprintf(stderr, "rviWriteSa, sending: '%.*s'\n", 
+                (int)rviBufferLength( out ), rviBufferData( out ) );
+    }
+
+    err = rviRemoteWrite( handle, remote, rviBufferData( out ), 
+                          rviBufferLength( out ) );
+
+exit:
+    rviBufferClear( out );
+
+    return err;
+}
+
+/* 
+ * Unregister a previously registered service
+ */
+int rviUnregisterService(TRviHandle handle, const char *serviceName)
+{
+    if( !handle || !serviceName ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    int             err     = RVI_OK;
+    char            *fqsn   = NULL;
+    
+    fqsn = rviFqsnGet( handle, serviceName );
+    if( !fqsn ) { return ENOMEM; }
+
+    rviRegistryWrite( ctx );
+    TRviService *stmp = rviServiceLookup( handle, fqsn );
+    
+    if( !stmp ) {
+        err = -ENXIO;
+        goto exit;
+    }
+
+    if( stmp->registrant != 0 ) {
+        err = -RVI_ERR_RIGHTS;
+        goto exit;
+    }
+
+    if( ctx->deferAnnounce ) {
+        rviAnnounceDefer( handle, stmp->name, false );
+    } else {
+        rviServiceAnnounce( handle, stmp, 0 );
+    }
+
+    err = rviRemoveService( handle, fqsn );
+
+exit:
+    rviRegistryUnlock( ctx );
+    free( fqsn );
+
+    return err;
+}
+
+int rviRemoveService(TRviHandle handle, const char *serviceName)
+{
+    if( !handle || !serviceName ) { return EINVAL; }
+
+    TRviService *stmp = rviServiceLookup( handle, serviceName );
+    
+    if( !stmp ) { return ENOENT; }
+    rviServiceIndexRemove( handle, stmp );
+    rviServiceDestroy( stmp );
+
+    return RVI_OK;
+}
+
+/* State for copying service names out while walking serviceNameIdx */
+typedef struct TRviServiceNames {
+    char **result;
+    int len;    /* Capacity of result */
+    int count;  /* Names copied so far */
+} TRviServiceNames;
+
+static int rviCollectServiceName( void *record, void *context )
+{
+    TRviService *service = record;
+    TRviServiceNames *names = context;
+
+    if( names->count == names->len )
+        return 1;
+    names->result[names->count++] = strdup( service->name );
+
+    return 0;
+}
+
+/* 
+ * Get list of services available
+ */
+int rviGetServices(TRviHandle handle, char **result, int *len)
+{
+    if( !handle || !result || ( *len < 1 ) ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+
+    TRviServiceNames names = { result, *len, 0 };
+
+    rviRegistryRead( ctx );
+    if( ctx->serviceNameIdx->count ) {
+        btree_foreach( ctx->serviceNameIdx, rviCollectServiceName, &names );
+    }
+    rviRegistryUnlock( ctx );
+    *len = names.count;
+
+    return RVI_OK;
+}
+
+/* 
+ * Invoke a remote service
+ */
+int rviInvokeService(TRviHandle handle, const char *serviceName, 
+                              const char *parameters)
+{
+    if( !parameters ) { return RVI_ERR_JSON; }
+
+    return rviInvokeServiceRaw( handle, serviceName, parameters, 
+                                strlen( parameters ) );
+}
+
+/* 
+ * Invoke a remote service with parameters in a length-delimited buffer. The 
+ * rcv message is written straight to the connection with the parameters 
+ * copied in verbatim, after the checks selected by rviSetValidation().
+ */
+int rviInvokeServiceRaw(TRviHandle handle, const char *serviceName, 
+                        const char *parameters, size_t len)
+{
+    if( !handle || !serviceName ) { return EINVAL; }
+
+    TRviContext *ctx = (TRviContext *)handle;
+    TRviService *stmp = NULL;
+    TRviRemote *rtmp = NULL;
+    int ret;
+    
+    /* Check the parameters before holding up changes to the registry */
+    if( ( ret = rviCheckParameters( handle, parameters, len ) ) ) { 
+        return ret; 
+    }
 
-    stmp = btree_search(ctx->serviceNameIdx, &skey);
+    /* The remote stays connected while the lock is held */
+    rviRegistryRead( ctx );
+
+    /* get service from service name index */
+    stmp = rviServiceLookup( handle, serviceName );
     if( !stmp ) { ret = ENOENT; goto exit; }
 
     /* identify registrant, get SSL session from remote index */
-    rkey.fd = stmp->registrant;
-
-    rtmp = btree_search(ctx->remoteIdx, &rkey);
+    rtmp = rviRemoteLookup( handle, stmp->registrant );
     if( !rtmp ) { ret = ENXIO; goto exit; }
 
-    time(&rawtime);
-    timeout = rawtime + wait;
-
-    /* prepare rcv message */
-    if( parameters ) {
-        params = json_loads( parameters, 0, NULL );
-    }
-    if ( !params ) { ret = RVI_ERR_JSON; goto exit; }
-
-    rcv = json_pack( 
-            "{s:s, s:i, s:s, s:{s:s, s:I, s:o}}",
-            "cmd", "rcv",
-            "tid", 1, /* TODO: talk to Ulf about tid */
-            "mod", "proto_json_rpc",
-            "data", "service", serviceName,
-                    "timeout", timeout,
-                    "parameters", params
-            );
-    if( ! rcv ) {
-        fprintf(stderr, "JSON error\n");
-        ret = RVI_ERR_JSON;
-        goto exit;
+    ret = rviRemoteWriteRcv( handle, rtmp, serviceName, rviNextTid( ctx ), 
+                             rviWallMs( handle ) + ctx->invokeTimeout, 
+                             parameters, len );
+
+exit:
+    rviRegistryUnlock( ctx );
+
+    return ret;
+}
+
+/*
+ * Set the lifetime of the invocations sent by rviInvokeService()
+ */
+int rviSetInvokeTimeout( TRviHandle handle, int timeoutMs )
+{
+    if( !handle || timeoutMs < 1 ) { return EINVAL; }
+
+    ( (TRviContext *)handle )->invokeTimeout = timeoutMs;
+
+    return RVI_OK;
+}
+
+/*
+ * Current wall clock time in milliseconds, which invocation deadlines are 
+ * expressed in since they are compared on another node. The result never 
+ * goes backwards, so a clock stepped back does not extend the life of the 
+ * messages sent after it.
+ */
+long long rviWallMs( TRviHandle handle )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    struct timespec now;
+    long long       ms;
+    long long       last;
+    long long       prev;
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    ms = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    /* Any thread may advance it, but none may move it back */
+    last = ctx->lastWallMs;
+    while( ms > last ) {
+        prev = __sync_val_compare_and_swap( &ctx->lastWallMs, last, ms );
+        if( prev == last ) { return ms; }
+        last = prev;
     }
 
-    char *rcvString = json_dumps(rcv, JSON_COMPACT);
+    return last;
+}
+
+/*
+ * Return true if the "timeout" of an invocation has passed. Older peers send
+ * the deadline in seconds, which is recognized by its magnitude.
+ */
+bool rviDeadlinePassed( TRviHandle handle, long long timeout )
+{
+    long long       now     = rviWallMs( handle );
 
-    /* send rcv message to registrant */
+    if( timeout < RVI_TIMEOUT_MS_MIN ) { return now / 1000 > timeout; }
 
-    if(verbose){
-        fprintf(stderr, "rviInvokeService, sending: '%s'\n", rcvString);
+    return now > timeout;
+}
+
+/*
+ * Return true if a message is an "rcv" whose deadline has passed, judged from
+ * its text alone. Anything that cannot be judged this way is left for 
+ * rviReadRcv() to check.
+ */
+bool rviRcvExpired( TRviHandle handle, const char *raw, size_t len )
+{
+    const char      *cmd;
+    const char      *data;
+    const char      *value;
+    size_t          cmdLen;
+    size_t          dataLen;
+    size_t          valueLen;
+    long long       timeout = 0;
+    size_t          i;
+
+    if( !rviJsonFindMember( raw, len, "cmd", &cmd, &cmdLen ) ||
+        cmdLen != 5 || memcmp( cmd, "\"rcv\"", 5 ) != 0 ||
+        !rviJsonFindMember( raw, len, "data", &data, &dataLen ) ||
+        !rviJsonFindMember( data, dataLen, "timeout", &value, &valueLen ) ||
+        valueLen == 0 || valueLen > 18 ) {
+        return false;
+    }
+    for( i = 0; i < valueLen; i++ ) {
+        if( value[i] < '0' || value[i] > '9' ) { return false; }
+        timeout = timeout * 10 + ( value[i] - '0' );
+    }
+
+    return rviDeadlinePassed( handle, timeout );
+}
+
+/*
+ * The same check for the MessagePack payload of a binary frame.
+ */
+bool rviRcvFrameExpired( TRviHandle handle, const char *raw, size_t len )
+{
+    const char      *cmd;
+    const char      *data;
+    const char      *value;
+    size_t          cmdLen;
+    size_t          dataLen;
+    size_t          valueLen;
+    long long       timeout;
+
+    if( !rviMsgpackFindMember( raw, len, "cmd", &cmd, &cmdLen ) ||
+        cmdLen != 4 || memcmp( cmd, "\xa3" "rcv", 4 ) != 0 ||
+        !rviMsgpackFindMember( raw, len, "data", &data, &dataLen ) ||
+        !rviMsgpackFindMember( data, dataLen, "timeout", &value, &valueLen ) ||
+        !rviMsgpackGetInteger( value, valueLen, &timeout ) || timeout < 0 ) {
+        return false;
+    }
+
+    return rviDeadlinePassed( handle, timeout );
+}
+
+/*
+ * Check JSON text to be sent to a remote according to the mode selected by
+ * rviSetValidation().
+ */
+int rviCheckParameters( TRviHandle handle, const char *parameters, 
+                        size_t len )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviReactor     *loop   = rviLoopReactor;
+    json_t          *params = NULL;
+    TRviJsonScope   scope;
+
+    if( !parameters ) { return RVI_ERR_JSON; }
+    if( loop && loop->ctx != ctx ) { loop = NULL; }
+
+    switch( ctx->validation ) {
+    case RVI_VALIDATE_FULL:
+        /* 
+         * Parse the parameters just to check them, in the arena if this is
+         * the thread running one of the context's event loops, which owns 
+         * it, and otherwise on the heap. 
+         */
+        if( loop ) {
+            rviJsonScopeBegin( &scope, &loop->msgArena );
+        }
+        params = json_loadb( parameters, len, 0, NULL );
+        json_decref( params );
+        if( loop ) {
+            rviJsonScopeEnd( &scope );
+        }
+        if( !params ) { return RVI_ERR_JSON; }
+        break;
+    case RVI_VALIDATE_STRUCTURE:
+        /* A single balanced object or array keeps the framing intact */
+        if( !rviFramerValidate( parameters, len ) ) { return RVI_ERR_JSON; }
+        break;
+    default:
+        break;
+    }
+
+    return RVI_OK;
+}
+
+/* 
+ * Invoke a remote service and arrange for the reply to be delivered to a
+ * completion callback
+ */
+int rviInvokeServiceAsync( TRviHandle handle, const char *serviceName, 
+                           const char *parameters, size_t len, 
+                           int timeoutMs, TRviCompletion completion, 
+                           void *callData, long long *tid )
+{
+    if( !handle || !serviceName || !completion || timeoutMs < 0 ) { 
+        return EINVAL; 
     }
 
-    ret = BIO_puts(rtmp->sbio, rcvString);
-    if (ret < 0) {
-        /* The connection was likely closed by the peer, attempt to resume */
-        rviResumeConnection(handle, rtmp->fd);
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviService     *stmp;
+    TRviRemote      *rtmp;
+    TRviPendingCall *call;
+    long long       id;
+    long long       deadline;
+    int             ret;
+
+    if( ( ret = rviCheckParameters( handle, parameters, len ) ) ) { 
+        return ret; 
     }
 
-    free(rcvString);
-    json_decref(rcv);
+    call = rviSharedAlloc( &rviCallPool );
+    if( !call ) { return ENOMEM; }
+    call->tid = id = rviNextTid( ctx );
+    call->completion = completion;
+    call->data = callData;
+    call->tick = ( rviNowMs() + timeoutMs ) / RVI_WHEEL_TICK_MS;
+
+    /* The remote stays connected while the lock is held */
+    rviRegistryRead( ctx );
+
+    stmp = rviServiceLookup( handle, serviceName );
+    rtmp = stmp ? rviRemoteLookup( handle, stmp->registrant ) : NULL;
+    if( !rtmp ) { 
+        rviRegistryUnlock( ctx );
+        rviSharedRelease( &rviCallPool, call );
+        return stmp ? ENXIO : ENOENT; 
+    }
+    call->fd = rtmp->fd;
+
+    /* The call is pending before the reply can possibly arrive */
+    pthread_mutex_lock( &ctx->callLock );
+    if( rviHashInsert( &ctx->pendingCalls, &call->tid, call ) ) {
+        pthread_mutex_unlock( &ctx->callLock );
+        rviRegistryUnlock( ctx );
+        rviSharedRelease( &rviCallPool, call );
+        return ENOMEM;
+    }
+    rviCallSchedule( handle, call );
+    deadline = ( call->tick + 1 ) * RVI_WHEEL_TICK_MS;
+    pthread_mutex_unlock( &ctx->callLock );
+    /* A worker sleeping past the timeout must wake up for it */
+    rviReactorNotify( rviCallsReactor( handle ), deadline );
+
+    /* The callee may drop the invocation once the caller stops waiting */
+    ret = rviRemoteWriteRcv( handle, rtmp, serviceName, id, 
+                             rviWallMs( handle ) + timeoutMs, 
+                             parameters, len );
+    rviRegistryUnlock( ctx );
+    if( ret ) {
+        /* 
+         * The reply will never come; the completion is not called, unless
+         * the event loop has already failed the call in the meantime. 
+         */
+        pthread_mutex_lock( &ctx->callLock );
+        if( ( call = rviHashRemove( &ctx->pendingCalls, &id ) ) ) {
+            rviCallUnlink( handle, call );
+        }
+        pthread_mutex_unlock( &ctx->callLock );
+        rviSharedRelease( &rviCallPool, call );
+        return ret;
+    }
 
-    ret = 0;
+    /* The call may already have been completed, and freed, by now */
+    if( tid ) { *tid = id; }
 
-exit:
-    free(skey.name);
+    return RVI_OK;
+}
+
+/* 
+ * Send the result of a service invocation back to the caller
+ */
+int rviReplyService( TRviHandle handle, int fd, long long tid, 
+                     const char *result, size_t len )
+{
+    if( !handle ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *rtmp;
+    int             ret;
+
+    if( ( ret = rviCheckParameters( handle, result, len ) ) ) { return ret; }
+
+    rviRegistryRead( ctx );
+    rtmp = rviRemoteLookup( handle, fd );
+    ret = rtmp ? rviRemoteWriteRpl( handle, rtmp, tid, result, len ) : ENXIO;
+    rviRegistryUnlock( ctx );
 
     return ret;
 }
 
+/*
+ * Link a pending call into the wheel slot for its tick. A call already due
+ * goes in the slot expired next.
+ */
+void rviCallSchedule( TRviHandle handle, TRviPendingCall *call )
+{
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviPendingCall     **slot;
+
+    if( call->tick < ctx->wheelTick ) { call->tick = ctx->wheelTick; }
+
+    slot = &ctx->wheel[ call->tick & ( RVI_WHEEL_SLOTS - 1 ) ];
+    call->prev = NULL;
+    call->next = *slot;
+    if( *slot ) { (*slot)->prev = call; }
+    *slot = call;
+}
+
+/*
+ * Unlink a pending call from its wheel slot
+ */
+void rviCallUnlink( TRviHandle handle, TRviPendingCall *call )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+
+    if( call->prev ) {
+        call->prev->next = call->next;
+    } else {
+        ctx->wheel[ call->tick & ( RVI_WHEEL_SLOTS - 1 ) ] = call->next;
+    }
+    if( call->next ) { call->next->prev = call->prev; }
+}
+
+/*
+ * Complete a list of calls, linked through next, that have already been
+ * removed from the pending table, and free them. The list is detached first
+ * so the completions may make new calls.
+ */
+void rviCallsComplete( TRviPendingCall *list, int status )
+{
+    TRviPendingCall     *call;
+    bool                paused;
+
+    while( ( call = list ) ) {
+        list = call->next;
+        paused = rviJsonScopePause();
+        call->completion( call->fd, call->data, call->tid, status, NULL, 0 );
+        rviJsonScopeResume( paused );
+        rviSharedRelease( &rviCallPool, call );
+    }
+}
+
+/*
+ * Time out every pending call whose tick has passed. Each slot between the
+ * last tick expired and now is visited once, so the work done is bounded by
+ * the size of the wheel however long it has been since the last pass.
+ */
+void rviCallsExpire( TRviHandle handle )
+{
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviPendingCall     *expired = NULL;
+    TRviPendingCall     *call;
+    TRviPendingCall     *next;
+    long long           now;
+    long long           steps;
+    long long           i;
+
+    now = rviNowMs() / RVI_WHEEL_TICK_MS;
+
+    pthread_mutex_lock( &ctx->callLock );
+    if( now <= ctx->wheelTick ) { 
+        pthread_mutex_unlock( &ctx->callLock );
+        return; 
+    }
+    steps = now - ctx->wheelTick;
+    if( steps > RVI_WHEEL_SLOTS ) { steps = RVI_WHEEL_SLOTS; }
+
+    if( rviHashGetCount( &ctx->pendingCalls ) ) {
+        for( i = 0; i < steps; i++ ) {
+            call = ctx->wheel[ ( ctx->wheelTick + i ) & ( RVI_WHEEL_SLOTS - 1 ) ];
+            for( ; call; call = next ) {
+                next = call->next;
+                if( call->tick >= now ) { continue; } /* A later lap */
+                rviCallUnlink( handle, call );
+                rviHashRemove( &ctx->pendingCalls, &call->tid );
+                call->next = expired;
+                expired = call;
+            }
+        }
+    }
+    ctx->wheelTick = now;
+    pthread_mutex_unlock( &ctx->callLock );
+
+    rviCallsComplete( expired, RVI_ERR_TIMEOUT );
+}
+
+/*
+ * Complete every pending call made on a connection with an error
+ */
+void rviCallsFail( TRviHandle handle, int fd, int status )
+{
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviPendingCall     *failed = NULL;
+    TRviPendingCall     *call;
+    size_t              index   = 0;
+
+    pthread_mutex_lock( &ctx->callLock );
+
+    /* Collect the calls first, since removing them reorders the table */
+    while( ( call = rviHashNext( &ctx->pendingCalls, &index ) ) ) {
+        if( call->fd != fd ) { continue; }
+        rviCallUnlink( handle, call );
+        call->next = failed;
+        failed = call;
+    }
+    for( call = failed; call; call = call->next ) {
+        rviHashRemove( &ctx->pendingCalls, &call->tid );
+    }
+
+    pthread_mutex_unlock( &ctx->callLock );
+
+    rviCallsComplete( failed, status );
+}
+
+/*
+ * Return the monotonic time (ms) at which the next pending call times out, or
+ * 0 if there are none. Calls are timed out once their tick has passed.
+ */
+long long rviCallsNextDeadline( TRviHandle handle )
+{
+    TRviContext         *ctx    = (TRviContext *)handle;
+    TRviPendingCall     *call;
+    long long           tick;
+    long long           deadline;
+    int                 i;
+
+    pthread_mutex_lock( &ctx->callLock );
+
+    if( !rviHashGetCount( &ctx->pendingCalls ) ) { 
+        deadline = 0;
+        goto exit;
+    }
+
+    for( i = 0; i < RVI_WHEEL_SLOTS; i++ ) {
+        tick = ctx->wheelTick + i;
+        call = ctx->wheel[ tick & ( RVI_WHEEL_SLOTS - 1 ) ];
+        for( ; call; call = call->next ) {
+            if( call->tick <= tick ) { 
+                deadline = ( tick + 1 ) * RVI_WHEEL_TICK_MS; 
+                goto exit;
+            }
+        }
+    }
+
+    /* Everything is at least a lap away; look again after one lap */
+    deadline = ( ctx->wheelTick + RVI_WHEEL_SLOTS ) * RVI_WHEEL_TICK_MS;
+
+exit:
+    pthread_mutex_unlock( &ctx->callLock );
+
+    return deadline;
+}
+
 /* ************** */
 /* I/O MANAGEMENT */
 /* ************** */
@@ -1652,129 +6019,330 @@ int rviProcessInput(TRviHandle handle, int *fdArr, int fdLen)
     if( !handle || !fdArr || ( fdLen < 1 ) ) { return EINVAL; }
 
     TRviContext   *ctx    = (TRviContext *)handle;
-    TRviRemote    rkey    = {0};
     TRviRemote    *rtmp   = NULL;
-    char            cmd[5]  = {0};
-
-    SSL             *ssl    = NULL;
-    json_t          *root   = NULL;
 
-    int             len     = 0;
-    int             read    = 0;
-    char            *buf    = {0};
-    long            mode    = 0;
     int             i       = 0;
     int             err     = 0;
 
+    /* The workers read from every connection */
+    if( ctx->workerCount ) { return EBUSY; }
+
+    ctx->loop.loopMs = rviNowMs();
+    rviLoopReactor = &ctx->loop;
 
     /* For each file descriptor we've received */
     while( i < fdLen ) {
-        rkey.fd = fdArr[i]; /* Set the key to the requested fd */
-        i++;
-        rtmp = btree_search( ctx->remoteIdx, &rkey ); /* Find the connection */
+        rtmp = rviRemoteLookup( handle, fdArr[i] ); /* Find the connection */
         if( !rtmp ) {
             err = ENXIO;
-            fprintf( stderr, "No connection on %d\n", rkey.fd );
+            fprintf( stderr, "No connection on %d\n", fdArr[i] );
+            i++;
+            continue;
+        }
+        i++;
+        ctx->loop.dispatching++;
+        err = rviRemoteProcess( handle, rtmp );
+        ctx->loop.dispatching--;
+        if( err == ENOMEM ) { goto exit; }
+    }
+
+exit:
+    rviTimersDue( handle, &ctx->loop );
+
+    if( !ctx->loop.dispatching ) { rviReapRemotes( handle, &ctx->loop ); }
+
+    return err;
+}
+
+/*
+ * Process input on a single remote connection. A blocking connection reads
+ * and dispatches one message. A non-blocking connection first advances the
+ * handshake and flushes queued output, then reads and dispatches messages
+ * until no more data is available.
+ */
+int rviRemoteProcess( TRviHandle handle, TRviRemote *remote )
+{
+    if( !handle || !remote ) { return EINVAL; }
+
+    SSL             *ssl    = NULL;
+    int             read    = 0;
+    long            mode    = 0;
+    int             err     = 0;
+    bool            lost    = false;
+
+    if( remote->state == RVI_REMOTE_BACKOFF ) { return RVI_OK; }
+
+    /* Drive the handshake of a new or reopened connection */
+    if( ( err = rviRemoteAdvance( handle, remote ) ) ) { 
+        rviRemoteBackoff( handle, remote );
+        return err; 
+    }
+
+    /* 
+     * The lock is held while using the connection, but not while dispatching
+     * the messages read, so that the callbacks, and other threads, can write
+     * to the remote. Only this thread touches the receive buffer. 
+     */
+    pthread_mutex_lock( &remote->lock );
+
+    if( remote->nonblocking ) {
+        /* Output held for coalescing waits for its deadline */
+        if( rviBufferLength( &remote->wbuf ) && 
+            remote->state != RVI_REMOTE_HANDSHAKE &&
+            ( !remote->flushDeadline || remote->flushDeadline <= rviNowMs() ) ) {
+            if( ( err = rviRemoteFlush( handle, remote ) ) ) { goto exit; }
+        }
+    } else if( rviBufferLength( &remote->wbuf ) && 
+               remote->state != RVI_REMOTE_HANDSHAKE ) {
+        /* The peer may be waiting for held output before it replies */
+        if( ( err = rviRemoteFlush( handle, remote ) ) ) { goto exit; }
+    }
+
+    BIO_get_ssl(remote->sbio, &ssl);
+    if( !ssl ) {
+        fprintf( stderr, "Error reading on fd %d, try again\n", remote->fd );
+        err = RVI_ERR_OPENSSL;
+        goto exit;
+    }
+
+    if( !remote->nonblocking ) {
+        /* Grab the current mode flags from the session */
+        mode = SSL_get_mode ( ssl );
+        /* Ensure our mode is blocking */
+        SSL_set_mode( ssl, SSL_MODE_AUTO_RETRY );
+    }
+
+    /* Blocking connections read once; non-blocking ones read until empty */
+    do {
+        /* Reads are not possible until the handshake is complete */
+        if( remote->state == RVI_REMOTE_HANDSHAKE ) { break; }
+        /* A callback may have disconnected or reset the remote */
+        if( remote->closed || remote->state == RVI_REMOTE_BACKOFF ) { break; }
+
+        /* Read directly into the free space at the end of the buffer */
+        if( rviBufferReserve( &remote->rbuf, TLS_BUFSIZE ) ) { 
+            err = ENOMEM;
+            break; 
+        }
+
+        read = SSL_read(ssl, rviBufferTail( &remote->rbuf ), TLS_BUFSIZE);
+
+        if( read  <= 0 )  {
+            err = SSL_get_error(ssl, read);
+            if( remote->nonblocking && err == SSL_ERROR_WANT_READ ) {
+                /* Everything available has been read */
+                err = RVI_OK;
+            } else if( remote->nonblocking && err == SSL_ERROR_WANT_WRITE ) {
+                rviRemoteSetEvents( handle, remote, 
+                                    remote->events | POLLOUT );
+                err = RVI_OK;
+            } else if (err != SSL_ERROR_NONE) {
+                /* The peer probably closed the connection, so reopen it */
+                lost = true;
+            }
+            break;
+        } 
+
+        if(verbose){
+            fprintf(stderr, "rviProcessInput, received %d bytes, : '%.*s'\n", 
+                    read, read, rviBufferTail( &remote->rbuf ) );
+        }
+
+        rviBufferCommit( &remote->rbuf, read );
+        remote->stats.bytesIn += read;
+        /* The peer is alive */
+        remote->lastRxMs = remote->reactor->loopMs;
+        remote->pingSent = false;
+
+        pthread_mutex_unlock( &remote->lock );
+        err = rviReadMessages( handle, remote );
+        pthread_mutex_lock( &remote->lock );
+    } while( remote->nonblocking && err != ENOMEM );
+
+    if( !remote->nonblocking ) {
+        /* Set the mode back to its original bitmask */
+        SSL_set_mode( ssl, mode );
+    }
+
+exit:
+    /* Writes, here or from other threads, may have found it lost as well */
+    lost = ( lost || remote->lost ) && !remote->closed && 
+           remote->state != RVI_REMOTE_BACKOFF;
+    pthread_mutex_unlock( &remote->lock );
+
+    if( lost ) { rviRemoteBackoff( handle, remote ); }
+
+    return err;
+}
+
+/*
+ * Find the next complete message in the remote's read buffer. Binary frames
+ * are only looked for between JSON messages, once MessagePack has been
+ * negotiated, and never inside a JSON message the framer is partway through.
+ */
+static size_t rviRemoteNextFrame( TRviRemote *remote, bool *binary )
+{
+    const char  *data;
+    size_t      skip    = 0;
+
+    *binary = false;
+    if( remote->binaryIn && !rviFramerPending( &remote->framer ) ) {
+        data = rviBufferData( &remote->rbuf );
+        while( skip < rviBufferLength( &remote->rbuf ) && 
+               isspace( (unsigned char)data[skip] ) ) {
+            skip++;
+        }
+        rviBufferConsume( &remote->rbuf, skip );
+        if( rviMsgpackIsFrame( &remote->rbuf ) ) {
+            *binary = true;
+            return rviMsgpackFrameNext( &remote->rbuf );
+        }
+    }
+
+    return rviFramerNext( &remote->framer, &remote->rbuf );
+}
+
+/*
+ * Parse and dispatch every complete message in a remote's receive buffer.
+ * Messages are found by the framer in a single pass over the new data and
+ * parsed in place; only a trailing partial message is left in the buffer.
+ *
+ * Returns RVI_ERR_JSON_PART if a partial message remains, which is not
+ * strictly an error condition.
+ */
+int rviReadMessages( TRviHandle handle, TRviRemote *remote )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviJsonScope   scope;
+    json_error_t    error;
+    json_t          *root   = NULL;
+    size_t          len;
+    long long       start;
+    bool            binary;
+    int             err     = RVI_OK;
+
+    while( !remote->closed && !remote->verify &&
+           ( len = rviRemoteNextFrame( remote, &binary ) ) ) {
+        remote->stats.msgsIn++;
+        RVI_PROBE2( message__received, remote->fd, len );
+        /* Drop stale invocations before spending any time on them */
+        if( binary ? 
+            rviRcvFrameExpired( handle, rviBufferData( &remote->rbuf ) + 
+                                RVI_FRAME_HEADER, len - RVI_FRAME_HEADER ) :
+            rviRcvExpired( handle, rviBufferData( &remote->rbuf ), len ) ) {
+            rviBufferConsume( &remote->rbuf, len );
+            err = RVI_ERR_TIMEOUT;
             continue;
         }
-        BIO_get_ssl(rtmp->sbio, &ssl);
-        if( !ssl ) {
-            err = RVI_ERR_OPENSSL;
-            fprintf( stderr, "Error reading on fd %d, try again\n", rtmp->fd );
-            continue;
+        /* The message and everything built to handle it share one arena */
+        rviJsonScopeBegin( &scope, &remote->reactor->msgArena );
+        start = rviStatsStart( ctx );
+        if( binary ) {
+            root = rviMsgpackDecode( rviBufferData( &remote->rbuf ) + 
+                                     RVI_FRAME_HEADER, 
+                                     len - RVI_FRAME_HEADER );
+        } else {
+            root = json_loadb( rviBufferData( &remote->rbuf ), len, 0, 
+                               &error );
         }
-        /* Grab the current mode flags from the session */
-        mode = SSL_get_mode ( ssl );
-        /* Ensure our mode is blocking */
-        SSL_set_mode( ssl, SSL_MODE_AUTO_RETRY );
-
-        len = rtmp->buflen;
-#ifdef RVI_MAX_MSG_SIZE
-        if ((TLS_BUFSIZE + len) > RVI_MAX_MSG_SIZE) {
-            /* Exceeded maximum message size */
-            memset(rtmp->buf, 0, rtmp->buflen);
-            free(rtmp->buf);
-            rtmp->buf = NULL;
-            rtmp->buflen = 0;
-            len = 0;
-            err = RVI_ERR_JSON; continue;
+        rviStatsSince( &remote->stats.parse, start );
+        if( root ) {
+            /* Binary frames have no JSON text to hand to raw consumers */
+            err = rviDispatchMessage( handle, root, 
+                                      binary ? NULL : 
+                                      rviBufferData( &remote->rbuf ), 
+                                      binary ? 0 : len, remote );
+            json_decref( root );
+        } else {
+            err = RVI_ERR_JSON;
         }
-#endif
-        buf = malloc(TLS_BUFSIZE + len + 1);
-        if(!buf) { err = ENOMEM; goto exit; }
-        memset(buf, 0, TLS_BUFSIZE + len + 1);
-        if(len) {
-            memcpy(buf, rtmp->buf, len);
-            memset(rtmp->buf, 0, len);
-            free(rtmp->buf);
-            rtmp->buflen = 0; 
-            rtmp->buf = NULL;
+        rviJsonScopeEnd( &scope );
+        /* The remote may have been reset while handling the message */
+        if( rviBufferLength( &remote->rbuf ) >= len ) {
+            rviBufferConsume( &remote->rbuf, len );
         }
+    }
 
-        read = SSL_read(ssl, &buf[len], TLS_BUFSIZE);
+    if( rviBufferLength( &remote->rbuf ) > remote->stats.carryHighWater ) {
+        remote->stats.carryHighWater = rviBufferLength( &remote->rbuf );
+    }
 
-        if( read  <= 0 )  {
-            err = SSL_get_error(ssl, read);
-            if (err != SSL_ERROR_NONE) {
-                /* The peer probably closed the connection, so reopen it */
-                rviResumeConnection(handle, rkey.fd);
-            }
-            free(buf);
-            continue;
-        } 
-        if(verbose){
-            fprintf(stderr, "rviProcessInput, received %d bytes, : '%s'\n", read, buf);
+    /* Messages held for a credential check are dispatched by rviVerifyDue() */
+    if( rviBufferLength( &remote->rbuf ) && !remote->verify ) {
+#ifdef RVI_MAX_MSG_SIZE
+        if( rviBufferLength( &remote->rbuf ) > RVI_MAX_MSG_SIZE ) {
+            /* Exceeded maximum message size */
+            rviBufferClear( &remote->rbuf );
+            rviFramerInitialize( &remote->framer );
+            return RVI_ERR_JSON;
         }
-        err = rviReadJsonChunk(&root, buf, rtmp); // rviReadJsonChunk returns
-                                                  // non-zero if there's data
-                                                  // remaining: not strictly an
-                                                  // error condition
-
-        if (!root) { continue; }
-
-        err = 0; // if we got valid JSON, it's not an error condition
-
-        /* Get RVI cmd from string */
-        strncpy( cmd, json_string_value( json_object_get( root, "cmd" ) ), 5 );
-        /* Ensure null-termination */
-        cmd[4] = 0;
+#endif
+        err = RVI_ERR_JSON_PART;
+    }
 
-        if( strcmp( cmd, "au" ) == 0 ) {
-            rviReadAu( handle, root, rtmp );
-        } else if( strcmp( cmd, "sa" ) == 0 ) {
-            rviReadSa( handle, root, rtmp );
-        } else if( strcmp( cmd, "rcv" ) == 0 ) {
-            rviReadRcv( handle, root, rtmp );
-        } else if( strcmp( cmd, "ping" ) == 0 ) {
-            /* Echo the ping back */
+    return err;
+}
 
-            if(verbose){
-                fprintf(stderr, "rviProcessInput[ping], sending: '%s'\n", buf);
-            }
+/*
+ * Dispatch a single RVI message received from a remote node to the handler
+ * for its command.
+ */
+int rviDispatchMessage( TRviHandle handle, json_t *msg, const char *raw, 
+                        size_t rawLen, TRviRemote *remote )
+{
+    if( !handle || !msg || !remote ) { return EINVAL; }
 
-            len = SSL_write( ssl, "{\"cmd\":\"ping\"}", read );
-            if (len != read) {
-                err = SSL_get_error(ssl, read);
-                if (err != SSL_ERROR_NONE) {
-                    /* The peer probably closed the connection, so reopen it */
-                    rviResumeConnection(handle, rkey.fd);
-                }
-            }
+    const char      *str    = NULL;
+    char            cmd[5]  = {0};
+    int             err     = 0;
 
-        } else { /* UNKNOWN RVI COMMAND */
-            err = -RVI_ERR_NOCMD; 
+    /* Get RVI cmd from string */
+    str = json_string_value( json_object_get( msg, "cmd" ) );
+    if( !str ) { return -RVI_ERR_NOCMD; }
+    strncpy( cmd, str, 5 );
+    /* Ensure null-termination */
+    cmd[4] = 0;
+
+    if( strcmp( cmd, "au" ) == 0 ) {
+        /* The rights decoded from the credentials outlive the message */
+        bool paused = rviJsonScopePause();
+        rviReadAu( handle, msg, remote );
+        rviJsonScopeResume( paused );
+        /* Unless the credentials went to the verifier threads */
+        if( !remote->verify ) { rviRemoteAuthorized( handle, remote ); }
+    } else if( strcmp( cmd, "sa" ) == 0 ) {
+        rviReadSa( handle, msg, remote );
+        remote->announced = true;
+    } else if( strcmp( cmd, "rcv" ) == 0 ) {
+        rviReadRcv( handle, msg, raw, rawLen, remote );
+    } else if( strcmp( cmd, "rpl" ) == 0 ) {
+        rviReadRpl( handle, msg, raw, rawLen, remote );
+    } else if( strcmp( cmd, "ping" ) == 0 ) {
+        /* 
+         * Echo the ping back. With keepalive enabled, at most one ping is 
+         * sent per interval, so two nodes doing the same do not bounce
+         * pings back and forth indefinitely. 
+         */
+        TRviContext *ctx = (TRviContext *)handle;
+        if( !ctx->keepalive || 
+            remote->reactor->loopMs - remote->lastPingMs >= ctx->keepalive ) {
+            rviRemotePing( handle, remote );
         }
 
-        /* Set the mode back to its original bitmask */
-        SSL_set_mode( ssl, mode );
-
-        json_decref( root );
+    } else { /* UNKNOWN RVI COMMAND */
+        err = -RVI_ERR_NOCMD; 
     }
 
-exit:
     return err;
 }
 
+/*
+ * Take the rights granted by the credentials in a peer's "au". Rights found
+ * in the cache are taken right away. The other credentials are checked by
+ * the verifier threads, if there are any and the connection is non-blocking;
+ * the remote then waits in RVI_REMOTE_AUTH, with remote->verify set, until
+ * rviVerifyDue() finds the check done. Otherwise they are checked here.
+ */
 int rviReadAu( TRviHandle handle, json_t *msg, TRviRemote *remote )
 {
     if( !handle || !msg || !remote ) { return EINVAL; }
@@ -1785,6 +6353,27 @@ int rviReadAu( TRviHandle handle, json_t *msg, TRviRemote *remote )
     json_t          *value  = NULL;
     X509            *cert   = NULL;
     json_t          *tmp    = NULL;
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRights      *cached = NULL;
+    TRviVerifyJob   *job    = NULL;
+    TRviVerifyCred  *vc;
+    unsigned char   digest[SHA256_DIGEST_LENGTH];
+    long long       start   = rviNowNs();
+    long long       elapsed;
+    int             keyed;
+    bool            found;
+
+    /* Once both sides have offered binary frames, send them from here on */
+    tmp = json_object_get( msg, "encodings" );
+    found = false;
+    for( index = 0; index < json_array_size( tmp ); index++ ) {
+        value = json_array_get( tmp, index );
+        found = found || ( json_string_value( value ) &&
+                           !strcmp( json_string_value( value ), "msgpack" ) );
+    }
+    pthread_mutex_lock( &remote->lock );
+    remote->binaryOut = remote->binaryIn && found;
+    pthread_mutex_unlock( &remote->lock );
 
     tmp = json_object_get( msg, "creds" );
     if( !tmp ) {
@@ -1803,23 +6392,387 @@ int rviReadAu( TRviHandle handle, json_t *msg, TRviRemote *remote )
         goto exit;
     }
 
+    job = calloc( 1, sizeof( TRviVerifyJob ) + 
+                     json_array_size( tmp ) * sizeof( TRviVerifyCred ) );
+    if( !job ) {
+        err = ENOMEM;
+        goto exit;
+    }
+
 //    json_array_foreach( tmp, index, value ) {
     for( index = 0; 
          index < json_array_size( tmp ) && ( value = json_array_get( tmp, index ) ); 
          index ++) {
         const char *val = json_string_value( value );
-        if(  rviValidateCredential( handle, val, cert ) != RVI_OK ) {
+        if( !val ) { continue; }
+        /* Reuse the rights from an earlier verification, if any */
+        keyed = ( rviCredCacheKey( val, cert, digest ) == RVI_OK );
+        found = false;
+        if( keyed ) {
+            /* The workers share the cache, so copy the rights while the 
+             * entry can't be evicted. The signature check is done unlocked. */
+            pthread_mutex_lock( &ctx->credLock );
+            if( ( cached = rviCredCacheLookup( handle, digest ) ) ) {
+                found = true;
+                cached = rviRightsClone( cached );
+            }
+            pthread_mutex_unlock( &ctx->credLock );
+        }
+        if( found ) {
+            remote->stats.credCacheHits++;
+            if( !cached ) {
+                err = ENOMEM;
+                goto exit;
+            }
+            if( ( err = rviRemoteRightsAdd( handle, remote, cached ) ) ) {
+                goto exit;
+            }
             continue;
         }
-        err = rviGetRightsFromCredential( handle, val, remote->rights );
-        if( err ) goto exit;
+        remote->stats.credCacheMisses++;
+        vc = &job->creds[job->count];
+        if( !( vc->cred = strdup( val ) ) ) {
+            err = ENOMEM;
+            goto exit;
+        }
+        job->count++;
+        vc->keyed = keyed;
+        if( keyed ) { memcpy( vc->digest, digest, SHA256_DIGEST_LENGTH ); }
+    }
+    if( !job->count ) { goto exit; }
+
+    job->cert = cert;
+    cert = NULL;
+    job->credGen = ctx->credGen;
+    job->startNs = start;
+    if( ctx->caKey && !( job->caKey = strdup( ctx->caKey ) ) ) {
+        err = ENOMEM;
+        goto exit;
+    }
+
+    if( remote->nonblocking ) {
+        job->remote = remote;
+        remote->verify = job;
+        if( rviVerifySubmit( handle, job ) ) {
+            remote->reactor->verifying++;
+            return RVI_OK;
+        }
+        /* No verifier threads, or too many checks queued already */
+        job->remote = NULL;
+        remote->verify = NULL;
     }
 
+    rviVerifyRun( job );
+    err = rviVerifyApply( handle, remote, job );
+
 exit:
+    elapsed = rviNowNs() - start;
+    rviHistogramAdd( &remote->stats.credentials, elapsed );
+    RVI_PROBE2( credentials__checked, remote->fd, elapsed );
+    rviVerifyFree( job );
     if( cert ) X509_free( cert );
     return err;
 }
 
+/*
+ * Add rights presented by a remote to its list and index. Other threads check
+ * them when announcing services, so they change under the registry lock.
+ */
+int rviRemoteRightsAdd( TRviHandle handle, TRviRemote *remote, 
+                        TRviRights *rights )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    int             err;
+
+    rviRegistryWrite( ctx );
+    rviListInsert( remote->rights, rights );
+    err = rviRightsIndexAdd( &remote->rightsIdx, rights );
+    rviRegistryUnlock( ctx );
+
+    return err;
+}
+
+/*
+ * Reply to the peer's credentials with our services, once they have been
+ * checked
+ */
+void rviRemoteAuthorized( TRviHandle handle, TRviRemote *remote )
+{
+    if( remote->state != RVI_REMOTE_AUTH ) { return; }
+
+    pthread_mutex_lock( &remote->lock );
+    remote->state = RVI_REMOTE_CONNECTED;
+    /* Output refused before the connection was reset may be sent now */
+    if( remote->throttled ) {
+        remote->throttled = false;
+        rviRemoteFlag( remote, &remote->drained );
+    }
+    pthread_mutex_unlock( &remote->lock );
+    remote->backoffMs = 0;
+    rviAllServiceAnnounce( handle, remote );
+}
+
+/*
+ * Check each credential of a verification job, on whichever thread. Nothing
+ * but the job is touched.
+ */
+void rviVerifyRun( TRviVerifyJob *job )
+{
+    TRviVerifyCred  *vc;
+    int             i;
+
+    for( i = 0; i < job->count; i++ ) {
+        vc = &job->creds[i];
+        if( rviDecodeCredentialKey( job->caKey, vc->cred, job->cert, 
+                                    &vc->rights ) != RVI_OK ) {
+            vc->rights = NULL;
+        }
+    }
+}
+
+/*
+ * Queue a job for the verifier threads. Returns false if there are none, or
+ * the queue is full, for the caller to check the credentials itself.
+ */
+bool rviVerifySubmit( TRviHandle handle, TRviVerifyJob *job )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    bool            queued  = false;
+
+    pthread_mutex_lock( &ctx->verifyLock );
+    if( ctx->verifierCount && !ctx->verifyStop && 
+        ctx->verifyQueued < RVI_VERIFY_BACKLOG ) {
+        job->next = NULL;
+        if( ctx->verifyTail ) {
+            ctx->verifyTail->next = job;
+        } else {
+            ctx->verifyHead = job;
+        }
+        ctx->verifyTail = job;
+        ctx->verifyQueued++;
+        pthread_cond_signal( &ctx->verifyCond );
+        queued = true;
+    }
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    return queued;
+}
+
+/*
+ * Give a remote the rights from the valid credentials of a finished job, and
+ * cache them, unless the trust store was reloaded since the job was made.
+ * Called by the remote's event loop.
+ */
+int rviVerifyApply( TRviHandle handle, TRviRemote *remote, 
+                    TRviVerifyJob *job )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviVerifyCred  *vc;
+    TRviRights      *rights;
+    int             err;
+    int             i;
+
+    for( i = 0; i < job->count; i++ ) {
+        vc = &job->creds[i];
+        if( !( rights = vc->rights ) ) { continue; }
+        /* The remote's list owns the rights from here on */
+        vc->rights = NULL;
+        if( ( err = rviRemoteRightsAdd( handle, remote, rights ) ) ) {
+            return err;
+        }
+        if( vc->keyed && job->credGen == ctx->credGen ) {
+            pthread_mutex_lock( &ctx->credLock );
+            rviCredCacheInsert( handle, vc->digest, rights );
+            pthread_mutex_unlock( &ctx->credLock );
+        }
+    }
+
+    return RVI_OK;
+}
+
+/*
+ * Free a verification job, with any rights it still holds
+ */
+void rviVerifyFree( TRviVerifyJob *job )
+{
+    int             i;
+
+    if( !job ) { return; }
+
+    for( i = 0; i < job->count; i++ ) {
+        free( job->creds[i].cred );
+        rviRightsDestroy( job->creds[i].rights );
+    }
+    X509_free( job->cert );
+    free( job->caKey );
+    free( job );
+}
+
+/*
+ * Stop waiting for the check of a remote's credentials, because it is being
+ * closed or reset. A job still queued or running is freed by its verifier 
+ * thread.
+ */
+void rviVerifyCancel( TRviHandle handle, TRviRemote *remote )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviVerifyJob   *job    = remote->verify;
+
+    if( !job ) { return; }
+
+    remote->verify = NULL;
+    remote->reactor->verifying--;
+
+    pthread_mutex_lock( &ctx->verifyLock );
+    if( job->done ) {
+        __sync_fetch_and_sub( &remote->reactor->verified, 1 );
+    } else {
+        job->remote = NULL;
+        job = NULL;
+    }
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    rviVerifyFree( job );
+}
+
+/*
+ * Finish the handshakes of an event loop's remotes whose credentials have
+ * been checked, and dispatch the messages they sent in the meantime
+ */
+void rviVerifyDue( TRviHandle handle, TRviReactor *reactor )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviRemote      *remote;
+    TRviRemote      *next;
+    TRviVerifyJob   *job;
+    long long       elapsed;
+    bool            done;
+
+    if( !__sync_add_and_fetch( &reactor->verified, 0 ) ) { return; }
+
+    /* The messages' callbacks may disconnect remotes */
+    reactor->dispatching++;
+    for( remote = reactor->remotes; remote; remote = next ) {
+        next = remote->shardNext;
+        if( remote->closed || !( job = remote->verify ) ) { continue; }
+
+        pthread_mutex_lock( &ctx->verifyLock );
+        if( ( done = job->done ) ) {
+            __sync_fetch_and_sub( &reactor->verified, 1 );
+        }
+        pthread_mutex_unlock( &ctx->verifyLock );
+        if( !done ) { continue; }
+
+        remote->verify = NULL;
+        reactor->verifying--;
+        rviVerifyApply( handle, remote, job );
+        elapsed = rviNowNs() - job->startNs;
+        rviHistogramAdd( &remote->stats.credentials, elapsed );
+        RVI_PROBE2( credentials__checked, remote->fd, elapsed );
+        rviVerifyFree( job );
+
+        rviRemoteAuthorized( handle, remote );
+        rviReadMessages( handle, remote );
+    }
+    reactor->dispatching--;
+}
+
+/*
+ * The body of a verifier thread. Once told to stop, it still finishes the
+ * jobs queued.
+ */
+static void *rviVerifierMain( void *arg )
+{
+    TRviContext     *ctx    = arg;
+    TRviVerifyJob   *job;
+    TRviReactor     *reactor;
+
+    pthread_mutex_lock( &ctx->verifyLock );
+    for( ;; ) {
+        while( !ctx->verifyHead && !ctx->verifyStop ) {
+            pthread_cond_wait( &ctx->verifyCond, &ctx->verifyLock );
+        }
+        if( !( job = ctx->verifyHead ) ) { break; }
+        if( !( ctx->verifyHead = job->next ) ) { ctx->verifyTail = NULL; }
+        ctx->verifyQueued--;
+        pthread_mutex_unlock( &ctx->verifyLock );
+
+        rviVerifyRun( job );
+
+        pthread_mutex_lock( &ctx->verifyLock );
+        if( job->remote ) {
+            /* The remote can't be closed, or moved, until this is done */
+            job->done = true;
+            reactor = job->remote->reactor;
+            __sync_fetch_and_add( &reactor->verified, 1 );
+            rviReactorNotify( reactor, 0 );
+        } else {
+            rviVerifyFree( job );
+        }
+    }
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    return NULL;
+}
+
+/*
+ * Stop the verifier threads, once they have finished the jobs queued
+ */
+void rviVerifyStop( TRviHandle handle )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    int             i;
+
+    pthread_mutex_lock( &ctx->verifyLock );
+    ctx->verifyStop = true;
+    pthread_cond_broadcast( &ctx->verifyCond );
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    for( i = 0; i < ctx->verifierCount; i++ ) {
+        pthread_join( ctx->verifiers[i], NULL );
+    }
+
+    pthread_mutex_lock( &ctx->verifyLock );
+    ctx->verifierCount = 0;
+    ctx->verifyStop = false;
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    free( ctx->verifiers );
+    ctx->verifiers = NULL;
+}
+
+/*
+ * Set the number of threads checking the credentials presented by peers
+ */
+int rviSetVerifyThreads( TRviHandle handle, int count )
+{
+    if( !handle || count < 0 ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    int             err     = RVI_OK;
+    int             i;
+
+    rviVerifyStop( handle );
+    if( !count ) { return RVI_OK; }
+
+    ctx->verifiers = calloc( count, sizeof( pthread_t ) );
+    if( !ctx->verifiers ) { return ENOMEM; }
+
+    pthread_mutex_lock( &ctx->verifyLock );
+    for( i = 0; i < count; i++ ) {
+        if( ( err = pthread_create( &ctx->verifiers[i], NULL, 
+                                    rviVerifierMain, ctx ) ) ) {
+            break;
+        }
+        ctx->verifierCount++;
+    }
+    pthread_mutex_unlock( &ctx->verifyLock );
+
+    if( err ) { rviVerifyStop( handle ); }
+
+    return err;
+}
+
 int rviWriteAu( TRviHandle handle, TRviRemote *remote )
 {
     if( !handle || !remote ) { return EINVAL; }
@@ -1856,6 +6809,16 @@ int rviWriteAu( TRviHandle handle, TRviRemote *remote )
         goto exit;
     }
 
+    /* Offer binary frames for what follows; the "au" itself is always JSON */
+    remote->binaryOut = false;
+    remote->binaryIn = ( ctx->encoding == RVI_ENCODING_MSGPACK );
+    if( remote->binaryIn && 
+        json_object_set_new( au, "encodings", 
+                             json_pack( "[s]", "msgpack" ) ) ) {
+        err = RVI_ERR_JSON;
+        goto exit;
+    }
+
     auString = json_dumps(au, JSON_COMPACT);
 
     /* send "au" message */
@@ -1864,15 +6827,11 @@ int rviWriteAu( TRviHandle handle, TRviRemote *remote )
         fprintf(stderr, "rviWriteAu, sending: '%s'\n", auString);
     }
   
-    err = BIO_puts( remote->sbio, auString );
-    if (err < 0) {
-        /* The connection was likely closed by the peer, attempt to resume */
-        rviResumeConnection(handle, remote->fd);
-    }
+    err = rviRemoteWrite( handle, remote, auString, strlen( auString ) );
 
 
 exit:
-    free( auString );
+    rviJsonFree( auString );
     json_decref( au );
 
     return err;
@@ -1900,6 +6859,9 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
         av = 1;
     }
 
+    rviRegistryWrite( ctx );
+    rviRightsIndexExpire( &remote->rightsIdx, time( NULL ) );
+    rviRightsIndexExpire( &ctx->rightsIdx, time( NULL ) );
     //json_array_foreach( tmp, index, value ) {
     for( index = 0; 
          index < json_array_size( tmp ) && ( value = json_array_get( tmp, index ) ); 
@@ -1907,10 +6869,10 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
         const char *val = json_string_value( value );
         if( av ) { /* Service newly available */
             /* If remote doesn't have right to receive, discard */
-            if ( ( err = rviRightToReceiveError( remote->rights, val ) ) ) 
+            if ( ( err = rviRightToReceiveError( &remote->rightsIdx, val ) ) ) 
                 continue;
             /* If we don't have right to invoke, discard */
-            if ( ( err = rviRightToInvokeError( ctx->rights, val ) ) )
+            if ( ( err = rviRightToInvokeError( &ctx->rightsIdx, val ) ) )
                 continue;
             
             /* Otherwise, add the service to services available */
@@ -1918,20 +6880,52 @@ int rviReadSa( TRviHandle handle, json_t *msg, TRviRemote *remote )
                                                  val, remote->fd, 
                                                  NULL, NULL 
                                                     );
-            btree_insert( ctx->serviceNameIdx, service );
-            btree_insert( ctx->serviceRegIdx, service );
+            if( !service ) { err = ENOMEM; break; }
+            if( rviServiceIndexInsert( handle, service ) != RVI_OK ) {
+                rviServiceDestroy( service );
+            } else {
+                rviServiceLink( remote, service );
+            }
         } else { /* Service not available, find it and remove it */
             /* If remote doesn't have right to receive, ignore this message */
-            if ( ( err = rviRightToReceiveError( remote->rights, val ) ) ) 
+            if ( ( err = rviRightToReceiveError( &remote->rightsIdx, val ) ) ) 
                 continue;
-            rviRemoveService( handle, val );
+            /* A remote can only withdraw the services it announced */
+            TRviService *stmp = rviServiceLookup( handle, val );
+            if( stmp && stmp->owner == remote ) {
+                rviServiceIndexRemove( handle, stmp );
+                rviServiceDestroy( stmp );
+            }
         }
     }
+    rviRegistryUnlock( ctx );
 
 exit:
     return err;
 }
 
+/* State for gathering the services announced to a newly connected remote */
+typedef struct TRviAnnounceState {
+    TRviRemote *remote;
+    json_t *svcs;
+} TRviAnnounceState;
+
+static int rviCollectAnnounced( void *record, void *context )
+{
+    TRviService *stmp = record;
+    TRviAnnounceState *state = context;
+
+    if ( /* The remote is allowed to invoke it */
+         !rviRightToInvokeError( &state->remote->rightsIdx, stmp->name ) &&
+         /* The service was registered locally */
+         stmp->registrant == 0
+       ) {
+        json_array_append_new( state->svcs, json_string( stmp->name ) );
+    }
+
+    return 0;
+}
+
 int rviAllServiceAnnounce( TRviHandle handle, TRviRemote *remote )
 {
     if( !handle || !remote ) { return EINVAL; }
@@ -1944,21 +6938,13 @@ int rviAllServiceAnnounce( TRviHandle handle, TRviRemote *remote )
     char            *saString = NULL;
 
     svcs = json_array();
+    rviRightsExpireDue( handle, remote );
+    rviRegistryRead( ctx );
     if( ctx->serviceNameIdx->count ) {
-        btree_iter iter = btree_iter_begin( ctx->serviceNameIdx );
-        while ( !btree_iter_at_end( iter ) ) {
-            TRviService *stmp = btree_iter_data( iter );
-            if ( /* The remote is allowed to invoke it */
-                 !( err = rviRightToInvokeError( remote->rights, stmp->name ) ) &&
-                 /* The service was registered locally */
-                 stmp->registrant == 0
-               ) {
-                json_array_append_new( svcs, json_string( stmp->name ) );
-            }
-            btree_iter_next( iter );
-        }
-        btree_iter_cleanup( iter );
+        TRviAnnounceState state = { remote, svcs };
+        btree_foreach( ctx->serviceNameIdx, rviCollectAnnounced, &state );
     }
+    rviRegistryUnlock( ctx );
 
     sa = json_pack( "{s:s, s:s, s:o}", 
             "cmd", "sa",            /* populate cmd */
@@ -1978,15 +6964,11 @@ int rviAllServiceAnnounce( TRviHandle handle, TRviRemote *remote )
         fprintf(stderr, "rviAllServiceAnnounce, sending: '%s'\n", saString);
     }
 
-    err = BIO_puts( remote->sbio, saString );
-    if (err < 0) {
-        /* The connection was likely closed by the peer, attempt to resume */
-        rviResumeConnection(handle, remote->fd);
-    }
+    err = rviRemoteWrite( handle, remote, saString, strlen( saString ) );
 
 
 exit:
-    free(saString);
+    rviJsonFree(saString);
     json_decref(sa);
 
     return err;
@@ -2001,9 +6983,12 @@ int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available )
     json_t          *svcs   = NULL;
     json_t          *sa     = NULL;
     char            *saString = NULL;
+    int             fd;
 
+    /* Called with the registry lock held for writing */
+    rviRightsIndexExpire( &ctx->rightsIdx, time( NULL ) );
     svcs = json_pack( "[s]", service->name );
-    if( ( err = rviRightToReceiveError( ctx->rights, service->name ) ) ) {
+    if( ( err = rviRightToReceiveError( &ctx->rightsIdx, service->name ) ) ) {
         err = -RVI_ERR_RIGHTS; 
         goto exit;
     }
@@ -2013,7 +6998,7 @@ int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available )
         goto exit;
     }
 
-    if( !(ctx->remoteIdx->count) ) {
+    if( !(ctx->remoteCount) ) {
         err = -ENXIO; 
         goto exit;
     }
@@ -2026,38 +7011,51 @@ int rviServiceAnnounce( TRviHandle handle, TRviService *service, int available )
 
     saString = json_dumps(sa, JSON_COMPACT);
 
-    btree_iter iter = btree_iter_begin( ctx->remoteIdx );
-        while( !btree_iter_at_end( iter  ) ) {
-            TRviRemote *remote = btree_iter_data( iter );
-            if( ( err = rviRightToInvokeError( remote->rights, service->name ) ) ) {
-                btree_iter_next( iter );
-                continue; /* If the remote can't invoke, don't announce */
-            }
-
-            if(verbose){
-                fprintf(stderr, "rviServiceAnnounce, sending: '%s'\n", saString);
-            }
-
-            err = BIO_puts( remote->sbio, saString );
-            if (err < 0) {
-                /* The connection was likely closed by the peer, resume and try again */
-                rviResumeConnection(handle, remote->fd);
-                continue;
-            }
+    for( fd = 0; fd < ctx->remotesSize; fd++ ) {
+        TRviRemote *remote = ctx->remotes[fd];
+        if( !remote ) { continue; }
+        rviRightsIndexExpire( &remote->rightsIdx, time( NULL ) );
+        if( ( err = rviRightToInvokeError( &remote->rightsIdx, service->name ) ) ) {
+            continue; /* If the remote can't invoke, don't announce */
+        }
 
-            btree_iter_next( iter );
+        if(verbose){
+            fprintf(stderr, "rviServiceAnnounce, sending: '%s'\n", saString);
         }
-    btree_iter_cleanup( iter );
+
+        err = rviRemoteWrite( handle, remote, saString, 
+                              strlen( saString ) );
+    }
 
 
 exit:
-    if( saString ) free( saString );
+    if( saString ) rviJsonFree( saString );
     json_decref(sa);
 
     return err;
 }
 
-int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote )
+/* Check the rights needed for a remote to invoke a service on this node */
+int rviRcvRightsError( TRviHandle handle, TRviRemote *remote, 
+                       const char *serviceName )
+{
+    TRviContext     *ctx    = ( TRviContext * )handle;
+    int             err;
+
+    if( ( err = rviRightToInvokeError( &remote->rightsIdx, serviceName ) ) )
+        return err; /* Remote does not have right to invoke */
+    if( ( err = rviRightToReceiveError( &ctx->rightsIdx, serviceName ) ) )
+        return err; /* This node does not have the right to receive */
+
+    return RVI_OK;
+}
+
+/*
+ * Handle an "rcv" message. raw holds the message as received, from which the 
+ * parameters are handed to a raw callback without being re-serialized.
+ */
+int rviReadRcv( TRviHandle handle, json_t *msg, const char *raw, 
+                size_t rawLen, TRviRemote *remote )
 {
     if( !handle || !msg || !remote ) { return EINVAL; }
 
@@ -2065,37 +7063,205 @@ int rviReadRcv( TRviHandle handle, json_t *msg, TRviRemote *remote )
     TRviContext   *ctx    = ( TRviContext * )handle;
     json_t          *tmp    = NULL;
     json_t          *params = NULL;
-    TRviService   skey    = {0};
     TRviService   *stmp   = NULL;
+    TRviService     service;
+    TRviAuthCacheEntry  *auth = NULL;
     char            *parameters = NULL;
-    time_t          rawtime;
+    long long       tid;
     const char      *sname;
+    const char      *data;
+    const char      *view;
+    size_t          dataLen;
+    size_t          viewLen;
+    long long       start;
 
     tmp = json_object_get( msg, "data" );
     if( !tmp ) { err = RVI_ERR_JSON; goto exit; }
 
     long long timeout = json_integer_value( json_object_get( tmp, "timeout" ) );
-    time(&rawtime);
-    if( rawtime > timeout ) { err = RVI_ERR_JSON; goto exit; }
+    if( rviDeadlinePassed( handle, timeout ) ) { 
+        err = RVI_ERR_TIMEOUT; 
+        goto exit; 
+    }
 
     sname = json_string_value( json_object_get( tmp, "service" ) );
-    if( ( err = rviRightToInvokeError( remote->rights, sname ) ) )
-        goto exit; /* Remote does not have right to invoke */
-    if( ( err = rviRightToReceiveError( ctx->rights, sname ) ) )
-        goto exit; /* This node does not have the right to receive */
+    if( !sname ) { err = RVI_ERR_JSON; goto exit; }
+
+    /* Drop expired rights first, since the checks below only read them */
+    rviRightsExpireDue( handle, remote );
+
+    rviRegistryRead( ctx );
+    stmp = rviServiceLookup( handle, sname );
+    if( !stmp ) {
+        if( !( err = rviRcvRightsError( handle, remote, sname ) ) ) {
+            err = ENXIO;
+        }
+        rviRegistryUnlock( ctx );
+        goto exit;
+    }
 
-    skey.name = strdup( sname );
-    stmp = btree_search( ctx->serviceNameIdx, &skey );
-    if( !stmp ) { err = ENXIO; goto exit; }
+    /* 
+     * Check the rights, reusing the last decision for this service unless
+     * either side's rights have changed since. 
+     */
+    start = rviStatsStart( ctx );
+    auth = &remote->authCache[ stmp->id & ( RVI_AUTH_CACHE_SIZE - 1 ) ];
+    if( auth->serviceId != stmp->id || 
+        auth->localGen != ctx->rightsIdx.generation ||
+        auth->remoteGen != remote->rightsIdx.generation ) {
+        auth->serviceId = stmp->id;
+        auth->localGen = ctx->rightsIdx.generation;
+        auth->remoteGen = remote->rightsIdx.generation;
+        auth->err = rviRcvRightsError( handle, remote, sname );
+    }
+
+    /* Another thread may unregister the service once the lock is released */
+    service = *stmp;
+    stmp = &service;
+    rviRegistryUnlock( ctx );
+    rviStatsSince( &remote->stats.rights, start );
+    if( ( err = auth->err ) ) { goto exit; }
 
     params = json_object_get( tmp, "parameters" );
     if( !params ) { err = RVI_ERR_JSON; goto exit; }
+
+    tid = json_integer_value( json_object_get( msg, "tid" ) );
+    RVI_PROBE2( service__invoked, remote->fd, sname );
+    start = rviStatsStart( ctx );
+
+    /* Point a raw callback at the parameters in the receive buffer */
+    if( stmp->rawCallback && raw &&
+        rviJsonFindMember( raw, rawLen, "data", &data, &dataLen ) &&
+        rviJsonFindMember( data, dataLen, "parameters", &view, &viewLen ) ) {
+        err = rviRunService( handle, stmp, remote->fd, sname, tid, 
+                             view, viewLen );
+        rviStatsSince( &remote->stats.callback, start );
+        goto exit;
+    }
+
+    /* Keys written with escapes are not found above; use the copy */
     parameters = json_dumps( params, JSON_COMPACT );
+    if( !parameters ) { err = ENOMEM; goto exit; }
 
-    stmp->callback( remote->fd, stmp->data, parameters );
+    err = rviRunService( handle, stmp, remote->fd, sname, tid, 
+                         parameters, strlen( parameters ) );
+    rviStatsSince( &remote->stats.callback, start );
 
 exit:
-    if( skey.name ) free( skey.name );
-    if( parameters ) free( parameters );
+    if( parameters ) rviJsonFree( parameters );
     return err;
 }
+
+/* Run an invocation handed to the executor, then free it */
+static void rviInvocationRun( void *task )
+{
+    TRviInvocation  *inv    = task;
+
+    if( inv->rawCallback ) {
+        inv->rawCallback( inv->fd, inv->data, inv->name, inv->tid, 
+                          inv->parameters, inv->len );
+    } else if( inv->callback ) {
+        inv->callback( inv->fd, inv->data, inv->parameters );
+    }
+    free( inv );
+}
+
+/*
+ * Call a service's callback for an invocation, on this thread, or hand a 
+ * copy of the invocation to the executor set with rviSetExecutor(). The 
+ * parameters need only be null-terminated for a plain callback.
+ */
+int rviRunService( TRviHandle handle, TRviService *service, int fd, 
+                   const char *name, long long tid, 
+                   const char *parameters, size_t len )
+{
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviInvocation  *inv;
+    size_t          nameLen;
+    bool            paused;
+
+    if( !ctx->executor ) {
+        /* The callback's own use of jansson must not land in the arena */
+        paused = rviJsonScopePause();
+        if( service->rawCallback ) {
+            service->rawCallback( fd, service->data, name, tid, 
+                                  parameters, len );
+        } else if( service->callback ) {
+            service->callback( fd, service->data, parameters );
+        }
+        rviJsonScopeResume( paused );
+        return RVI_OK;
+    }
+
+    /* The message, and the arena holding it, are gone by the time it runs */
+    nameLen = strlen( name );
+    inv = malloc( sizeof( TRviInvocation ) + nameLen + len + 2 );
+    if( !inv ) { return ENOMEM; }
+    inv->callback = service->callback;
+    inv->rawCallback = service->rawCallback;
+    inv->data = service->data;
+    inv->fd = fd;
+    inv->tid = tid;
+    inv->name = (char *)( inv + 1 );
+    memcpy( inv->name, name, nameLen + 1 );
+    inv->parameters = inv->name + nameLen + 1;
+    memcpy( inv->parameters, parameters, len );
+    inv->parameters[len] = '\0';
+    inv->len = len;
+
+    ctx->executor( rviInvocationRun, inv, ctx->executorData );
+
+    return RVI_OK;
+}
+
+/*
+ * Handle an "rpl" message, completing the call it answers. A reply to a call
+ * that has already timed out, or that was not made on this connection, is 
+ * dropped.
+ */
+int rviReadRpl( TRviHandle handle, json_t *msg, const char *raw, 
+                size_t rawLen, TRviRemote *remote )
+{
+    if( !handle || !msg || !remote ) { return EINVAL; }
+
+    TRviContext     *ctx    = (TRviContext *)handle;
+    TRviPendingCall *call;
+    json_t          *tmp;
+    char            *result = NULL;
+    const char      *view   = NULL;
+    size_t          viewLen = 0;
+    long long       tid;
+    bool            paused;
+
+    tmp = json_object_get( msg, "tid" );
+    if( !json_is_integer( tmp ) ) { return RVI_ERR_JSON; }
+    tid = json_integer_value( tmp );
+
+    pthread_mutex_lock( &ctx->callLock );
+    call = rviHashFind( &ctx->pendingCalls, &tid );
+    if( !call || call->fd != remote->fd ) { 
+        pthread_mutex_unlock( &ctx->callLock );
+        return ENOENT; 
+    }
+    rviCallUnlink( handle, call );
+    rviHashRemove( &ctx->pendingCalls, &call->tid );
+    pthread_mutex_unlock( &ctx->callLock );
+
+    /* Hand over the result as received, or re-serialized if not found */
+    if( !raw || !rviJsonFindMember( raw, rawLen, "result", &view, &viewLen ) ) {
+        tmp = json_object_get( msg, "result" );
+        result = tmp ? json_dumps( tmp, JSON_COMPACT | JSON_ENCODE_ANY ) : NULL;
+        view = result ? result : "null";
+        viewLen = strlen( view );
+    }
+
+    paused = rviJsonScopePause();
+    call->completion( remote->fd, call->data, call->tid, RVI_OK, 
+                      view, viewLen );
+    rviJsonScopeResume( paused );
+
+    if( result ) rviJsonFree( result );
+    rviSharedRelease( &rviCallPool, call );
+
+    return RVI_OK;
+}
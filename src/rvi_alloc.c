@@ -0,0 +1,339 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rvi_alloc.h"
+
+#define RVI_ALIGN(n) \
+    ( ( (n) + RVI_ALLOC_ALIGN - 1 ) & ~( (size_t)RVI_ALLOC_ALIGN - 1 ) )
+
+//
+//  The data in a chunk starts at the first aligned offset past the header.
+//
+#define RVI_CHUNK_HEADER RVI_ALIGN ( sizeof(TRviArenaChunk) )
+
+static inline char* rviChunkData ( TRviArenaChunk* chunk )
+{
+    return (char*)chunk + RVI_CHUNK_HEADER;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ i n i t i a l i z e
+
+	@brief Initialize a new, empty arena.
+
+	No storage is allocated until the first block is requested. Requests
+    larger than a chunk get a chunk of their own.
+
+	@param[in] arena - The address of the arena to initialize
+	@param[in] chunkSize - The size of each regular chunk of storage
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviArenaInitialize ( TRviArena* arena, size_t chunkSize )
+{
+    if ( !arena || chunkSize == 0 )
+    {
+        return EINVAL;
+    }
+    arena->head      = NULL;
+    arena->current   = NULL;
+    arena->chunkSize = RVI_ALIGN ( chunkSize );
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ f r e e
+
+	@brief Release all of the storage held by an arena.
+
+	The arena is left empty and may be used again.
+
+	@param[in] arena - The address of the arena
+
+------------------------------------------------------------------------*/
+void rviArenaFree ( TRviArena* arena )
+{
+    TRviArenaChunk* chunk = arena->head;
+    TRviArenaChunk* next;
+
+    while ( chunk )
+    {
+        next = chunk->next;
+        free ( chunk );
+        chunk = next;
+    }
+    arena->head    = NULL;
+    arena->current = NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ a l l o c
+
+	@brief Allocate a block from an arena.
+
+	The block stays valid until the arena is rewound to a mark taken before
+    it was allocated, or the arena is freed.
+
+	@param[in] arena - The address of the arena
+	@param[in] size - The number of bytes needed
+
+	@return block - The aligned block, or NULL if out of memory
+
+------------------------------------------------------------------------*/
+void* rviArenaAlloc ( TRviArena* arena, size_t size )
+{
+    TRviArenaChunk* chunk = arena->current;
+    TRviArenaChunk* next;
+    size_t          chunkSize;
+
+    size = RVI_ALIGN ( size );
+
+    if ( chunk && chunk->size - chunk->used >= size )
+    {
+        chunk->used += size;
+        return rviChunkData ( chunk ) + chunk->used - size;
+    }
+    //
+    //  Move on to the next chunk kept from earlier use if the block fits in
+    //  it, otherwise insert a new chunk after the current one.
+    //
+    next = chunk ? chunk->next : arena->head;
+    if ( !next || next->size < size )
+    {
+        chunkSize = size > arena->chunkSize ? size : arena->chunkSize;
+        if ( posix_memalign ( (void**)&next, RVI_ALLOC_ALIGN,
+                              RVI_CHUNK_HEADER + chunkSize ) != 0 )
+        {
+            return NULL;
+        }
+        next->size = chunkSize;
+        if ( chunk )
+        {
+            next->next  = chunk->next;
+            chunk->next = next;
+        }
+        else
+        {
+            next->next  = arena->head;
+            arena->head = next;
+        }
+    }
+    next->used     = size;
+    arena->current = next;
+
+    return rviChunkData ( next );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ m a r k
+
+	@brief Return the current position of an arena, for rviArenaRewind().
+
+	@param[in] arena - The address of the arena
+
+	@return mark - The current position
+
+------------------------------------------------------------------------*/
+TRviArenaMark rviArenaMark ( TRviArena* arena )
+{
+    TRviArenaMark mark;
+
+    mark.chunk = arena->current;
+    mark.used  = arena->current ? arena->current->used : 0;
+
+    return mark;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ r e w i n d
+
+	@brief Release every block allocated since a mark was taken.
+
+	Marks must be rewound in the reverse of the order they were taken in.
+    Rewinding to a mark taken while the arena was empty also frees any
+    oversized chunks, so that one unusually large message does not pin its
+    storage for the life of the arena.
+
+	@param[in] arena - The address of the arena
+	@param[in] mark - A mark returned by rviArenaMark()
+
+------------------------------------------------------------------------*/
+void rviArenaRewind ( TRviArena* arena, TRviArenaMark mark )
+{
+    TRviArenaChunk** link;
+    TRviArenaChunk*  chunk;
+
+    if ( mark.chunk )
+    {
+        mark.chunk->used = mark.used;
+        arena->current   = mark.chunk;
+        return;
+    }
+    arena->current = NULL;
+
+    link = &arena->head;
+    while ( ( chunk = *link ) )
+    {
+        if ( chunk->size > arena->chunkSize )
+        {
+            *link = chunk->next;
+            free ( chunk );
+        }
+        else
+        {
+            link = &chunk->next;
+        }
+    }
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ a r e n a _ c o n t a i n s
+
+	@brief Test whether a block belongs to an arena.
+
+	@param[in] arena - The address of the arena
+	@param[in] ptr - The address to test
+
+	@return contained - true if the address is within the arena's storage
+
+------------------------------------------------------------------------*/
+bool rviArenaContains ( TRviArena* arena, const void* ptr )
+{
+    TRviArenaChunk* chunk;
+    uintptr_t       p = (uintptr_t)ptr;
+    uintptr_t       data;
+
+    for ( chunk = arena->head; chunk; chunk = chunk->next )
+    {
+        data = (uintptr_t)rviChunkData ( chunk );
+        if ( p >= data && p < data + chunk->size )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p o o l _ a l l o c
+
+	@brief Take an object from a pool.
+
+	A new slab of objects is allocated when none are free. The object is not
+    initialized.
+
+	@param[in] pool - The address of the pool
+
+	@return object - The aligned object, or NULL if out of memory
+
+------------------------------------------------------------------------*/
+void* rviPoolAlloc ( TRviPool* pool )
+{
+    char*  slab;
+    void*  object;
+    size_t size = RVI_ALIGN ( pool->size );
+    int    i;
+
+    if ( !pool->free )
+    {
+        //
+        //  The first aligned word of each slab links it to the next one;
+        //  the objects follow it.
+        //
+        if ( posix_memalign ( (void**)&slab, RVI_ALLOC_ALIGN,
+                              RVI_ALLOC_ALIGN +
+                              RVI_POOL_SLAB_OBJECTS * size ) != 0 )
+        {
+            return NULL;
+        }
+        *(void**)slab = pool->slabs;
+        pool->slabs   = slab;
+
+        for ( i = RVI_POOL_SLAB_OBJECTS - 1; i >= 0; --i )
+        {
+            object = slab + RVI_ALLOC_ALIGN + i * size;
+            *(void**)object = pool->free;
+            pool->free = object;
+        }
+    }
+    object     = pool->free;
+    pool->free = *(void**)object;
+
+    return object;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p o o l _ r e l e a s e
+
+	@brief Return an object to the pool it was taken from.
+
+	@param[in] pool - The address of the pool
+	@param[in] object - The object, which may be NULL
+
+------------------------------------------------------------------------*/
+void rviPoolRelease ( TRviPool* pool, void* object )
+{
+    if ( !object )
+    {
+        return;
+    }
+    *(void**)object = pool->free;
+    pool->free      = object;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ p o o l _ f r e e
+
+	@brief Release all of the storage held by a pool.
+
+	Every object taken from the pool becomes invalid. The pool is left empty
+    and may be used again.
+
+	@param[in] pool - The address of the pool
+
+------------------------------------------------------------------------*/
+void rviPoolFree ( TRviPool* pool )
+{
+    void* slab = pool->slabs;
+    void* next;
+
+    while ( slab )
+    {
+        next = *(void**)slab;
+        free ( slab );
+        slab = next;
+    }
+    pool->slabs = NULL;
+    pool->free  = NULL;
+}
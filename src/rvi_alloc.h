@@ -0,0 +1,102 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_ALLOC_H_
+#define _RVI_ALLOC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+//  Every block handed out by an arena or a pool is aligned to this many
+//  bytes, enough for any of the types stored in them.
+//
+#define RVI_ALLOC_ALIGN  16
+
+
+//
+//  One chunk of arena storage. The data follows the header, which is padded
+//  to keep the data aligned.
+//
+typedef struct TRviArenaChunk
+{
+    struct TRviArenaChunk*  next;  // Next chunk in the arena
+    size_t                  size;  // Bytes of data in this chunk
+    size_t                  used;  // Bytes of data handed out
+
+}   TRviArenaChunk;
+
+
+//
+//  A bump allocator for objects that all die together, such as everything
+//  allocated while decoding and dispatching one message. Allocation is a
+//  pointer increment; individual blocks are never freed. Instead, the arena
+//  is rewound to a mark taken earlier, which releases everything allocated
+//  after the mark at once. Chunks are kept for reuse, so an arena that has
+//  warmed up does not call the system allocator at all.
+//
+typedef struct TRviArena
+{
+    TRviArenaChunk*  head;       // First chunk, NULL until the first alloc
+    TRviArenaChunk*  current;    // Chunk allocations are taken from
+    size_t           chunkSize;  // Size of a regular chunk
+
+}   TRviArena;
+
+
+//
+//  A position in an arena, as returned by rviArenaMark().
+//
+typedef struct TRviArenaMark
+{
+    TRviArenaChunk*  chunk;
+    size_t           used;
+
+}   TRviArenaMark;
+
+
+//
+//  A free list of fixed size objects, carved out of slabs of
+//  RVI_POOL_SLAB_OBJECTS objects. Released objects are reused before new
+//  slabs are allocated, so objects that come and go over a long uptime do
+//  not fragment the heap.
+//
+#define RVI_POOL_SLAB_OBJECTS 32
+
+typedef struct TRviPool
+{
+    size_t  size;   // Size of one object, rounded up to RVI_ALLOC_ALIGN
+    void*   slabs;  // List of slabs, linked through their first word
+    void*   free;   // Released objects, linked through their first word
+
+}   TRviPool;
+
+#define RVI_POOL_INITIALIZER(objectSize) { (objectSize), NULL, NULL }
+
+
+int rviArenaInitialize ( TRviArena* arena, size_t chunkSize );
+
+void rviArenaFree ( TRviArena* arena );
+
+void* rviArenaAlloc ( TRviArena* arena, size_t size );
+
+TRviArenaMark rviArenaMark ( TRviArena* arena );
+
+void rviArenaRewind ( TRviArena* arena, TRviArenaMark mark );
+
+bool rviArenaContains ( TRviArena* arena, const void* ptr );
+
+void* rviPoolAlloc ( TRviPool* pool );
+
+void rviPoolRelease ( TRviPool* pool, void* object );
+
+void rviPoolFree ( TRviPool* pool );
+
+
+#endif // _RVI_ALLOC_H_
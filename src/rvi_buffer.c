@@ -0,0 +1,669 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_buffer.h"
+
+//
+//  Buffers that have grown beyond this size (e.g., to hold one unusually
+//  large message) release their storage once they are empty.
+//
+#define RVI_BUFFER_KEEP ( 4 * 16384 )
+
+//
+//  Deepest nesting accepted by rviFramerValidate(), the same as jansson's
+//  parser accepts by default.
+//
+#define RVI_FRAMER_MAX_DEPTH 2048
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ i n i t i a l i z e
+
+	@brief Initialize a new buffer data structure.
+
+	This function will initialize all of the fields in the buffer structure.
+    No storage is allocated until data is added to the buffer.
+
+	@param[in] buffer - The address of the buffer structure to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviBufferInitialize ( TRviBuffer* buffer )
+{
+    buffer->data  = NULL;
+    buffer->size  = 0;
+    buffer->start = 0;
+    buffer->end   = 0;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ f r e e
+
+	@brief Release the storage held by a buffer.
+
+	The buffer is left empty and may be used again.
+
+	@param[in] buffer - The address of the buffer
+
+------------------------------------------------------------------------*/
+void rviBufferFree ( TRviBuffer* buffer )
+{
+    free ( buffer->data );
+
+    rviBufferInitialize ( buffer );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ r e s e r v e
+
+	@brief Make room for new data at the tail of a buffer.
+
+	This function ensures that at least "length" bytes can be written at
+    rviBufferTail().  Space consumed at the head of the buffer is reclaimed
+    first by moving the unconsumed bytes to the start of the storage.  If
+    that is not enough, the storage is grown to at least twice its size.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] length - The number of bytes needed at the tail
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviBufferReserve ( TRviBuffer* buffer, size_t length )
+{
+    size_t unconsumed = buffer->end - buffer->start;
+    size_t newSize;
+    char*  newData;
+
+    //
+    //  If there is already enough room at the tail, there's nothing to do.
+    //
+    if ( buffer->size - buffer->end >= length )
+    {
+        return 0;
+    }
+    //
+    //  Reclaim the space before the first unconsumed byte.
+    //
+    if ( buffer->start > 0 )
+    {
+        memmove ( buffer->data, buffer->data + buffer->start, unconsumed );
+        buffer->start = 0;
+        buffer->end   = unconsumed;
+
+        if ( buffer->size - buffer->end >= length )
+        {
+            return 0;
+        }
+    }
+    //
+    //  Otherwise, grow the storage.
+    //
+    newSize = buffer->size ? buffer->size * 2 : length;
+    if ( newSize < unconsumed + length )
+    {
+        newSize = unconsumed + length;
+    }
+    newData = realloc ( buffer->data, newSize );
+    if ( !newData )
+    {
+        return ENOMEM;
+    }
+    buffer->data = newData;
+    buffer->size = newSize;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ a p p e n d
+
+	@brief Copy data to the tail of a buffer.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] data - The data to append
+	@param[in] length - The number of bytes to append
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviBufferAppend ( TRviBuffer* buffer, const void* data, size_t length )
+{
+    int status = rviBufferReserve ( buffer, length );
+
+    if ( status == 0 )
+    {
+        memcpy ( rviBufferTail ( buffer ), data, length );
+        rviBufferCommit ( buffer, length );
+    }
+    return status;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ a p p e n d _ j s o n _ s t r i n g
+
+	@brief Append a null terminated string to a buffer as a JSON string.
+
+	The string is enclosed in double quotes, and quotes, backslashes and
+    control characters are escaped. Other characters, including UTF-8
+    sequences, are copied unchanged.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] string - The string to append
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviBufferAppendJsonString ( TRviBuffer* buffer, const char* string )
+{
+    static const char hex[] = "0123456789abcdef";
+    const char*       run   = string;
+    const char*       p;
+    char              escape[6];
+    unsigned char     c;
+    int               status;
+
+    if ( ( status = rviBufferAppend ( buffer, "\"", 1 ) ) )
+    {
+        return status;
+    }
+    //
+    //  Copy runs of characters that need no escaping in one go.
+    //
+    for ( p = string; ( c = *p ) != '\0'; p++ )
+    {
+        if ( c != '"' && c != '\\' && c >= 0x20 )
+        {
+            continue;
+        }
+        if ( ( status = rviBufferAppend ( buffer, run, p - run ) ) )
+        {
+            return status;
+        }
+        escape[0] = '\\';
+        if ( c == '"' || c == '\\' )
+        {
+            escape[1] = c;
+            status = rviBufferAppend ( buffer, escape, 2 );
+        }
+        else
+        {
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xf];
+            status = rviBufferAppend ( buffer, escape, 6 );
+        }
+        if ( status )
+        {
+            return status;
+        }
+        run = p + 1;
+    }
+    if ( ( status = rviBufferAppend ( buffer, run, p - run ) ) )
+    {
+        return status;
+    }
+    return rviBufferAppend ( buffer, "\"", 1 );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ c o n s u m e
+
+	@brief Discard data from the head of a buffer.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] length - The number of bytes to discard
+
+------------------------------------------------------------------------*/
+void rviBufferConsume ( TRviBuffer* buffer, size_t length )
+{
+    if ( length > buffer->end - buffer->start )
+    {
+        length = buffer->end - buffer->start;
+    }
+    buffer->start += length;
+
+    //
+    //  Once everything has been consumed, start again at the beginning of
+    //  the storage so no copying is needed later.
+    //
+    if ( buffer->start == buffer->end )
+    {
+        if ( buffer->size > RVI_BUFFER_KEEP )
+        {
+            rviBufferFree ( buffer );
+        }
+        else
+        {
+            buffer->start = 0;
+            buffer->end   = 0;
+        }
+    }
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ b u f f e r _ c l e a r
+
+	@brief Discard all data in a buffer.
+
+	@param[in] buffer - The address of the buffer
+
+------------------------------------------------------------------------*/
+void rviBufferClear ( TRviBuffer* buffer )
+{
+    rviBufferConsume ( buffer, buffer->end - buffer->start );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f r a m e r _ i n i t i a l i z e
+
+	@brief Reset a framer to look for the start of a new message.
+
+	@param[in] framer - The address of the framer
+
+------------------------------------------------------------------------*/
+void rviFramerInitialize ( TRviFramer* framer )
+{
+    framer->scan     = 0;
+    framer->depth    = 0;
+    framer->inString = false;
+    framer->escape   = false;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f r a m e r _ n e x t
+
+	@brief Find the next complete JSON object in a buffer.
+
+	This function scans the unconsumed data in the buffer for the end of a
+    top level JSON object, tracking nesting of objects and arrays and
+    skipping over the contents of strings (including escaped quotes).  Any
+    bytes before the opening brace of a message are discarded.  Scanning
+    resumes where the previous call left off, so each byte is only examined
+    once no matter how many pieces a message arrives in.
+
+    When a complete message is found, it starts at rviBufferData() and its
+    length is returned.  The caller must consume it from the buffer (after
+    parsing it in place) before calling this function again.
+
+	@param[in] framer - The address of the framer state for the stream
+	@param[in] buffer - The address of the buffer holding the stream
+
+	@return length - The length of the complete message, or 0 if the
+                     buffer does not yet hold one.
+
+------------------------------------------------------------------------*/
+size_t rviFramerNext ( TRviFramer* framer, TRviBuffer* buffer )
+{
+    char*  data   = rviBufferData ( buffer );
+    size_t length = rviBufferLength ( buffer );
+    size_t i      = 0;
+    char   c;
+
+    //
+    //  If we haven't found the start of a message yet, discard everything
+    //  up to the next opening brace.
+    //
+    if ( framer->scan == 0 )
+    {
+        while ( i < length && data[i] != '{' )
+        {
+            i++;
+        }
+        rviBufferConsume ( buffer, i );
+        data   = rviBufferData ( buffer );
+        length = rviBufferLength ( buffer );
+    }
+    //
+    //  Scan the bytes that haven't been examined yet.
+    //
+    for ( i = framer->scan; i < length; i++ )
+    {
+        c = data[i];
+
+        if ( framer->inString )
+        {
+            if ( framer->escape )
+            {
+                framer->escape = false;
+            }
+            else if ( c == '\\' )
+            {
+                framer->escape = true;
+            }
+            else if ( c == '"' )
+            {
+                framer->inString = false;
+            }
+        }
+        else if ( c == '"' )
+        {
+            framer->inString = true;
+        }
+        else if ( c == '{' || c == '[' )
+        {
+            framer->depth++;
+        }
+        else if ( c == '}' || c == ']' )
+        {
+            //
+            //  If this closes the top level object, we have a message.
+            //
+            if ( --framer->depth == 0 )
+            {
+                rviFramerInitialize ( framer );
+                return i + 1;
+            }
+        }
+    }
+    //
+    //  Remember how far we got for next time.
+    //
+    framer->scan = length;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ f r a m e r _ v a l i d a t e
+
+	@brief Check that a block holds exactly one JSON object or array.
+
+	This is a cheap structural check, using the same single pass as the
+    framer: the data must consist of an object or array whose brackets
+    balance outside of strings, each closing bracket matching the one that
+    opened it, optionally surrounded by whitespace.  Nesting deeper than
+    RVI_FRAMER_MAX_DEPTH is rejected.  The contents are not otherwise
+    validated.  Data that passes this check can be
+    embedded in a message without upsetting the framing at the receiver.
+
+	@param[in] data - The data to check
+	@param[in] length - The length of the data
+
+	@return valid - true if the data passes the check
+
+------------------------------------------------------------------------*/
+bool rviFramerValidate ( const char* data, size_t length )
+{
+    TRviFramer    framer;
+    unsigned char objects[RVI_FRAMER_MAX_DEPTH / 8];
+    size_t        i = 0;
+    bool          object;
+    char          c;
+
+    rviFramerInitialize ( &framer );
+
+    while ( i < length && isspace ( (unsigned char)data[i] ) )
+    {
+        i++;
+    }
+    if ( i == length || ( data[i] != '{' && data[i] != '[' ) )
+    {
+        return false;
+    }
+    for ( ; i < length; i++ )
+    {
+        c = data[i];
+
+        if ( framer.inString )
+        {
+            if ( framer.escape )
+            {
+                framer.escape = false;
+            }
+            else if ( c == '\\' )
+            {
+                framer.escape = true;
+            }
+            else if ( c == '"' )
+            {
+                framer.inString = false;
+            }
+        }
+        else if ( c == '"' )
+        {
+            framer.inString = true;
+        }
+        //
+        //  One bit per level records whether it was opened as an object.
+        //
+        else if ( c == '{' || c == '[' )
+        {
+            if ( framer.depth == RVI_FRAMER_MAX_DEPTH )
+            {
+                return false;
+            }
+            if ( c == '{' )
+            {
+                objects[framer.depth / 8] |= 1 << ( framer.depth % 8 );
+            }
+            else
+            {
+                objects[framer.depth / 8] &= ~( 1 << ( framer.depth % 8 ) );
+            }
+            framer.depth++;
+        }
+        else if ( c == '}' || c == ']' )
+        {
+            framer.depth--;
+            object = objects[framer.depth / 8] & ( 1 << ( framer.depth % 8 ) );
+            if ( object != ( c == '}' ) )
+            {
+                return false;
+            }
+            if ( framer.depth == 0 )
+            {
+                break;
+            }
+        }
+    }
+    if ( i == length )
+    {
+        return false;
+    }
+    //
+    //  Only whitespace may follow the end of the value.
+    //
+    for ( i++; i < length; i++ )
+    {
+        if ( !isspace ( (unsigned char)data[i] ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//
+//  Return the offset just past the JSON string starting at data[i], which
+//  must be the opening quote.
+//
+static size_t rviJsonSkipString ( const char* data, size_t length, size_t i )
+{
+    for ( i++; i < length; i++ )
+    {
+        if ( data[i] == '\\' )
+        {
+            i++;
+        }
+        else if ( data[i] == '"' )
+        {
+            return i + 1;
+        }
+    }
+    return length;
+}
+
+
+//
+//  Return the offset just past the JSON value starting at data[i].
+//
+static size_t rviJsonSkipValue ( const char* data, size_t length, size_t i )
+{
+    unsigned int depth = 0;
+
+    if ( i < length && data[i] == '"' )
+    {
+        return rviJsonSkipString ( data, length, i );
+    }
+    if ( i < length && data[i] != '{' && data[i] != '[' )
+    {
+        //
+        //  A number, true, false or null runs up to the next delimiter.
+        //
+        while ( i < length && data[i] != ',' && data[i] != '}' &&
+                data[i] != ']' && !isspace ( (unsigned char)data[i] ) )
+        {
+            i++;
+        }
+        return i;
+    }
+    while ( i < length )
+    {
+        if ( data[i] == '"' )
+        {
+            i = rviJsonSkipString ( data, length, i );
+            continue;
+        }
+        if ( data[i] == '{' || data[i] == '[' )
+        {
+            depth++;
+        }
+        else if ( data[i] == '}' || data[i] == ']' )
+        {
+            if ( --depth == 0 )
+            {
+                return i + 1;
+            }
+        }
+        i++;
+    }
+    return length;
+}
+
+
+static size_t rviJsonSkipSpace ( const char* data, size_t length, size_t i )
+{
+    while ( i < length && isspace ( (unsigned char)data[i] ) )
+    {
+        i++;
+    }
+    return i;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ j s o n _ f i n d _ m e m b e r
+
+	@brief Find the text of a member's value in a serialized JSON object.
+
+	The object is scanned without being parsed, so the value is returned as
+    a view into the original data rather than a copy.  Keys are compared as
+    they appear in the data, so a key written with escape sequences will not
+    match.  If the key occurs more than once, the last occurrence is found,
+    as it is by jansson.  The data is expected to be valid JSON, e.g., a
+    message that has already been parsed successfully.
+
+	@param[in] data - The serialized object
+	@param[in] length - The length of the data
+	@param[in] key - The member name to look for
+	@param[out] value - Set to the start of the member's value
+	@param[out] valueLength - Set to the length of the member's value
+
+	@return found - true if the member was found
+
+------------------------------------------------------------------------*/
+bool rviJsonFindMember ( const char* data, size_t length, const char* key,
+                         const char** value, size_t* valueLength )
+{
+    size_t keyLength = strlen ( key );
+    size_t i;
+    size_t keyStart;
+    size_t keyEnd;
+    size_t valueStart;
+    bool   found = false;
+
+    i = rviJsonSkipSpace ( data, length, 0 );
+    if ( i == length || data[i] != '{' )
+    {
+        return false;
+    }
+    i++;
+
+    while ( true )
+    {
+        i = rviJsonSkipSpace ( data, length, i );
+        if ( i == length || data[i] != '"' )
+        {
+            break;
+        }
+        keyStart = i + 1;
+        i = rviJsonSkipString ( data, length, i );
+        keyEnd = i - 1;
+
+        i = rviJsonSkipSpace ( data, length, i );
+        if ( i == length || data[i] != ':' )
+        {
+            break;
+        }
+        valueStart = rviJsonSkipSpace ( data, length, i + 1 );
+        i = rviJsonSkipValue ( data, length, valueStart );
+
+        if ( keyEnd - keyStart == keyLength &&
+             memcmp ( data + keyStart, key, keyLength ) == 0 )
+        {
+            *value       = data + valueStart;
+            *valueLength = i - valueStart;
+            found        = true;
+        }
+
+        i = rviJsonSkipSpace ( data, length, i );
+        if ( i == length || data[i] != ',' )
+        {
+            break;
+        }
+        i++;
+    }
+    return found;
+}
@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_BUFFER_H_
+#define _RVI_BUFFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+//  A growable byte buffer with separate read and write offsets. Data is
+//  appended at the tail and consumed from the head without copying. Space
+//  freed at the head is reclaimed by moving the unconsumed bytes down only
+//  when the tail runs out of room, so the cost of reclaiming is amortized
+//  over the data consumed. The unconsumed bytes are always contiguous, which
+//  lets complete messages be handed to a parser in place.
+//
+typedef struct TRviBuffer
+{
+    char*   data;       // Storage for the buffer
+    size_t  size;       // Number of bytes allocated
+    size_t  start;      // Offset of the first unconsumed byte
+    size_t  end;        // Offset just past the last valid byte
+
+}   TRviBuffer;
+
+
+//
+//  Incremental framer state for a stream of JSON objects. Each byte is
+//  examined once: the framer remembers how far it has scanned into the
+//  current message, along with the nesting depth and string state at that
+//  point, so data arriving in pieces is never rescanned from the start.
+//
+typedef struct TRviFramer
+{
+    size_t        scan;      // Bytes of the current message already scanned
+    unsigned int  depth;     // Nesting depth of objects and arrays
+    bool          inString;  // Inside a string literal
+    bool          escape;    // Previous byte was a backslash in a string
+
+}   TRviFramer;
+
+
+int rviBufferInitialize ( TRviBuffer* buffer );
+
+void rviBufferFree ( TRviBuffer* buffer );
+
+int rviBufferReserve ( TRviBuffer* buffer, size_t length );
+
+int rviBufferAppend ( TRviBuffer* buffer, const void* data, size_t length );
+
+int rviBufferAppendJsonString ( TRviBuffer* buffer, const char* string );
+
+void rviBufferConsume ( TRviBuffer* buffer, size_t length );
+
+void rviBufferClear ( TRviBuffer* buffer );
+
+static inline char* rviBufferData ( TRviBuffer* buffer )
+{
+    return buffer->data + buffer->start;
+}
+
+static inline size_t rviBufferLength ( TRviBuffer* buffer )
+{
+    return buffer->end - buffer->start;
+}
+
+static inline char* rviBufferTail ( TRviBuffer* buffer )
+{
+    return buffer->data + buffer->end;
+}
+
+static inline void rviBufferCommit ( TRviBuffer* buffer, size_t length )
+{
+    buffer->end += length;
+}
+
+//
+//  Drop everything after the first "length" unconsumed bytes, e.g., to undo
+//  a partially appended message.
+//
+static inline void rviBufferTruncate ( TRviBuffer* buffer, size_t length )
+{
+    if ( length < buffer->end - buffer->start )
+    {
+        buffer->end = buffer->start + length;
+    }
+}
+
+
+void rviFramerInitialize ( TRviFramer* framer );
+
+size_t rviFramerNext ( TRviFramer* framer, TRviBuffer* buffer );
+
+bool rviFramerValidate ( const char* data, size_t length );
+
+bool rviJsonFindMember ( const char* data, size_t length, const char* key,
+                         const char** value, size_t* valueLength );
+
+static inline size_t rviFramerPending ( TRviFramer* framer )
+{
+    return framer->scan;
+}
+
+
+#endif // _RVI_BUFFER_H_
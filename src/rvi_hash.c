@@ -0,0 +1,389 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_hash.h"
+
+//
+//  The initial number of slots. The table grows by doubling whenever it
+//  would become more than 3/4 full, which keeps probe sequences short.
+//
+#define RVI_HASH_MIN_CAPACITY 16
+
+
+//
+//  Return the slot holding the key, or the empty slot where it would go.
+//
+static size_t rviHashProbe ( TRviHash* hash, const void* key, uint32_t h )
+{
+    size_t mask = hash->capacity - 1;
+    size_t i    = h & mask;
+
+    while ( hash->slots[i].key )
+    {
+        if ( hash->slots[i].hash == h &&
+             hash->equalFn ( hash->slots[i].key, key ) )
+        {
+            break;
+        }
+        i = ( i + 1 ) & mask;
+    }
+    return i;
+}
+
+
+//
+//  Move all entries into a new slot array of the given capacity.
+//
+static int rviHashResize ( TRviHash* hash, size_t capacity )
+{
+    TRviHashSlot* old         = hash->slots;
+    size_t        oldCapacity = hash->capacity;
+    size_t        mask        = capacity - 1;
+    size_t        i;
+    size_t        j;
+
+    hash->slots = calloc ( capacity, sizeof(TRviHashSlot) );
+    if ( !hash->slots )
+    {
+        hash->slots = old;
+        return ENOMEM;
+    }
+    hash->capacity = capacity;
+
+    for ( i = 0; i < oldCapacity; i++ )
+    {
+        if ( old[i].key )
+        {
+            j = old[i].hash & mask;
+            while ( hash->slots[j].key )
+            {
+                j = ( j + 1 ) & mask;
+            }
+            hash->slots[j] = old[i];
+        }
+    }
+    free ( old );
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ i n i t i a l i z e
+
+	@brief Initialize a new hash table.
+
+	No storage is allocated until the first record is inserted.
+
+	@param[in] hash - The address of the hash table to initialize
+	@param[in] hashFn - The function used to hash keys
+	@param[in] equalFn - The function used to compare keys
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviHashInitialize ( TRviHash* hash, TRviHashFunction hashFn,
+                        TRviHashEqual equalFn )
+{
+    if ( !hash || !hashFn || !equalFn )
+    {
+        return EINVAL;
+    }
+    hash->slots    = NULL;
+    hash->capacity = 0;
+    hash->count    = 0;
+    hash->hashFn   = hashFn;
+    hash->equalFn  = equalFn;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ f r e e
+
+	@brief Release the storage held by a hash table.
+
+	The keys and values are not freed. The table is left empty and may be
+    used again.
+
+	@param[in] hash - The address of the hash table
+
+------------------------------------------------------------------------*/
+void rviHashFree ( TRviHash* hash )
+{
+    free ( hash->slots );
+
+    hash->slots    = NULL;
+    hash->capacity = 0;
+    hash->count    = 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ f i n d
+
+	@brief Find the record stored under a key.
+
+	@param[in] hash - The address of the hash table
+	@param[in] key - The key to look for
+
+	@return value - The record, or NULL if the key is not in the table
+
+------------------------------------------------------------------------*/
+void* rviHashFind ( TRviHash* hash, const void* key )
+{
+    size_t i;
+
+    if ( hash->count == 0 )
+    {
+        return NULL;
+    }
+    i = rviHashProbe ( hash, key, hash->hashFn ( key ) );
+
+    return hash->slots[i].key ? hash->slots[i].value : NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ i n s e r t
+
+	@brief Insert a record into a hash table.
+
+	@param[in] hash - The address of the hash table
+	@param[in] key - The key for the record
+	@param[in] value - The record to insert, which may not be NULL
+
+	@return status - 0: Success
+                     EEXIST: The key is already in the table
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviHashInsert ( TRviHash* hash, const void* key, void* value )
+{
+    uint32_t h;
+    size_t   i;
+    int      status;
+
+    if ( !key || !value )
+    {
+        return EINVAL;
+    }
+    //
+    //  Grow the table first if this record would make it too full.
+    //
+    if ( ( hash->count + 1 ) * 4 > hash->capacity * 3 )
+    {
+        status = rviHashResize ( hash, hash->capacity ?
+                                       hash->capacity * 2 :
+                                       RVI_HASH_MIN_CAPACITY );
+        if ( status != 0 )
+        {
+            return status;
+        }
+    }
+    h = hash->hashFn ( key );
+    i = rviHashProbe ( hash, key, h );
+    if ( hash->slots[i].key )
+    {
+        return EEXIST;
+    }
+    hash->slots[i].key   = key;
+    hash->slots[i].value = value;
+    hash->slots[i].hash  = h;
+    hash->count++;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ r e m o v e
+
+	@brief Remove the record stored under a key.
+
+	The entries following the removed one in its probe sequence are shifted
+    back to close the gap, so no tombstones are left behind and lookups never
+    slow down as records come and go.
+
+	@param[in] hash - The address of the hash table
+	@param[in] key - The key of the record to remove
+
+	@return value - The record removed, or NULL if the key was not found
+
+------------------------------------------------------------------------*/
+void* rviHashRemove ( TRviHash* hash, const void* key )
+{
+    size_t mask;
+    size_t i;
+    size_t j;
+    size_t k;
+    void*  value;
+
+    if ( hash->count == 0 )
+    {
+        return NULL;
+    }
+    mask = hash->capacity - 1;
+    i    = rviHashProbe ( hash, key, hash->hashFn ( key ) );
+    if ( !hash->slots[i].key )
+    {
+        return NULL;
+    }
+    value = hash->slots[i].value;
+
+    //
+    //  Move back each following entry that may legally occupy the hole,
+    //  i.e., whose home slot is not between the hole and its position.
+    //
+    for ( j = ( i + 1 ) & mask; hash->slots[j].key; j = ( j + 1 ) & mask )
+    {
+        k = hash->slots[j].hash & mask;
+        if ( ( ( j - k ) & mask ) >= ( ( j - i ) & mask ) )
+        {
+            hash->slots[i] = hash->slots[j];
+            i = j;
+        }
+    }
+    hash->slots[i].key   = NULL;
+    hash->slots[i].value = NULL;
+    hash->count--;
+
+    return value;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ c l e a r
+
+	@brief Remove all records from a hash table, keeping its storage.
+
+	@param[in] hash - The address of the hash table
+
+------------------------------------------------------------------------*/
+void rviHashClear ( TRviHash* hash )
+{
+    if ( hash->slots )
+    {
+        memset ( hash->slots, 0, hash->capacity * sizeof(TRviHashSlot) );
+    }
+    hash->count = 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ n e x t
+
+	@brief Iterate over the records in a hash table.
+
+	Set *index to 0 before the first call. Each call returns the next record
+    and advances *index past it. The table must not be modified while it is
+    being iterated, except by removing the record just returned, which may
+    cause another record to be skipped.
+
+	@param[in] hash - The address of the hash table
+	@param[in,out] index - The iteration position
+
+	@return value - The next record, or NULL when there are no more
+
+------------------------------------------------------------------------*/
+void* rviHashNext ( TRviHash* hash, size_t* index )
+{
+    while ( *index < hash->capacity )
+    {
+        TRviHashSlot* slot = &hash->slots[( *index )++];
+
+        if ( slot->key )
+        {
+            return slot->value;
+        }
+    }
+    return NULL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ b y t e s
+
+	@brief Compute the 32 bit FNV-1a hash of a block of memory.
+
+	@param[in] data - The address of the data
+	@param[in] length - The number of bytes to hash
+
+	@return hash - The hash value
+
+------------------------------------------------------------------------*/
+uint32_t rviHashBytes ( const void* data, size_t length )
+{
+    const unsigned char* p = data;
+    uint32_t             h = 2166136261u;
+
+    while ( length-- )
+    {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ s t r i n g
+
+	@brief Compute the 32 bit FNV-1a hash of a null terminated string.
+
+	@param[in] key - The string
+
+	@return hash - The hash value
+
+------------------------------------------------------------------------*/
+uint32_t rviHashString ( const void* key )
+{
+    const unsigned char* p = key;
+    uint32_t             h = 2166136261u;
+
+    while ( *p )
+    {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ h a s h _ s t r i n g _ e q u a l
+
+	@brief Compare two null terminated string keys.
+
+	@param[in] key1 - The first string
+	@param[in] key2 - The second string
+
+	@return equal - true if the strings are the same
+
+------------------------------------------------------------------------*/
+bool rviHashStringEqual ( const void* key1, const void* key2 )
+{
+    return strcmp ( key1, key2 ) == 0;
+}
@@ -0,0 +1,78 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_HASH_H_
+#define _RVI_HASH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t (*TRviHashFunction) ( const void* key );
+
+typedef bool (*TRviHashEqual) ( const void* key1, const void* key2 );
+
+//
+//  A slot in the hash table. Empty slots have a NULL key. The full hash is
+//  kept in the slot so that growing the table and probing past other keys
+//  don't need to call the hash or compare functions.
+//
+typedef struct TRviHashSlot
+{
+    const void*  key;       // Key, normally pointing into the value
+    void*        value;     // The record stored under the key
+    uint32_t     hash;      // Hash of the key
+
+}   TRviHashSlot;
+
+
+//
+//  An open addressing hash table using linear probing. The table does not
+//  own its keys or values: keys must stay valid and unchanged while they are
+//  in the table, which is easiest when the key is a field of the value.
+//
+typedef struct TRviHash
+{
+    TRviHashSlot*     slots;     // Slot array, capacity is a power of 2
+    size_t            capacity;  // Number of slots allocated
+    size_t            count;     // Number of slots in use
+    TRviHashFunction  hashFn;    // Hashes a key
+    TRviHashEqual     equalFn;   // Compares two keys
+
+}   TRviHash;
+
+
+int rviHashInitialize ( TRviHash* hash, TRviHashFunction hashFn,
+                        TRviHashEqual equalFn );
+
+void rviHashFree ( TRviHash* hash );
+
+void* rviHashFind ( TRviHash* hash, const void* key );
+
+int rviHashInsert ( TRviHash* hash, const void* key, void* value );
+
+void* rviHashRemove ( TRviHash* hash, const void* key );
+
+void rviHashClear ( TRviHash* hash );
+
+void* rviHashNext ( TRviHash* hash, size_t* index );
+
+uint32_t rviHashBytes ( const void* data, size_t length );
+
+uint32_t rviHashString ( const void* key );
+
+bool rviHashStringEqual ( const void* key1, const void* key2 );
+
+static inline size_t rviHashGetCount ( TRviHash* hash )
+{
+    return hash->count;
+}
+
+
+#endif // _RVI_HASH_H_
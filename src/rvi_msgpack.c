@@ -0,0 +1,823 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvi_msgpack.h"
+
+//
+//  Strings shorter than this are copied to the stack to be null-terminated
+//  for jansson; longer ones are copied to the heap.
+//
+#define RVI_MSGPACK_SCRATCH 256
+
+
+//
+//  Append a type byte followed by n bytes of value, most significant first.
+//
+static int rviMsgpackPut ( TRviBuffer* buffer, unsigned char type,
+                           uint64_t value, int n )
+{
+    unsigned char bytes[9];
+    int           i;
+
+    bytes[0] = type;
+    for ( i = n; i > 0; --i )
+    {
+        bytes[i] = value & 0xff;
+        value >>= 8;
+    }
+    return rviBufferAppend ( buffer, bytes, n + 1 );
+}
+
+
+//
+//  Append the header of a string, array or map: the short form holds the
+//  length in the type byte, the others follow it with 1, 2 or 4 bytes.
+//  Lengths that need 1 byte only have a form of their own for strings.
+//
+static int rviMsgpackPutLength ( TRviBuffer* buffer, size_t length,
+                                 unsigned char fix, size_t fixMax,
+                                 unsigned char type8, unsigned char type16,
+                                 unsigned char type32 )
+{
+    if ( length <= fixMax )
+    {
+        return rviMsgpackPut ( buffer, fix | length, 0, 0 );
+    }
+    if ( type8 && length <= UINT8_MAX )
+    {
+        return rviMsgpackPut ( buffer, type8, length, 1 );
+    }
+    if ( length <= UINT16_MAX )
+    {
+        return rviMsgpackPut ( buffer, type16, length, 2 );
+    }
+    if ( length <= UINT32_MAX )
+    {
+        return rviMsgpackPut ( buffer, type32, length, 4 );
+    }
+    return EINVAL;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ p u t _ s t r i n g
+
+	@brief Append a string to a buffer, encoded with MessagePack.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] string - The UTF-8 string, which need not be null-terminated
+	@param[in] length - The number of bytes in string
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviMsgpackPutString ( TRviBuffer* buffer, const char* string,
+                          size_t length )
+{
+    int status = rviMsgpackPutLength ( buffer, length, 0xa0, 31,
+                                       0xd9, 0xda, 0xdb );
+
+    if ( status == 0 )
+    {
+        status = rviBufferAppend ( buffer, string, length );
+    }
+    return status;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ p u t _ i n t e g e r
+
+	@brief Append an integer to a buffer, in the smallest MessagePack
+           encoding that holds it.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] v - The integer
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviMsgpackPutInteger ( TRviBuffer* buffer, long long v )
+{
+    if ( v >= 0 )
+    {
+        if ( v <= 0x7f )       return rviMsgpackPut ( buffer, v, 0, 0 );
+        if ( v <= UINT8_MAX )  return rviMsgpackPut ( buffer, 0xcc, v, 1 );
+        if ( v <= UINT16_MAX ) return rviMsgpackPut ( buffer, 0xcd, v, 2 );
+        if ( v <= UINT32_MAX ) return rviMsgpackPut ( buffer, 0xce, v, 4 );
+        return rviMsgpackPut ( buffer, 0xcf, v, 8 );
+    }
+    if ( v >= -32 )        return rviMsgpackPut ( buffer, v & 0xff, 0, 0 );
+    if ( v >= INT8_MIN )   return rviMsgpackPut ( buffer, 0xd0, v & 0xff, 1 );
+    if ( v >= INT16_MIN )  return rviMsgpackPut ( buffer, 0xd1, v & 0xffff, 2 );
+    if ( v >= INT32_MIN )
+    {
+        return rviMsgpackPut ( buffer, 0xd2, v & 0xffffffff, 4 );
+    }
+    return rviMsgpackPut ( buffer, 0xd3, (uint64_t)v, 8 );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ p u t _ m a p
+
+	@brief Append the header of a map to a buffer. The keys and values
+           follow it, in turn.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] count - The number of key and value pairs in the map
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviMsgpackPutMap ( TRviBuffer* buffer, size_t count )
+{
+    return rviMsgpackPutLength ( buffer, count, 0x80, 15, 0, 0xde, 0xdf );
+}
+
+
+static int rviMsgpackPutReal ( TRviBuffer* buffer, double value )
+{
+    uint64_t bits;
+
+    memcpy ( &bits, &value, sizeof(bits) );
+
+    return rviMsgpackPut ( buffer, 0xcb, bits, 8 );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ e n c o d e
+
+	@brief Append a JSON value to a buffer, encoded with MessagePack.
+
+	Objects become maps with string keys, and integers take the smallest
+    encoding that holds them. On failure, the buffer may hold part of the
+    encoding; the caller truncates it.
+
+	@param[in] buffer - The address of the buffer
+	@param[in] value - The value to encode
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviMsgpackEncode ( TRviBuffer* buffer, json_t* value )
+{
+    const char* key;
+    void*       iter;
+    size_t      i;
+    int         status;
+
+    if ( !buffer || !value )
+    {
+        return EINVAL;
+    }
+    switch ( json_typeof ( value ) )
+    {
+    case JSON_OBJECT:
+        status = rviMsgpackPutMap ( buffer, json_object_size ( value ) );
+        for ( iter = json_object_iter ( value ); iter && status == 0;
+              iter = json_object_iter_next ( value, iter ) )
+        {
+            key    = json_object_iter_key ( iter );
+            status = rviMsgpackPutString ( buffer, key, strlen ( key ) );
+            if ( status == 0 )
+            {
+                status = rviMsgpackEncode ( buffer,
+                                            json_object_iter_value ( iter ) );
+            }
+        }
+        return status;
+
+    case JSON_ARRAY:
+        status = rviMsgpackPutLength ( buffer, json_array_size ( value ),
+                                       0x90, 15, 0, 0xdc, 0xdd );
+        for ( i = 0; i < json_array_size ( value ) && status == 0; i++ )
+        {
+            status = rviMsgpackEncode ( buffer, json_array_get ( value, i ) );
+        }
+        return status;
+
+    case JSON_STRING:
+        key = json_string_value ( value );
+        return rviMsgpackPutString ( buffer, key, strlen ( key ) );
+
+    case JSON_INTEGER:
+        return rviMsgpackPutInteger ( buffer, json_integer_value ( value ) );
+
+    case JSON_REAL:
+        return rviMsgpackPutReal ( buffer, json_real_value ( value ) );
+
+    case JSON_TRUE:
+        return rviMsgpackPut ( buffer, 0xc3, 0, 0 );
+
+    case JSON_FALSE:
+        return rviMsgpackPut ( buffer, 0xc2, 0, 0 );
+
+    default:
+        return rviMsgpackPut ( buffer, 0xc0, 0, 0 );
+    }
+}
+
+
+//
+//  A position in the data being decoded.
+//
+typedef struct TRviMsgpackReader
+{
+    const unsigned char* data;
+    size_t               length;
+    size_t               offset;
+
+}   TRviMsgpackReader;
+
+
+//
+//  Read n bytes of value, most significant first.
+//
+static bool rviMsgpackGet ( TRviMsgpackReader* reader, int n,
+                            uint64_t* value )
+{
+    int i;
+
+    if ( reader->length - reader->offset < (size_t)n )
+    {
+        return false;
+    }
+    *value = 0;
+    for ( i = 0; i < n; i++ )
+    {
+        *value = ( *value << 8 ) | reader->data[reader->offset++];
+    }
+    return true;
+}
+
+
+//
+//  Read the header of a string and return its length. Map keys must be
+//  strings.
+//
+static bool rviMsgpackGetStringLength ( TRviMsgpackReader* reader,
+                                        uint64_t* length )
+{
+    unsigned char type;
+
+    if ( reader->offset >= reader->length )
+    {
+        return false;
+    }
+    type = reader->data[reader->offset++];
+    if ( ( type & 0xe0 ) == 0xa0 )
+    {
+        *length = type & 0x1f;
+        return true;
+    }
+    if ( type < 0xd9 || type > 0xdb )
+    {
+        return false;
+    }
+    return rviMsgpackGet ( reader, 1 << ( type - 0xd9 ), length );
+}
+
+
+//
+//  Read the bytes of a string of the given length, null-terminated for
+//  jansson, into scratch if they fit or into memory that must be freed
+//  otherwise. JSON strings can't hold null bytes.
+//
+static char* rviMsgpackGetChars ( TRviMsgpackReader* reader, size_t length,
+                                  char* scratch )
+{
+    char* string = scratch;
+
+    if ( reader->length - reader->offset < length ||
+         memchr ( reader->data + reader->offset, 0, length ) )
+    {
+        return NULL;
+    }
+    if ( length >= RVI_MSGPACK_SCRATCH && !( string = malloc ( length + 1 ) ) )
+    {
+        return NULL;
+    }
+    memcpy ( string, reader->data + reader->offset, length );
+    string[length] = 0;
+    reader->offset += length;
+
+    return string;
+}
+
+
+//
+//  Read a string value. jansson checks that it is UTF-8.
+//
+static json_t* rviMsgpackGetString ( TRviMsgpackReader* reader, size_t length )
+{
+    char    scratch[RVI_MSGPACK_SCRATCH];
+    char*   string = rviMsgpackGetChars ( reader, length, scratch );
+    json_t* value  = string ? json_string ( string ) : NULL;
+
+    if ( string != scratch )
+    {
+        free ( string );
+    }
+    return value;
+}
+
+
+static json_t* rviMsgpackGetValue ( TRviMsgpackReader* reader, int depth );
+
+
+static json_t* rviMsgpackGetArray ( TRviMsgpackReader* reader, size_t count,
+                                    int depth )
+{
+    json_t* array = json_array ();
+    json_t* item;
+
+    while ( array && count-- > 0 )
+    {
+        item = rviMsgpackGetValue ( reader, depth + 1 );
+        if ( !item || json_array_append_new ( array, item ) != 0 )
+        {
+            json_decref ( array );
+            return NULL;
+        }
+    }
+    return array;
+}
+
+
+static json_t* rviMsgpackGetMap ( TRviMsgpackReader* reader, size_t count,
+                                  int depth )
+{
+    char          scratch[RVI_MSGPACK_SCRATCH];
+    json_t*       map = json_object ();
+    json_t*       item;
+    char*         key;
+    uint64_t      length;
+    int           status;
+
+    while ( map && count-- > 0 )
+    {
+        //
+        //  Keys must be strings; jansson checks that they are UTF-8.
+        //
+        key = rviMsgpackGetStringLength ( reader, &length ) ?
+              rviMsgpackGetChars ( reader, length, scratch ) : NULL;
+        item   = key ? rviMsgpackGetValue ( reader, depth + 1 ) : NULL;
+        status = item ? json_object_set_new ( map, key, item ) : -1;
+        if ( key != scratch )
+        {
+            free ( key );
+        }
+        if ( status != 0 )
+        {
+            json_decref ( map );
+            return NULL;
+        }
+    }
+    return map;
+}
+
+
+static json_t* rviMsgpackGetValue ( TRviMsgpackReader* reader, int depth )
+{
+    unsigned char type;
+    uint64_t      v;
+    uint32_t      bits32;
+    float         f;
+    double        d;
+
+    if ( depth > RVI_MSGPACK_MAX_DEPTH || reader->offset >= reader->length )
+    {
+        return NULL;
+    }
+    type = reader->data[reader->offset++];
+
+    if ( type <= 0x7f )              return json_integer ( type );
+    if ( type >= 0xe0 )              return json_integer ( (signed char)type );
+    if ( ( type & 0xf0 ) == 0x80 )   return rviMsgpackGetMap ( reader, type & 0x0f, depth );
+    if ( ( type & 0xf0 ) == 0x90 )   return rviMsgpackGetArray ( reader, type & 0x0f, depth );
+    if ( ( type & 0xe0 ) == 0xa0 )   return rviMsgpackGetString ( reader, type & 0x1f );
+
+    switch ( type )
+    {
+    case 0xc0: return json_null ();
+    case 0xc2: return json_false ();
+    case 0xc3: return json_true ();
+
+    case 0xca:
+        if ( !rviMsgpackGet ( reader, 4, &v ) ) return NULL;
+        bits32 = v;
+        memcpy ( &f, &bits32, sizeof(f) );
+        return json_real ( f );
+    case 0xcb:
+        if ( !rviMsgpackGet ( reader, 8, &v ) ) return NULL;
+        memcpy ( &d, &v, sizeof(d) );
+        return json_real ( d );
+
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if ( !rviMsgpackGet ( reader, 1 << ( type - 0xcc ), &v ) ||
+             v > LLONG_MAX )
+        {
+            return NULL;
+        }
+        return json_integer ( v );
+    case 0xd0: return rviMsgpackGet ( reader, 1, &v ) ? json_integer ( (int8_t)v ) : NULL;
+    case 0xd1: return rviMsgpackGet ( reader, 2, &v ) ? json_integer ( (int16_t)v ) : NULL;
+    case 0xd2: return rviMsgpackGet ( reader, 4, &v ) ? json_integer ( (int32_t)v ) : NULL;
+    case 0xd3: return rviMsgpackGet ( reader, 8, &v ) ? json_integer ( (int64_t)v ) : NULL;
+
+    case 0xd9: case 0xda: case 0xdb:
+        if ( !rviMsgpackGet ( reader, 1 << ( type - 0xd9 ), &v ) ) return NULL;
+        return rviMsgpackGetString ( reader, v );
+    case 0xdc: case 0xdd:
+        if ( !rviMsgpackGet ( reader, 2 << ( type - 0xdc ), &v ) ) return NULL;
+        return rviMsgpackGetArray ( reader, v, depth );
+    case 0xde: case 0xdf:
+        if ( !rviMsgpackGet ( reader, 2 << ( type - 0xde ), &v ) ) return NULL;
+        return rviMsgpackGetMap ( reader, v, depth );
+
+    default:
+        //
+        //  Binary data and extension types have no JSON equivalent.
+        //
+        return NULL;
+    }
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ d e c o d e
+
+	@brief Decode one MessagePack value into JSON.
+
+	The data must hold exactly one value. Maps must have string keys, and
+    strings must be UTF-8 without null bytes; binary data and extension
+    types are rejected.
+
+	@param[in] data - The encoded value
+	@param[in] length - The number of bytes in data
+
+	@return value - A new reference to the value, or NULL if the data is not
+                    a valid value or memory ran out
+
+------------------------------------------------------------------------*/
+json_t* rviMsgpackDecode ( const char* data, size_t length )
+{
+    TRviMsgpackReader reader;
+    json_t*           value;
+
+    if ( !data )
+    {
+        return NULL;
+    }
+    reader.data   = (const unsigned char*)data;
+    reader.length = length;
+    reader.offset = 0;
+
+    value = rviMsgpackGetValue ( &reader, 0 );
+    if ( value && reader.offset != length )
+    {
+        json_decref ( value );
+        value = NULL;
+    }
+    return value;
+}
+
+
+//
+//  Step over one value without decoding it, accepting the same values as
+//  rviMsgpackGetValue().
+//
+static bool rviMsgpackSkip ( TRviMsgpackReader* reader, int depth )
+{
+    unsigned char type;
+    uint64_t      count = 0;
+    uint64_t      length = 0;
+
+    if ( depth > RVI_MSGPACK_MAX_DEPTH || reader->offset >= reader->length )
+    {
+        return false;
+    }
+    type = reader->data[reader->offset++];
+
+    if ( type <= 0x7f || type >= 0xe0 )
+    {
+        return true;
+    }
+    if ( ( type & 0xf0 ) == 0x80 )
+    {
+        count = 2 * ( type & 0x0f );
+    }
+    else if ( ( type & 0xf0 ) == 0x90 )
+    {
+        count = type & 0x0f;
+    }
+    else if ( ( type & 0xe0 ) == 0xa0 )
+    {
+        length = type & 0x1f;
+    }
+    else switch ( type )
+    {
+    case 0xc0: case 0xc2: case 0xc3:
+        break;
+
+    case 0xca: length = 4; break;
+    case 0xcb: length = 8; break;
+
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        length = 1 << ( type - 0xcc );
+        break;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+        length = 1 << ( type - 0xd0 );
+        break;
+
+    case 0xd9: case 0xda: case 0xdb:
+        if ( !rviMsgpackGet ( reader, 1 << ( type - 0xd9 ), &length ) ) return false;
+        break;
+    case 0xdc: case 0xdd:
+        if ( !rviMsgpackGet ( reader, 2 << ( type - 0xdc ), &count ) ) return false;
+        break;
+    case 0xde: case 0xdf:
+        if ( !rviMsgpackGet ( reader, 2 << ( type - 0xde ), &count ) ) return false;
+        count *= 2;
+        break;
+
+    default:
+        return false;
+    }
+
+    if ( reader->length - reader->offset < length )
+    {
+        return false;
+    }
+    reader->offset += length;
+
+    while ( count-- > 0 )
+    {
+        if ( !rviMsgpackSkip ( reader, depth + 1 ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ f i n d _ m e m b e r
+
+	@brief Find the encoding of a member's value in a MessagePack map.
+
+	The map is scanned without being decoded, so the value is returned as
+    a view into the original data, to be read with rviMsgpackDecode() or
+    rviMsgpackGetInteger().  If the key occurs more than once, the last
+    occurrence is found, as it is when decoding.  Data after the map is
+    ignored.
+
+	@param[in] data - The encoded map
+	@param[in] length - The number of bytes in data
+	@param[in] key - The member name to look for
+	@param[out] value - Set to the start of the member's value
+	@param[out] valueLength - Set to the length of the member's value
+
+	@return found - true if the member was found
+
+------------------------------------------------------------------------*/
+bool rviMsgpackFindMember ( const char* data, size_t length, const char* key,
+                            const char** value, size_t* valueLength )
+{
+    TRviMsgpackReader reader;
+    unsigned char     type;
+    uint64_t          count = 0;
+    uint64_t          keyLength;
+    size_t            wanted = strlen ( key );
+    size_t            start;
+    bool              match;
+    bool              found = false;
+
+    if ( !data || length == 0 )
+    {
+        return false;
+    }
+    reader.data   = (const unsigned char*)data;
+    reader.length = length;
+    reader.offset = 1;
+
+    type = reader.data[0];
+    if ( ( type & 0xf0 ) == 0x80 )
+    {
+        count = type & 0x0f;
+    }
+    else if ( ( type != 0xde && type != 0xdf ) ||
+              !rviMsgpackGet ( &reader, 2 << ( type - 0xde ), &count ) )
+    {
+        return false;
+    }
+
+    while ( count-- > 0 )
+    {
+        if ( !rviMsgpackGetStringLength ( &reader, &keyLength ) ||
+             reader.length - reader.offset < keyLength )
+        {
+            return false;
+        }
+        match = keyLength == wanted &&
+                memcmp ( reader.data + reader.offset, key, wanted ) == 0;
+        reader.offset += keyLength;
+
+        start = reader.offset;
+        if ( !rviMsgpackSkip ( &reader, 1 ) )
+        {
+            return false;
+        }
+        if ( match )
+        {
+            *value       = data + start;
+            *valueLength = reader.offset - start;
+            found        = true;
+        }
+    }
+    return found;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ g e t _ i n t e g e r
+
+	@brief Read an integer encoded with MessagePack, without building a
+           JSON value for it.
+
+	@param[in] data - The encoded value
+	@param[in] length - The number of bytes in data
+	@param[out] v - Set to the integer
+
+	@return valid - true if the data holds exactly one integer that fits
+                    in a long long
+
+------------------------------------------------------------------------*/
+bool rviMsgpackGetInteger ( const char* data, size_t length, long long* v )
+{
+    TRviMsgpackReader reader;
+    unsigned char     type;
+    uint64_t          bits;
+
+    if ( !data || length == 0 )
+    {
+        return false;
+    }
+    reader.data   = (const unsigned char*)data;
+    reader.length = length;
+    reader.offset = 1;
+
+    type = reader.data[0];
+    if ( type <= 0x7f )
+    {
+        *v = type;
+    }
+    else if ( type >= 0xe0 )
+    {
+        *v = (signed char)type;
+    }
+    else if ( type >= 0xcc && type <= 0xcf )
+    {
+        if ( !rviMsgpackGet ( &reader, 1 << ( type - 0xcc ), &bits ) ||
+             bits > LLONG_MAX )
+        {
+            return false;
+        }
+        *v = bits;
+    }
+    else if ( type >= 0xd0 && type <= 0xd3 )
+    {
+        if ( !rviMsgpackGet ( &reader, 1 << ( type - 0xd0 ), &bits ) )
+        {
+            return false;
+        }
+        switch ( type )
+        {
+        case 0xd0: *v = (int8_t)bits;  break;
+        case 0xd1: *v = (int16_t)bits; break;
+        case 0xd2: *v = (int32_t)bits; break;
+        default:   *v = (int64_t)bits; break;
+        }
+    }
+    else
+    {
+        return false;
+    }
+    return reader.offset == length;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ f r a m e _ b e g i n
+
+	@brief Start a binary frame at the end of a buffer.
+
+	The header is appended with the length left blank; append the payload,
+    then call rviMsgpackFrameEnd().
+
+	@param[in] buffer - The address of the buffer
+	@param[out] start - Set to the offset of the frame in the buffer
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviMsgpackFrameBegin ( TRviBuffer* buffer, size_t* start )
+{
+    *start = rviBufferLength ( buffer );
+
+    return rviMsgpackPut ( buffer, RVI_FRAME_MARKER, 0, 4 );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ f r a m e _ e n d
+
+	@brief Fill in the length of a binary frame started with
+           rviMsgpackFrameBegin().
+
+	@param[in] buffer - The address of the buffer
+	@param[in] start - The offset of the frame in the buffer
+
+	@return status - 0: Success
+                    ~0: An error code, if the payload is too long
+
+------------------------------------------------------------------------*/
+int rviMsgpackFrameEnd ( TRviBuffer* buffer, size_t start )
+{
+    unsigned char* header = (unsigned char*)rviBufferData ( buffer ) + start;
+    size_t         length = rviBufferLength ( buffer ) - start -
+                            RVI_FRAME_HEADER;
+
+    if ( length > UINT32_MAX )
+    {
+        return EINVAL;
+    }
+    header[1] = length >> 24;
+    header[2] = length >> 16;
+    header[3] = length >> 8;
+    header[4] = length;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ m s g p a c k _ f r a m e _ n e x t
+
+	@brief Find the binary frame at the head of a buffer.
+
+	The buffer must start with a frame marker, see rviMsgpackIsFrame(). The
+    payload follows the header, at RVI_FRAME_HEADER bytes into the frame.
+
+	@param[in] buffer - The address of the buffer
+
+	@return length - The length of the whole frame, or 0 if it has not all
+                     been received yet
+
+------------------------------------------------------------------------*/
+size_t rviMsgpackFrameNext ( TRviBuffer* buffer )
+{
+    const unsigned char* data   = (const unsigned char*)rviBufferData ( buffer );
+    size_t               length = rviBufferLength ( buffer );
+    size_t               frame;
+
+    if ( length < RVI_FRAME_HEADER )
+    {
+        return 0;
+    }
+    frame = RVI_FRAME_HEADER + ( ( (size_t)data[1] << 24 ) |
+                                 ( (size_t)data[2] << 16 ) |
+                                 ( (size_t)data[3] << 8 ) | data[4] );
+
+    return length >= frame ? frame : 0;
+}
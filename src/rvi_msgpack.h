@@ -0,0 +1,65 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_MSGPACK_H_
+#define _RVI_MSGPACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <jansson.h>
+
+#include "rvi_buffer.h"
+
+//
+//  Binary frames carry one message encoded with MessagePack. Each starts
+//  with a marker byte, 0xc1, which MessagePack never uses and which cannot
+//  begin a JSON message, so that binary frames and JSON messages can be told
+//  apart in the same stream. The marker is followed by the length of the
+//  payload as 4 bytes, most significant first, and then the payload.
+//
+#define RVI_FRAME_MARKER  0xc1
+#define RVI_FRAME_HEADER  5
+
+//
+//  Deepest nesting of arrays and maps accepted when decoding.
+//
+#define RVI_MSGPACK_MAX_DEPTH  64
+
+
+int rviMsgpackPutMap ( TRviBuffer* buffer, size_t count );
+
+int rviMsgpackPutString ( TRviBuffer* buffer, const char* string,
+                          size_t length );
+
+int rviMsgpackPutInteger ( TRviBuffer* buffer, long long v );
+
+int rviMsgpackEncode ( TRviBuffer* buffer, json_t* value );
+
+json_t* rviMsgpackDecode ( const char* data, size_t length );
+
+bool rviMsgpackFindMember ( const char* data, size_t length, const char* key,
+                            const char** value, size_t* valueLength );
+
+bool rviMsgpackGetInteger ( const char* data, size_t length, long long* v );
+
+int rviMsgpackFrameBegin ( TRviBuffer* buffer, size_t* start );
+
+int rviMsgpackFrameEnd ( TRviBuffer* buffer, size_t start );
+
+size_t rviMsgpackFrameNext ( TRviBuffer* buffer );
+
+static inline bool rviMsgpackIsFrame ( TRviBuffer* buffer )
+{
+    return rviBufferLength ( buffer ) > 0 &&
+           (unsigned char)rviBufferData ( buffer )[0] == RVI_FRAME_MARKER;
+}
+
+
+#endif // _RVI_MSGPACK_H_
@@ -0,0 +1,231 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "rvi_trie.h"
+
+
+static TRviTrieNode* rviTrieNodeCreate ( char c )
+{
+    TRviTrieNode* node = calloc ( 1, sizeof(TRviTrieNode) );
+
+    if ( node )
+    {
+        node->c = c;
+    }
+    return node;
+}
+
+
+static void rviTrieNodeDestroy ( TRviTrieNode* node )
+{
+    TRviTrieNode* next;
+
+    while ( node )
+    {
+        next = node->sibling;
+        rviTrieNodeDestroy ( node->child );
+        rviTrieNodeDestroy ( node->wildcard );
+        free ( node );
+        node = next;
+    }
+}
+
+
+//
+//  Skip the rest of the current topic, including the '/' that ends it.
+//
+static const char* rviTrieSkipTopic ( const char* s )
+{
+    while ( *s != '\0' && *s++ != '/' )
+        ;
+    return s;
+}
+
+
+static bool rviTrieMatchNode ( const TRviTrieNode* node, const char* name )
+{
+    const TRviTrieNode* child;
+
+    while ( node )
+    {
+        //
+        //  Every name below a node where a pattern ends is a match.
+        //
+        if ( node->terminal )
+        {
+            return true;
+        }
+        if ( *name == '\0' )
+        {
+            return false;
+        }
+        //
+        //  Try the wildcard first; if that fails, fall back to the literal
+        //  child for the next character.
+        //
+        if ( node->wildcard &&
+             rviTrieMatchNode ( node->wildcard, rviTrieSkipTopic ( name ) ) )
+        {
+            return true;
+        }
+        for ( child = node->child; child; child = child->sibling )
+        {
+            if ( child->c == *name )
+            {
+                break;
+            }
+        }
+        node = child;
+        name++;
+    }
+    return false;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ i n i t i a l i z e
+
+	@brief Initialize a new, empty trie.
+
+	@param[in] trie - The address of the trie to initialize
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviTrieInitialize ( TRviTrie* trie )
+{
+    trie->root  = NULL;
+    trie->count = 0;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ f r e e
+
+	@brief Release all of the nodes in a trie.
+
+	The trie is left empty and may be used again.
+
+	@param[in] trie - The address of the trie
+
+------------------------------------------------------------------------*/
+void rviTrieFree ( TRviTrie* trie )
+{
+    rviTrieNodeDestroy ( trie->root );
+
+    rviTrieInitialize ( trie );
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ i n s e r t
+
+	@brief Add a pattern to a trie.
+
+	Each character of the pattern is added as a literal node, except that a
+    '+' adds a wildcard node and the rest of that topic in the pattern is
+    ignored.
+
+	@param[in] trie - The address of the trie
+	@param[in] pattern - The service name pattern to add
+
+	@return status - 0: Success
+                    ~0: An error code
+
+------------------------------------------------------------------------*/
+int rviTrieInsert ( TRviTrie* trie, const char* pattern )
+{
+    TRviTrieNode* node;
+    TRviTrieNode* child;
+
+    if ( !pattern )
+    {
+        return EINVAL;
+    }
+    if ( !trie->root && !( trie->root = rviTrieNodeCreate ( '\0' ) ) )
+    {
+        return ENOMEM;
+    }
+    node = trie->root;
+
+    while ( *pattern != '\0' )
+    {
+        //
+        //  If a shorter pattern already covers this one, we're done.
+        //
+        if ( node->terminal )
+        {
+            break;
+        }
+        if ( *pattern == '+' )
+        {
+            if ( !node->wildcard &&
+                 !( node->wildcard = rviTrieNodeCreate ( '+' ) ) )
+            {
+                return ENOMEM;
+            }
+            node    = node->wildcard;
+            pattern = rviTrieSkipTopic ( pattern );
+            continue;
+        }
+        for ( child = node->child; child; child = child->sibling )
+        {
+            if ( child->c == *pattern )
+            {
+                break;
+            }
+        }
+        if ( !child )
+        {
+            if ( !( child = rviTrieNodeCreate ( *pattern ) ) )
+            {
+                return ENOMEM;
+            }
+            child->sibling = node->child;
+            node->child    = child;
+        }
+        node = child;
+        pattern++;
+    }
+    node->terminal = true;
+    trie->count++;
+
+    return 0;
+}
+
+
+/*!-----------------------------------------------------------------------
+
+    r v i _ t r i e _ m a t c h
+
+	@brief Test whether a name matches any pattern in a trie.
+
+	@param[in] trie - The address of the trie
+	@param[in] name - The fully qualified service name to test
+
+	@return match - true if some pattern matches the name
+
+------------------------------------------------------------------------*/
+bool rviTrieMatch ( const TRviTrie* trie, const char* name )
+{
+    if ( !name )
+    {
+        return false;
+    }
+    return rviTrieMatchNode ( trie->root, name );
+}
@@ -0,0 +1,56 @@
+/*
+    Copyright (C) 2016, Jaguar Land Rover. All Rights Reserved.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this file,
+    You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+
+#ifndef _RVI_TRIE_H_
+#define _RVI_TRIE_H_
+
+#include <stdbool.h>
+
+//
+//  A node in the topic trie. Literal children are kept in a sibling list;
+//  the patterns in a set of rights share long prefixes (the domain and
+//  device parts of the service names), so nodes have few children. A '+'
+//  in a pattern stands for the rest of the current topic, up to and
+//  including the next '/', and is stored as a separate wildcard child.
+//
+typedef struct TRviTrieNode
+{
+    struct TRviTrieNode*  child;     // First literal child
+    struct TRviTrieNode*  sibling;   // Next child of the same parent
+    struct TRviTrieNode*  wildcard;  // Child following a '+' wildcard
+    char                  c;         // Character leading to this node
+    bool                  terminal;  // A pattern ends at this node
+
+}   TRviTrieNode;
+
+
+//
+//  A set of service name patterns compiled into a trie. A name matches the
+//  set if any pattern is a prefix of it, with each '+' matching one topic.
+//  The cost of a match depends on the length of the name rather than the
+//  number of patterns.
+//
+typedef struct TRviTrie
+{
+    TRviTrieNode*  root;     // Root node, NULL if the trie is empty
+    unsigned int   count;    // Number of patterns inserted
+
+}   TRviTrie;
+
+
+int rviTrieInitialize ( TRviTrie* trie );
+
+void rviTrieFree ( TRviTrie* trie );
+
+int rviTrieInsert ( TRviTrie* trie, const char* pattern );
+
+bool rviTrieMatch ( const TRviTrie* trie, const char* name );
+
+
+#endif // _RVI_TRIE_H_
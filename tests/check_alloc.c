@@ -0,0 +1,104 @@
+/*
+ * Test suite for the message arena and the object pools
+ */
+
+#include "rvi_alloc.h"
+
+#include <check.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+START_TEST(test_arena_rewind)
+{
+    TRviArena arena;
+    TRviArenaMark start, mark;
+    char *a, *b, *big;
+    int local;
+
+    rviArenaInitialize( &arena, 1024 );
+    start = rviArenaMark( &arena );
+
+    a = rviArenaAlloc( &arena, 100 );
+    ck_assert_ptr_ne( a, NULL );
+    ck_assert_int_eq( (uintptr_t)a % RVI_ALLOC_ALIGN, 0 );
+    memset( a, 'a', 100 );
+
+    /* Blocks larger than a chunk get a chunk of their own */
+    big = rviArenaAlloc( &arena, 4096 );
+    ck_assert_ptr_ne( big, NULL );
+    memset( big, 'x', 4096 );
+    ck_assert( rviArenaContains( &arena, big + 4095 ) );
+
+    mark = rviArenaMark( &arena );
+    b = rviArenaAlloc( &arena, 10 );
+    rviArenaRewind( &arena, mark );
+    ck_assert_ptr_eq( rviArenaAlloc( &arena, 10 ), b );
+    ck_assert_int_eq( a[99], 'a' );
+
+    ck_assert( rviArenaContains( &arena, a ) );
+    ck_assert( !rviArenaContains( &arena, &local ) );
+
+    /* Storage of regular size is reused after rewinding to the start */
+    rviArenaRewind( &arena, start );
+    ck_assert_ptr_eq( rviArenaAlloc( &arena, 100 ), a );
+
+    rviArenaFree( &arena );
+}
+END_TEST
+
+START_TEST(test_pool_reuse)
+{
+    TRviPool pool = RVI_POOL_INITIALIZER( 40 );
+    void *objects[RVI_POOL_SLAB_OBJECTS * 2];
+    void *freed;
+    int i;
+
+    for( i = 0; i < RVI_POOL_SLAB_OBJECTS * 2; i++ ) {
+        objects[i] = rviPoolAlloc( &pool );
+        ck_assert_ptr_ne( objects[i], NULL );
+        memset( objects[i], i, 40 );
+    }
+
+    freed = objects[5];
+    rviPoolRelease( &pool, freed );
+    ck_assert_ptr_eq( rviPoolAlloc( &pool ), freed );
+    ck_assert_int_eq( ( (unsigned char *)objects[6] )[39], 6 );
+
+    rviPoolFree( &pool );
+}
+END_TEST
+
+Suite *alloc_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s= suite_create("Alloc");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_arena_rewind);
+    tcase_add_test(tc_core, test_pool_reuse);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = alloc_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,130 @@
+/*
+ * Test suite for the btree used to index services by name
+ */
+
+#include "btree.h"
+
+#include <check.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NKEYS 1000
+
+static int compareInt( void *a, void *b )
+{
+    return *(int *)a - *(int *)b;
+}
+
+static int matchOdd( void *record, void *context )
+{
+    (void)context;
+    return *(int *)record % 2;
+}
+
+static int matchNone( void *record, void *context )
+{
+    (void)record;
+    (void)context;
+    return 0;
+}
+
+static int matchAll( void *record, void *context )
+{
+    (void)record;
+    (void)context;
+    return 1;
+}
+
+/* Check that the records are visited in ascending order */
+static int checkOrder( void *record, void *context )
+{
+    int *last = context;
+
+    ck_assert( *(int *)record > *last );
+    *last = *(int *)record;
+
+    return 0;
+}
+
+START_TEST(test_btree_remove_if)
+{
+    btree_t *btree;
+    int keys[NKEYS];
+    int last = -1;
+    int i;
+
+    btree = btree_create( 2, compareInt );
+    ck_assert_ptr_ne( btree, NULL );
+
+    for( i = 0; i < NKEYS; i++ ) {
+        keys[i] = ( i * 7 ) % NKEYS;
+        btree_insert( btree, &keys[i] );
+    }
+
+    ck_assert_int_eq( btree_remove_if( btree, matchNone, NULL ), 0 );
+    ck_assert_int_eq( btree->count, NKEYS );
+
+    ck_assert_int_eq( btree_remove_if( btree, matchOdd, NULL ), NKEYS / 2 );
+    ck_assert_int_eq( btree->count, NKEYS / 2 );
+
+    for( i = 0; i < NKEYS; i++ ) {
+        if( i % 2 ) {
+            ck_assert_ptr_eq( btree_search( btree, &i ), NULL );
+        } else {
+            ck_assert_int_eq( *(int *)btree_search( btree, &i ), i );
+        }
+    }
+    btree_foreach( btree, checkOrder, &last );
+    ck_assert_int_eq( last, NKEYS - 2 );
+
+    /* The rebuilt tree must still take inserts */
+    last = -1;
+    for( i = 0; i < NKEYS; i++ ) {
+        if( keys[i] % 2 ) {
+            btree_insert( btree, &keys[i] );
+        }
+    }
+    ck_assert_int_eq( btree->count, NKEYS );
+    btree_foreach( btree, checkOrder, &last );
+    ck_assert_int_eq( last, NKEYS - 1 );
+
+    ck_assert_int_eq( btree_remove_if( btree, matchAll, NULL ), NKEYS );
+    ck_assert_int_eq( btree->count, 0 );
+
+    btree_destroy( btree );
+}
+END_TEST
+
+Suite *btree_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s= suite_create("Btree");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_btree_remove_if);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = btree_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
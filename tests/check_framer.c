@@ -0,0 +1,174 @@
+/* 
+ * Test suite for the receive buffer and JSON message framer
+ */
+
+#include "rvi_buffer.h"
+
+#include <check.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+START_TEST(test_framer_pipelined)
+{
+    TRviBuffer buf;
+    TRviFramer framer;
+    const char *stream = "{\"cmd\":\"sa\"}{\"cmd\":\"ping\"}";
+    size_t len;
+
+    rviBufferInitialize( &buf );
+    rviFramerInitialize( &framer );
+    rviBufferAppend( &buf, stream, strlen( stream ) );
+
+    len = rviFramerNext( &framer, &buf );
+    ck_assert_int_eq( len, strlen( "{\"cmd\":\"sa\"}" ) );
+    rviBufferConsume( &buf, len );
+
+    len = rviFramerNext( &framer, &buf );
+    ck_assert_int_eq( len, strlen( "{\"cmd\":\"ping\"}" ) );
+    ck_assert( strncmp( rviBufferData( &buf ), "{\"cmd\":\"ping\"}", len ) == 0 );
+    rviBufferConsume( &buf, len );
+
+    ck_assert_int_eq( rviFramerNext( &framer, &buf ), 0 );
+    ck_assert_int_eq( rviBufferLength( &buf ), 0 );
+
+    rviBufferFree( &buf );
+}
+END_TEST
+
+START_TEST(test_framer_fragmented)
+{
+    TRviBuffer buf;
+    TRviFramer framer;
+    const char *msg = "{\"data\":{\"s\":\"}{\\\"[\",\"a\":[1,{\"b\":2}]}}";
+    size_t i;
+
+    rviBufferInitialize( &buf );
+    rviFramerInitialize( &framer );
+
+    /* Deliver the message one byte at a time */
+    for( i = 0; i < strlen( msg ) - 1; i++ ) {
+        rviBufferAppend( &buf, &msg[i], 1 );
+        ck_assert_int_eq( rviFramerNext( &framer, &buf ), 0 );
+    }
+    ck_assert_int_eq( rviFramerPending( &framer ), strlen( msg ) - 1 );
+
+    rviBufferAppend( &buf, &msg[i], 1 );
+    ck_assert_int_eq( rviFramerNext( &framer, &buf ), strlen( msg ) );
+
+    rviBufferFree( &buf );
+}
+END_TEST
+
+START_TEST(test_framer_leading_junk)
+{
+    TRviBuffer buf;
+    TRviFramer framer;
+    const char *stream = " \n xx{\"cmd\":\"au\"}";
+
+    rviBufferInitialize( &buf );
+    rviFramerInitialize( &framer );
+    rviBufferAppend( &buf, stream, strlen( stream ) );
+
+    ck_assert_int_eq( rviFramerNext( &framer, &buf ), 
+                      strlen( "{\"cmd\":\"au\"}" ) );
+    ck_assert( rviBufferData( &buf )[0] == '{' );
+
+    rviBufferFree( &buf );
+}
+END_TEST
+
+START_TEST(test_framer_validate)
+{
+    const char *ok = " {\"a\":[1,2,{\"b\":\"}\\\"\"}]} \n";
+    const char *open = "{\"a\":[1,2}";
+    const char *trailing = "{\"a\":1}{";
+
+    ck_assert( rviFramerValidate( ok, strlen( ok ) ) );
+    ck_assert( rviFramerValidate( "[]", 2 ) );
+    ck_assert( !rviFramerValidate( open, strlen( open ) ) );
+    ck_assert( !rviFramerValidate( trailing, strlen( trailing ) ) );
+    ck_assert( !rviFramerValidate( "42", 2 ) );
+    ck_assert( !rviFramerValidate( "", 0 ) );
+    /* Closing brackets must match their openers */
+    ck_assert( !rviFramerValidate( "{]", 2 ) );
+    ck_assert( !rviFramerValidate( "[}", 2 ) );
+    ck_assert( !rviFramerValidate( "{\"a\":[1}]", 10 ) );
+    ck_assert( !rviFramerValidate( "{\"a\":1]", 8 ) );
+}
+END_TEST
+
+START_TEST(test_buffer_json_string)
+{
+    TRviBuffer buf;
+    const char *expected = "\"a\\\"b\\\\c\\u000a\"";
+
+    rviBufferInitialize( &buf );
+    rviBufferAppendJsonString( &buf, "a\"b\\c\n" );
+
+    ck_assert_int_eq( rviBufferLength( &buf ), strlen( expected ) );
+    ck_assert( strncmp( rviBufferData( &buf ), expected, 
+                        strlen( expected ) ) == 0 );
+
+    rviBufferFree( &buf );
+}
+END_TEST
+
+START_TEST(test_json_find_member)
+{
+    const char *msg = "{\"cmd\":\"rcv\",\"tid\":7,\"data\":{\"service\":"
+                      "\"a/b\",\"timeout\":1,\"parameters\":{\"x\":\"}\"}}}";
+    const char *data, *params;
+    size_t dataLen, paramsLen;
+
+    ck_assert( rviJsonFindMember( msg, strlen( msg ), "data", 
+                                  &data, &dataLen ) );
+    ck_assert( rviJsonFindMember( data, dataLen, "parameters", 
+                                  &params, &paramsLen ) );
+    ck_assert_int_eq( paramsLen, strlen( "{\"x\":\"}\"}" ) );
+    ck_assert( strncmp( params, "{\"x\":\"}\"}", paramsLen ) == 0 );
+
+    ck_assert( rviJsonFindMember( msg, strlen( msg ), "tid", 
+                                  &params, &paramsLen ) );
+    ck_assert( strncmp( params, "7", paramsLen ) == 0 );
+    ck_assert( !rviJsonFindMember( msg, strlen( msg ), "parameters", 
+                                   &params, &paramsLen ) );
+}
+END_TEST
+
+Suite *framer_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s= suite_create("Framer");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_framer_pipelined);
+    tcase_add_test(tc_core, test_framer_fragmented);
+    tcase_add_test(tc_core, test_framer_leading_junk);
+    tcase_add_test(tc_core, test_framer_validate);
+    tcase_add_test(tc_core, test_buffer_json_string);
+    tcase_add_test(tc_core, test_json_find_member);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = framer_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
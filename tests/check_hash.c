@@ -0,0 +1,114 @@
+/*
+ * Test suite for the open addressing hash table
+ */
+
+#include "rvi_hash.h"
+
+#include <check.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NKEYS 1000
+
+START_TEST(test_hash_insert_find)
+{
+    TRviHash hash;
+    char *keys[NKEYS];
+    int i;
+
+    rviHashInitialize( &hash, rviHashString, rviHashStringEqual );
+
+    for( i = 0; i < NKEYS; i++ ) {
+        keys[i] = malloc( 32 );
+        sprintf( keys[i], "genivi.org/node/%d", i );
+        ck_assert_int_eq( rviHashInsert( &hash, keys[i], keys[i] ), 0 );
+    }
+    ck_assert_int_eq( rviHashGetCount( &hash ), NKEYS );
+    ck_assert_int_eq( rviHashInsert( &hash, keys[7], keys[7] ), EEXIST );
+
+    for( i = 0; i < NKEYS; i++ ) {
+        ck_assert_ptr_eq( rviHashFind( &hash, keys[i] ), keys[i] );
+    }
+    ck_assert_ptr_eq( rviHashFind( &hash, "genivi.org/node/x" ), NULL );
+
+    rviHashFree( &hash );
+    for( i = 0; i < NKEYS; i++ ) {
+        free( keys[i] );
+    }
+}
+END_TEST
+
+START_TEST(test_hash_remove)
+{
+    TRviHash hash;
+    char *keys[NKEYS];
+    size_t index = 0;
+    int i, n = 0;
+
+    rviHashInitialize( &hash, rviHashString, rviHashStringEqual );
+
+    for( i = 0; i < NKEYS; i++ ) {
+        keys[i] = malloc( 32 );
+        sprintf( keys[i], "%d", i );
+        rviHashInsert( &hash, keys[i], keys[i] );
+    }
+
+    /* Remove every other key; the rest must still be reachable */
+    for( i = 0; i < NKEYS; i += 2 ) {
+        ck_assert_ptr_eq( rviHashRemove( &hash, keys[i] ), keys[i] );
+    }
+    ck_assert_ptr_eq( rviHashRemove( &hash, keys[0] ), NULL );
+    ck_assert_int_eq( rviHashGetCount( &hash ), NKEYS / 2 );
+
+    for( i = 0; i < NKEYS; i++ ) {
+        ck_assert_ptr_eq( rviHashFind( &hash, keys[i] ),
+                          ( i % 2 ) ? keys[i] : NULL );
+    }
+
+    while( rviHashNext( &hash, &index ) ) {
+        n++;
+    }
+    ck_assert_int_eq( n, NKEYS / 2 );
+
+    rviHashFree( &hash );
+    for( i = 0; i < NKEYS; i++ ) {
+        free( keys[i] );
+    }
+}
+END_TEST
+
+Suite *hash_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s= suite_create("Hash");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_hash_insert_find);
+    tcase_add_test(tc_core, test_hash_remove);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = hash_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
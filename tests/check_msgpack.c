@@ -0,0 +1,223 @@
+/* 
+ * Test suite for the MessagePack encoder, decoder and binary frames
+ */
+
+#include "rvi_msgpack.h"
+
+#include <check.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Encode a JSON document, decode it again and compare */
+static void round_trip( const char *json )
+{
+    TRviBuffer buf;
+    json_t *value;
+    json_t *copy;
+    size_t n;
+
+    value = json_loads( json, 0, NULL );
+    ck_assert( value != NULL );
+
+    rviBufferInitialize( &buf );
+    ck_assert_int_eq( rviMsgpackEncode( &buf, value ), 0 );
+
+    copy = rviMsgpackDecode( rviBufferData( &buf ), rviBufferLength( &buf ) );
+    ck_assert( copy != NULL );
+    ck_assert( json_equal( value, copy ) );
+    json_decref( copy );
+
+    /* Every truncation of the encoding is rejected */
+    for( n = 0; n < rviBufferLength( &buf ); n++ ) {
+        ck_assert( rviMsgpackDecode( rviBufferData( &buf ), n ) == NULL );
+    }
+
+    json_decref( value );
+    rviBufferFree( &buf );
+}
+
+START_TEST(test_msgpack_message)
+{
+    round_trip( "{\"cmd\":\"rcv\",\"tid\":1234,\"mod\":\"proto_json_rpc\","
+                "\"data\":{\"service\":\"genivi.org/vin/1/hvac\","
+                "\"timeout\":1500000000000,\"parameters\":"
+                "{\"temp\":21.5,\"fan\":[1,2,3],\"x\":null,"
+                "\"t\":true,\"f\":false}}}" );
+    round_trip( "[\"\",\"abcdefghijklmnopqrstuvwxyz01234\","
+                "\"abcdefghijklmnopqrstuvwxyz012345\",\"h\\u00e9llo\"]" );
+}
+END_TEST
+
+START_TEST(test_msgpack_integers)
+{
+    /* Each side of every change in encoded width */
+    round_trip( "[0,127,128,255,256,65535,65536,4294967295,4294967296,"
+                "-1,-32,-33,-128,-129,-32768,-32769,-2147483648,"
+                "-2147483649,9223372036854775807,-9223372036854775807]" );
+}
+END_TEST
+
+START_TEST(test_msgpack_frame)
+{
+    TRviBuffer buf;
+    json_t *value;
+    json_t *copy;
+    size_t start;
+    size_t len;
+
+    value = json_loads( "{\"cmd\":\"sa\",\"stat\":\"av\"}", 0, NULL );
+    rviBufferInitialize( &buf );
+    ck_assert_int_eq( rviMsgpackFrameBegin( &buf, &start ), 0 );
+    ck_assert_int_eq( rviMsgpackEncode( &buf, value ), 0 );
+    ck_assert_int_eq( rviMsgpackFrameEnd( &buf, start ), 0 );
+    ck_assert( rviMsgpackIsFrame( &buf ) );
+    len = rviBufferLength( &buf );
+
+    /* A partly received frame is not returned */
+    buf.end--;
+    ck_assert_int_eq( rviMsgpackFrameNext( &buf ), 0 );
+    buf.end++;
+    ck_assert_int_eq( rviMsgpackFrameNext( &buf ), len );
+
+    copy = rviMsgpackDecode( rviBufferData( &buf ) + RVI_FRAME_HEADER,
+                             len - RVI_FRAME_HEADER );
+    ck_assert( copy != NULL );
+    ck_assert( json_equal( value, copy ) );
+
+    /* A JSON message is not mistaken for a frame */
+    rviBufferConsume( &buf, len );
+    rviBufferAppend( &buf, "{}", 2 );
+    ck_assert( !rviMsgpackIsFrame( &buf ) );
+
+    json_decref( copy );
+    json_decref( value );
+    rviBufferFree( &buf );
+}
+END_TEST
+
+START_TEST(test_msgpack_find_member)
+{
+    TRviBuffer buf;
+    json_t *value;
+    json_t *copy;
+    const char *data;
+    const char *member;
+    size_t dataLen;
+    size_t memberLen;
+    long long v;
+
+    value = json_loads( "{\"cmd\":\"rcv\",\"tid\":7,\"data\":"
+                        "{\"parameters\":[{\"a\":1.5},\"x\",null],"
+                        "\"timeout\":1500000000000}}", 0, NULL );
+    rviBufferInitialize( &buf );
+    ck_assert_int_eq( rviMsgpackEncode( &buf, value ), 0 );
+
+    ck_assert( rviMsgpackFindMember( rviBufferData( &buf ), 
+                                     rviBufferLength( &buf ), "cmd", 
+                                     &member, &memberLen ) );
+    ck_assert_int_eq( memberLen, 4 );
+    ck_assert( memcmp( member, "\xa3rcv", 4 ) == 0 );
+
+    /* Members of nested maps are found within the outer member's value */
+    ck_assert( rviMsgpackFindMember( rviBufferData( &buf ), 
+                                     rviBufferLength( &buf ), "data", 
+                                     &data, &dataLen ) );
+    ck_assert( rviMsgpackFindMember( data, dataLen, "timeout", 
+                                     &member, &memberLen ) );
+    ck_assert( rviMsgpackGetInteger( member, memberLen, &v ) );
+    ck_assert( v == 1500000000000LL );
+    ck_assert( rviMsgpackFindMember( data, dataLen, "parameters", 
+                                     &member, &memberLen ) );
+    copy = rviMsgpackDecode( member, memberLen );
+    ck_assert( json_equal( copy, json_object_get( 
+                   json_object_get( value, "data" ), "parameters" ) ) );
+    json_decref( copy );
+
+    ck_assert( !rviMsgpackFindMember( rviBufferData( &buf ), 
+                                      rviBufferLength( &buf ), "timeout", 
+                                      &member, &memberLen ) );
+    /* Truncated data is not scanned past */
+    ck_assert( !rviMsgpackFindMember( data, dataLen - 1, "timeout", 
+                                      &member, &memberLen ) );
+    /* Only maps have members */
+    ck_assert( !rviMsgpackFindMember( "\x91\xc0", 2, "a", 
+                                      &member, &memberLen ) );
+
+    /* Integers of every width, and nothing else */
+    ck_assert( rviMsgpackGetInteger( "\xff", 1, &v ) && v == -1 );
+    ck_assert( rviMsgpackGetInteger( "\xd1\x80\x00", 3, &v ) && 
+               v == -32768 );
+    ck_assert( rviMsgpackGetInteger( "\xce\xff\xff\xff\xff", 5, &v ) && 
+               v == 4294967295LL );
+    ck_assert( !rviMsgpackGetInteger( "\xcf\xff\xff\xff\xff"
+                                      "\xff\xff\xff\xff", 9, &v ) );
+    ck_assert( !rviMsgpackGetInteger( "\xcd\x01", 2, &v ) );
+    ck_assert( !rviMsgpackGetInteger( "\xa1\x31", 2, &v ) );
+    ck_assert( !rviMsgpackGetInteger( "\x01\x02", 2, &v ) );
+
+    json_decref( value );
+    rviBufferFree( &buf );
+}
+END_TEST
+
+START_TEST(test_msgpack_reject)
+{
+    TRviBuffer buf;
+    int i;
+
+    /* Keys that are not strings, binary data, NULs and bad UTF-8 */
+    ck_assert( rviMsgpackDecode( "\x81\x01\x02", 3 ) == NULL );
+    ck_assert( rviMsgpackDecode( "\xc4\x01\x00", 3 ) == NULL );
+    ck_assert( rviMsgpackDecode( "\xa2\x61\x00", 3 ) == NULL );
+    ck_assert( rviMsgpackDecode( "\xa1\xff", 2 ) == NULL );
+    /* Trailing bytes after the value */
+    ck_assert( rviMsgpackDecode( "\xc0\xc0", 2 ) == NULL );
+
+    /* Nesting beyond the limit */
+    rviBufferInitialize( &buf );
+    for( i = 0; i <= RVI_MSGPACK_MAX_DEPTH; i++ ) {
+        rviBufferAppend( &buf, "\x91", 1 );
+    }
+    rviBufferAppend( &buf, "\xc0", 1 );
+    ck_assert( rviMsgpackDecode( rviBufferData( &buf ), 
+                                 rviBufferLength( &buf ) ) == NULL );
+    rviBufferFree( &buf );
+}
+END_TEST
+
+Suite *msgpack_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s= suite_create("MessagePack");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_msgpack_message);
+    tcase_add_test(tc_core, test_msgpack_integers);
+    tcase_add_test(tc_core, test_msgpack_frame);
+    tcase_add_test(tc_core, test_msgpack_find_member);
+    tcase_add_test(tc_core, test_msgpack_reject);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = msgpack_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,96 @@
+/*
+ * Test suite for the topic trie used to match service rights
+ */
+
+#include "rvi_trie.h"
+
+#include <check.h>
+
+#include <stdlib.h>
+
+START_TEST(test_trie_prefix)
+{
+    TRviTrie trie;
+
+    rviTrieInitialize( &trie );
+    ck_assert( !rviTrieMatch( &trie, "genivi.org/vin/1/unlock" ) );
+
+    rviTrieInsert( &trie, "genivi.org/vin/1/" );
+    rviTrieInsert( &trie, "jlr.com/backend/log" );
+
+    ck_assert( rviTrieMatch( &trie, "genivi.org/vin/1/unlock" ) );
+    ck_assert( rviTrieMatch( &trie, "jlr.com/backend/log" ) );
+    ck_assert( rviTrieMatch( &trie, "jlr.com/backend/logger" ) );
+    ck_assert( !rviTrieMatch( &trie, "genivi.org/vin/2/unlock" ) );
+    ck_assert( !rviTrieMatch( &trie, "genivi.org/vin/1" ) );
+    ck_assert( !rviTrieMatch( &trie, "jlr.com/backend/lo" ) );
+
+    rviTrieFree( &trie );
+}
+END_TEST
+
+START_TEST(test_trie_wildcard)
+{
+    TRviTrie trie;
+
+    rviTrieInitialize( &trie );
+    rviTrieInsert( &trie, "genivi.org/+/+/lock" );
+    rviTrieInsert( &trie, "genivi.org/vin/1/unlock" );
+
+    ck_assert( rviTrieMatch( &trie, "genivi.org/vin/2/lock" ) );
+    ck_assert( rviTrieMatch( &trie, "genivi.org/node/xyz/lock" ) );
+    ck_assert( rviTrieMatch( &trie, "genivi.org/vin/1/unlock" ) );
+    ck_assert( !rviTrieMatch( &trie, "genivi.org/vin/2/unlock" ) );
+    ck_assert( !rviTrieMatch( &trie, "genivi.org/vin/lock" ) );
+
+    rviTrieFree( &trie );
+}
+END_TEST
+
+START_TEST(test_trie_match_all)
+{
+    TRviTrie trie;
+
+    rviTrieInitialize( &trie );
+    rviTrieInsert( &trie, "" );
+
+    ck_assert( rviTrieMatch( &trie, "anything/at/all" ) );
+    ck_assert( rviTrieMatch( &trie, "" ) );
+
+    rviTrieFree( &trie );
+}
+END_TEST
+
+Suite *trie_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s= suite_create("Trie");
+
+    /* Core test case */
+    tc_core = tcase_create("Core");
+
+    tcase_add_test(tc_core, test_trie_prefix);
+    tcase_add_test(tc_core, test_trie_wildcard);
+    tcase_add_test(tc_core, test_trie_match_all);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
+
+int main(void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = trie_suite();
+    sr = srunner_create(s);
+
+    srunner_run_all(sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return ( number_failed == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}